@@ -0,0 +1,153 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "dlog.h"
+#include "cache_pin.h"
+
+static int pin_covers(const CachePin *p, int id, int64_t frame, short w, short h, int fmt) {
+  if (p->id < 0 || p->id != id) return 0;
+  if (frame < p->start) return 0;
+  if (p->end >= 0 && frame > p->end) return 0;
+  if (p->w > 0 && p->w != w) return 0;
+  if (p->h > 0 && p->h != h) return 0;
+  if (p->fmt >= 0 && p->fmt != fmt) return 0;
+  return 1;
+}
+
+void pinset_add(PinSet *ps, const CachePin *pin) {
+  CachePin *p;
+  int i;
+  for (i = 0; i < ps->n_pins; ++i) {
+    p = &ps->pins[i];
+    if (!strcmp(p->fn, pin->fn) && p->start == pin->start && p->end == pin->end
+        && p->w == pin->w && p->h == pin->h && p->fmt == pin->fmt) {
+      p->id = pin->id;
+      return;
+    }
+  }
+  ps->pins = realloc(ps->pins, (ps->n_pins + 1) * sizeof(CachePin));
+  p = &ps->pins[ps->n_pins++];
+  memcpy(p, pin, sizeof(CachePin));
+  p->fn = strdup(pin->fn);
+}
+
+int pinset_remove(PinSet *ps, const CachePin *f) {
+  int i, n = 0;
+  for (i = 0; i < ps->n_pins; ++i) {
+    const CachePin *p = &ps->pins[i];
+    const int keep =
+         (f->fn && strcmp(p->fn, f->fn))
+      || p->start < f->start
+      || (f->end >= 0 && (p->end < 0 || p->end > f->end))
+      || (f->w > 0 && p->w != f->w)
+      || (f->h > 0 && p->h != f->h)
+      || (f->fmt >= 0 && p->fmt != f->fmt);
+    if (keep) {
+      if (n != i) memcpy(&ps->pins[n], p, sizeof(CachePin));
+      ++n;
+    } else {
+      free(p->fn);
+    }
+  }
+  i = ps->n_pins - n;
+  ps->n_pins = n;
+  if (n == 0) {
+    free(ps->pins);
+    ps->pins = NULL;
+  }
+  return i;
+}
+
+void pinset_unbind(PinSet *ps, int id) {
+  int i;
+  for (i = 0; i < ps->n_pins; ++i) {
+    if (ps->pins[i].id == id) ps->pins[i].id = -1;
+  }
+}
+
+void pinset_bind(PinSet *ps, const char *fn, int id) {
+  int i;
+  for (i = 0; i < ps->n_pins; ++i) {
+    if (!strcmp(ps->pins[i].fn, fn)) ps->pins[i].id = id;
+  }
+}
+
+int pinset_match(const PinSet *ps, int id, int64_t frame, short w, short h, int fmt) {
+  int i;
+  for (i = 0; i < ps->n_pins; ++i) {
+    if (pin_covers(&ps->pins[i], id, frame, w, h, fmt)) return 1;
+  }
+  return 0;
+}
+
+int pinset_claim(PinSet *ps, size_t bytes) {
+  if (ps->bytes + bytes > ps->budget) {
+    return 0;
+  }
+  ps->bytes += bytes;
+  ps->lines++;
+  return 1;
+}
+
+void pinset_release(PinSet *ps, size_t bytes) {
+  assert(ps->lines > 0 && ps->bytes >= bytes);
+  ps->bytes -= bytes;
+  ps->lines--;
+}
+
+void pinset_free(PinSet *ps) {
+  int i;
+  for (i = 0; i < ps->n_pins; ++i) {
+    free(ps->pins[i].fn);
+  }
+  free(ps->pins);
+  ps->pins = NULL;
+  ps->n_pins = 0;
+}
+
+void pinset_info_html(const PinSet *ps, char **m, size_t *o, size_t *s, int tbl) {
+  int i;
+  rprintf("<tr><td colspan=\"8\" class=\"left%s\">pinned: %d lines, %.1f of %.1f MiB, pins:",
+      (tbl&1) ? "" : " line", ps->lines, ps->bytes / 1048576.0, ps->budget / 1048576.0);
+  if (ps->n_pins == 0) {
+    rprintf(" none");
+  }
+  for (i = 0; i < ps->n_pins; ++i) {
+    const CachePin *p = &ps->pins[i];
+    rprintf("%s %s%s frames %"PRIlld"..", i > 0 ? "," : "", p->fn, p->id < 0 ? " (not open)" : "", (long long) p->start);
+    if (p->end >= 0) {
+      rprintf("%"PRIlld, (long long) p->end);
+    }
+    if (p->w > 0 || p->h > 0) {
+      rprintf(" %dx%d", p->w, p->h);
+    }
+    if (p->fmt >= 0) {
+      rprintf(" fmt:%d", p->fmt);
+    }
+  }
+  rprintf("</td></tr>\n");
+}
+
+// vim:sw=2 sts=2 ts=8 et:
@@ -0,0 +1,88 @@
+/**
+   @file cache_pin.h
+   @brief cache-line pinning rules
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _CACHE_PIN_H
+#define _CACHE_PIN_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define PIN_DEFAULT_BUDGET (256 * 1048576) ///< default max. memory of pinned cache-lines
+
+/** a pin: cache-lines matching it are exempt from eviction.
+ * Pins belong to a file-name, cache-lines are keyed by file-ID: a pin
+ * only applies while the file is mapped to \a id. */
+typedef struct {
+  char *fn;       ///< file name
+  int id;         ///< current file-ID of \a fn, -1: not mapped
+  int64_t start;  ///< first frame
+  int64_t end;    ///< last frame (inclusive), -1: until the end of the file
+  short w;        ///< geometry, 0: any
+  short h;        ///< geometry, 0: any
+  int fmt;        ///< format, -1: any
+} CachePin;
+
+/** set of pins and the memory of pinned cache-lines.
+ * NB. not thread-safe, protected by the lock of the cache it belongs to */
+typedef struct {
+  CachePin *pins;
+  int n_pins;
+  size_t budget;  ///< max. pinned bytes
+  size_t bytes;   ///< currently pinned bytes
+  int lines;      ///< number of pinned cache-lines
+} PinSet;
+
+/** add a pin, \a pin->fn is copied */
+void pinset_add(PinSet *ps, const CachePin *pin);
+
+/** remove pins of file \a f->fn (NULL: any file) that lie within the frame range
+ * of \a f and match its geometry and format (0, -1: any)
+ * @return number of removed pins
+ */
+int pinset_remove(PinSet *ps, const CachePin *f);
+
+/** file-ID \a id is no longer valid, pins of it no longer apply */
+void pinset_unbind(PinSet *ps, int id);
+
+/** file \a fn was mapped to \a id, its pins apply to cache-lines of that ID */
+void pinset_bind(PinSet *ps, const char *fn, int id);
+
+/** @return 1 if a cache-line with the given key is covered by a pin */
+int pinset_match(const PinSet *ps, int id, int64_t frame, short w, short h, int fmt);
+
+/** account for a cache-line to be pinned
+ * @return 1 if it fits in the budget, 0 otherwise
+ */
+int pinset_claim(PinSet *ps, size_t bytes);
+
+/** a pinned cache-line is unpinned or freed */
+void pinset_release(PinSet *ps, size_t bytes);
+
+/** remove all pins */
+void pinset_free(PinSet *ps);
+
+/** HTML format pins and pinned memory as table-row */
+void pinset_info_html(const PinSet *ps, char **m, size_t *o, size_t *s, int tbl);
+
+#endif
@@ -25,8 +25,10 @@
 
 #include "decoder_ctrl.h"
 #include "frame_cache.h"
+#include "image_cache.h"
 #include "ffdecoder.h"
 #include "ffcompat.h"
+#include <libavutil/cpu.h>
 #include "dlog.h"
 
 #define DEFAULT_PIX_FMT (AV_PIX_FMT_RGB24) // TODO global default
@@ -42,6 +44,12 @@
 #define VOF_PENDING 8 ///< decoder is just opening a file (my_open_movie)
 #define VOF_INFO 16   ///< decoder is currently in use for info (size/fps) lookup only
 
+/* a decode of an earlier frame within this distance of the previous
+ * decode (same geometry) is considered to be backwards stepping */
+#define DCTL_REVERSE_WINDOW 600
+/* number of clients per file whose most recent decode is tracked */
+#define DCTL_REVERSE_CLIENTS 8
+
 /* id + fmt */
 #define CLKEYLEN (offsetof(JVOBJECT, frame) - offsetof(JVOBJECT, id))
 
@@ -61,10 +69,24 @@ typedef struct JVOBJECT {
   UT_hash_handle hhf;
 } /*__attribute__((__packed__)) */ JVOBJECT;
 
+typedef struct {
+  int client;     // VDEC_GET_CLIENT() of the decoder flags
+  unsigned int lru; // 0: unused
+  int64_t frame;  // most recently decoded frame of this client
+  int w, h, fmt;
+} RevState;
+
 typedef struct VidMap {
   unsigned short id;
   char *fn;
   time_t lru;
+  int have_info; // info and key are valid
+  FileKey key;   // file identity at the time info was cached
+  VInfo info;    // cached file information
+  int estimated; // frames were decoded with estimated frame-numbers (no index)
+  int stale;     // an index became available, cached frames are invalid
+  RevState rev[DCTL_REVERSE_CLIENTS]; // reverse access detection, per client
+  unsigned int rev_lru;
   UT_hash_handle hh;
   UT_hash_handle hr;
 } VidMap;
@@ -78,26 +100,37 @@ typedef struct JVD {
   unsigned short monotonic; // monotonic count for VidMap ID (wrap-around case is handled)
   int max_objects; // config
   int cache_size;  // config
+  int cpu_budget;  // config, total codec threads of all decoders, 0: auto
   int busycnt; // prevent cache purge/cleanup while decoders are active
+  int probing; // files probed without a decoder object, at most max_objects
+  void *ic; // image cache, invalidated along with file-IDs
+  int info_hits; // file-info cache statistics
+  int info_miss;
   int purge_in_progress;
   pthread_mutex_t lock_jvo;  // lock to modify (append to) jvo list (TODO consolidate w/ lock_jdh)
   pthread_rwlock_t lock_jdh; // lock for jvo index-hash
   pthread_rwlock_t lock_vml; // lock to modify monotonic (TODO consolidate w/ lock_jdh)
   pthread_mutex_t lock_busy; // lock to modify busycnt;
+  pthread_cond_t probe_cond; // signaled when a probe completes, uses lock_busy
 } JVD;
 
 ///////////////////////////////////////////////////////////////////////////////
 // ffdecoder wrappers
 
-static inline int my_decode(void *vd, unsigned long frame, uint8_t *b, int w, int h) {
+static inline int my_decode(void *vd, unsigned long frame, uint8_t *b, int w, int h, const VCrop *crop, int flags, VDecodeThrough *dt) {
   int rv;
+  ff_set_crop(vd, crop);
   ff_resize(vd, w, h, b, NULL);
+  ff_set_quality(vd, flags & VDEC_DRAFT);
+  ff_set_scaler(vd, VDEC_GET_SCALER(flags));
+  ff_set_decode_through(vd, dt);
   rv = ff_render(vd, frame, b, w, h, 0, w, w);
+  ff_set_decode_through(vd, NULL);
   ff_set_bufferptr(vd, NULL);
   return rv;
 }
 
-static inline int my_open_movie(void **vd, char *fn, int render_fmt) {
+static inline int my_open_movie(void **vd, char *fn, int render_fmt, int threads) {
   if (!fn) {
     dlog(DLOG_ERR, "DCTL: trying to open file w/o filename.\n");
     return -1;
@@ -113,8 +146,13 @@ static inline int my_open_movie(void **vd, char *fn, int render_fmt) {
       || render_fmt == AV_PIX_FMT_RGBA
       || render_fmt == AV_PIX_FMT_ARGB
       || render_fmt == AV_PIX_FMT_BGRA
+      || render_fmt == AV_PIX_FMT_NV12
+      || render_fmt == AV_PIX_FMT_YUV422P
+      || render_fmt == AV_PIX_FMT_GRAY8
+      || render_fmt == AV_PIX_FMT_RGB565
       );
 
+  ff_set_threads(*vd, threads);
   if (!ff_open_movie (*vd, fn, render_fmt)) {
     debugmsg(DEBUG_DCTL, "DCTL: opened file: '%s'\n", fn);
   } else {
@@ -133,14 +171,43 @@ static inline void my_get_info(void *vd, VInfo *i) {
   ff_get_info(vd, i);
 }
 
-static inline void my_get_info_canonical(void *vd, VInfo *i, int w, int h) {
-  ff_get_info_canonical(vd, i, w, h);
+static inline void my_get_info_canonical(void *vd, VInfo *i, int w, int h, VCrop *crop) {
+  ff_get_info_canonical(vd, i, w, h, crop);
+}
+
+static inline int my_probe_info(const char *fn, VInfo *i) {
+  return ff_probe_info(fn, i);
+}
+
+static inline int my_get_index(void *vd, FrameIndex **fi) {
+  return ff_get_index(vd, fi);
+}
+
+static inline int my_get_packet(void *vd, int64_t frame, uint8_t **buf, size_t *len) {
+  return ff_get_packet(vd, frame, buf, len);
+}
+
+static inline int my_indexed(void *vd) {
+  return ff_indexed(vd);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Video object management
 //
 
+/* codec threads of a decoder that is about to (re-)open its codec.
+ * The CPU budget is shared by the decoders that are busy at that time
+ * (incl. the caller), so the decoders x threads stay within the budget,
+ * and a single active decoder is not limited to budget / max_objects.
+ * The count is applied when the codec is opened or re-opened
+ * (switching between slice and frame-threading, see ff_thread_policy()). */
+static int codec_threads(JVD *jvd) {
+  const int cpus = jvd->cpu_budget > 0 ? jvd->cpu_budget : av_cpu_count();
+  const int busy = dctrl_decoders_busy(jvd);
+  const int t = cpus / (busy > 0 ? busy : 1);
+  return t < 1 ? 1 : t;
+}
+
 static JVOBJECT *newjvo (JVOBJECT *jvo, pthread_mutex_t *appendlock) {
   debugmsg(DEBUG_DCTL, "DCTL: newjvo() allocated new decoder object\n");
   JVOBJECT *n = calloc(1, sizeof(JVOBJECT));
@@ -437,13 +504,21 @@ static JVOBJECT *getjvo(JVD *jvd) {
 // Video decoder management
 //
 
+/* cached frames and images of a file-ID are no longer valid,
+ * pins of the file remain and apply once it is mapped again.
+ * NB. lock_vml must be write-locked */
+static void invalidate_id(JVD *jvd, void *vc, unsigned short id) {
+  if (vc) vcache_clear(vc, id);
+  if (jvd->ic) icache_clear_id(jvd->ic, id);
+}
+
 static void clearvid(JVD* jvd, void *vc) {
   VidMap *vm, *tmp;
   pthread_rwlock_wrlock(&jvd->lock_vml);
   HASH_ITER(hh, jvd->vml, vm, tmp) {
     HASH_DEL(jvd->vml, vm);
     HASH_DELETE(hr, jvd->vmr, vm);
-    if (vc) vcache_clear(vc, vm->id);
+    invalidate_id(jvd, vc, vm->id);
     clearjvo(jvd, 3, vm->id, -1, &jvd->lock_jvo);
     free(vm->fn);
     free(vm);
@@ -451,6 +526,23 @@ static void clearvid(JVD* jvd, void *vc) {
   pthread_rwlock_unlock(&jvd->lock_vml);
 }
 
+/* drop frames and images of a file that were cached before its frame index
+ * was available, the frame-numbers may have mapped to different frames.
+ * Pins of the file remain. */
+static void flush_stale(JVD *jvd, const char *fn, void *vc) {
+  VidMap *vm;
+  pthread_rwlock_wrlock(&jvd->lock_vml);
+  HASH_FIND_STR(jvd->vml, fn, vm);
+  if (vm && vm->stale) {
+    vm->stale = 0;
+    debugmsg(DEBUG_DCTL, "DCTL: frame index of id:%d is available, flushing cached frames\n", vm->id);
+    invalidate_id(jvd, vc, vm->id);
+    if (vc) vcache_pin_bind(vc, fn, vm->id);
+    if (jvd->ic) icache_pin_bind(jvd->ic, fn, vm->id);
+  }
+  pthread_rwlock_unlock(&jvd->lock_vml);
+}
+
 static unsigned short get_id(JVD *jvd, const char *fn, void *vc) {
   VidMap *vm = NULL;
   int rv;
@@ -459,9 +551,11 @@ static unsigned short get_id(JVD *jvd, const char *fn, void *vc) {
   HASH_FIND_STR(jvd->vml, fn, vm);
 
   if (vm) {
+    const int stale = vm->stale;
     rv = vm->id;
     vm->lru = time(NULL);
     pthread_rwlock_unlock(&jvd->lock_vml);
+    if (stale) flush_stale(jvd, fn, vc);
     return rv;
   }
   pthread_rwlock_unlock(&jvd->lock_vml);
@@ -491,6 +585,7 @@ static unsigned short get_id(JVD *jvd, const char *fn, void *vc) {
     if (vlru) {
       HASH_DEL(jvd->vml, vlru);
       HASH_DELETE(hr, jvd->vmr, vlru);
+      invalidate_id(jvd, vc, vlru->id);
       free(vlru->fn);
       vm = vlru;
       memset(vm, 0, sizeof(VidMap));
@@ -499,18 +594,26 @@ static unsigned short get_id(JVD *jvd, const char *fn, void *vc) {
 
   if (!vm) vm = calloc(1, sizeof(VidMap));
 
-  vm->id = jvd->monotonic++;
-  if (jvd->monotonic == 0) {
-    dlog(LOG_INFO, "monotonic ID counter roll-over\n");
-    jvd->monotonic = 1;
-  }
+  /* skip IDs that are still mapped after a roll-over */
+  do {
+    VidMap *used;
+    vm->id = jvd->monotonic++;
+    if (jvd->monotonic == 0) {
+      dlog(LOG_INFO, "monotonic ID counter roll-over\n");
+      jvd->monotonic = 1;
+    }
+    HASH_FIND(hr, jvd->vmr, &vm->id, sizeof(unsigned short), used);
+    if (!used) break;
+  } while (1);
   vm->fn = strdup(fn);
   vm->lru = time(NULL);
   rv = vm->id;
   HASH_ADD_KEYPTR(hh, jvd->vml, vm->fn, strlen(vm->fn), vm);
   HASH_ADD(hr, jvd->vmr, id, sizeof(unsigned short), vm);
-  /* invalidate frame-cache for this ID*/
-  if (vc) vcache_clear(vc, vm->id);
+  /* invalidate cached data of a previous use of this ID, apply pins of the file */
+  invalidate_id(jvd, vc, vm->id);
+  if (vc) vcache_pin_bind(vc, fn, vm->id);
+  if (jvd->ic) icache_pin_bind(jvd->ic, fn, vm->id);
   pthread_rwlock_unlock(&jvd->lock_vml);
   return rv;
 }
@@ -524,6 +627,119 @@ static char *get_fn(JVD *jvd, unsigned short id) {
   return NULL;
 }
 
+static char *dup_fn(JVD *jvd, unsigned short id) {
+  VidMap *vm;
+  char *fn = NULL;
+  pthread_rwlock_rdlock(&jvd->lock_vml);
+  HASH_FIND(hr, jvd->vmr, &id, sizeof(unsigned short), vm);
+  if (vm && vm->fn) fn = strdup(vm->fn);
+  pthread_rwlock_unlock(&jvd->lock_vml);
+  return fn;
+}
+
+/* map entry of a file by name (if fn != NULL) or ID
+ * NB. lock_vml must be held */
+static VidMap *find_vm(JVD *jvd, unsigned short id, const char *fn) {
+  VidMap *vm = NULL;
+  if (fn) {
+    HASH_FIND_STR(jvd->vml, fn, vm);
+  } else {
+    HASH_FIND(hr, jvd->vmr, &id, sizeof(unsigned short), vm);
+  }
+  return vm;
+}
+
+/* look up cached file-info, return 0 if it is valid */
+static int get_info_cached(JVD *jvd, unsigned short id, const char *fn, VInfo *i) {
+  VidMap *vm;
+  FileKey k;
+  int rv = -1;
+  pthread_rwlock_rdlock(&jvd->lock_vml);
+  vm = find_vm(jvd, id, fn);
+  if (vm && vm->have_info
+      && !findex_filekey(vm->fn, &k)
+      && !memcmp(&k, &vm->key, sizeof(FileKey))) {
+    memcpy(i, &vm->info, sizeof(VInfo));
+    rv = 0;
+  }
+  pthread_rwlock_unlock(&jvd->lock_vml);
+
+  pthread_mutex_lock(&jvd->lock_busy);
+  if (rv) jvd->info_miss++; else jvd->info_hits++;
+  pthread_mutex_unlock(&jvd->lock_busy);
+  return rv;
+}
+
+static void set_info_cached(JVD *jvd, unsigned short id, const char *fn, const VInfo *i) {
+  VidMap *vm;
+  pthread_rwlock_wrlock(&jvd->lock_vml);
+  vm = find_vm(jvd, id, fn);
+  if (vm && !findex_filekey(vm->fn, &vm->key)) {
+    memcpy(&vm->info, i, sizeof(VInfo));
+    /* output geometry depends on the request */
+    vm->info.out_width = vm->info.out_height = -1;
+    vm->info.buffersize = 0;
+    vm->have_info = 1;
+  }
+  pthread_rwlock_unlock(&jvd->lock_vml);
+}
+
+/* track how the frames of a file were decoded. Once a decoder has the
+ * frame index, cached info and frames based on estimated frame-numbers
+ * are stale: the info is dropped right away, frames with the next
+ * get_id() (see flush_stale()). */
+static void index_state(JVD *jvd, unsigned short id, int indexed) {
+  VidMap *vm;
+  pthread_rwlock_wrlock(&jvd->lock_vml);
+  HASH_FIND(hr, jvd->vmr, &id, sizeof(unsigned short), vm);
+  if (vm && !indexed) {
+    vm->estimated = 1;
+  } else if (vm) {
+    if (vm->have_info && !vm->info.indexed) vm->have_info = 0;
+    if (vm->estimated) {
+      vm->estimated = 0;
+      vm->stale = 1;
+    }
+  }
+  pthread_rwlock_unlock(&jvd->lock_vml);
+}
+
+/* remember the decoded frame of the client, return 1 if it precedes the
+ * client's previous one (same geometry and format), i.e. frames are
+ * requested backwards */
+static int reverse_access(JVD *jvd, unsigned short id, int client, int64_t frame, int w, int h, int fmt) {
+  VidMap *vm;
+  int rv = 0;
+  pthread_rwlock_wrlock(&jvd->lock_vml);
+  HASH_FIND(hr, jvd->vmr, &id, sizeof(unsigned short), vm);
+  if (vm) {
+    int i;
+    RevState *rs = &vm->rev[0];
+    for (i = 0; i < DCTL_REVERSE_CLIENTS; ++i) {
+      if (vm->rev[i].lru && vm->rev[i].client == client) {
+        rs = &vm->rev[i];
+        break;
+      }
+      if (vm->rev[i].lru < rs->lru) rs = &vm->rev[i];
+    }
+    if (i < DCTL_REVERSE_CLIENTS) {
+      if (rs->w == w && rs->h == h && rs->fmt == fmt
+          && frame < rs->frame && frame >= rs->frame - DCTL_REVERSE_WINDOW) {
+        rv = 1;
+      }
+    } else {
+      rs->client = client; /* replace the least recently seen client */
+    }
+    rs->lru = ++vm->rev_lru;
+    rs->frame = frame;
+    rs->w = w;
+    rs->h = h;
+    rs->fmt = fmt;
+  }
+  pthread_rwlock_unlock(&jvd->lock_vml);
+  return rv;
+}
+
 static void release_id(JVD *jvd, unsigned short id) {
   VidMap *vm;
   pthread_rwlock_wrlock(&jvd->lock_vml);
@@ -672,7 +888,7 @@ static void * dctrl_get_decoder(void *p, unsigned short id, int fmt, int64_t fra
 
       if (fmt == AV_PIX_FMT_NONE) fmt = DEFAULT_PIX_FMT;
 
-      if (!my_open_movie(&jvo->decoder, get_fn(jvd, jvo->id), fmt)) {
+      if (!my_open_movie(&jvo->decoder, get_fn(jvd, jvo->id), fmt, codec_threads(jvd))) {
         pthread_mutex_lock(&jvo->lock);
         jvo->fmt = fmt;
         jvo->flags |= VOF_OPEN;
@@ -730,11 +946,11 @@ static void dctrl_release_infolock(void *dec) {
   pthread_mutex_unlock(&jvo->lock);
 }
 
-static inline int xdctrl_decode(void *dec, int64_t frame, uint8_t *b, int w, int h) {
+static inline int xdctrl_decode(void *dec, int64_t frame, uint8_t *b, int w, int h, const VCrop *crop, int flags, VDecodeThrough *dt) {
   JVOBJECT *jvo = (JVOBJECT *) dec;
   jvo->lru = time(NULL);
   jvo->hitcount_decoder++;
-  int rv = my_decode(jvo->decoder, frame, b, w, h);
+  int rv = my_decode(jvo->decoder, frame, b, w, h, crop, flags, dt);
   jvo->frame = frame;
   return rv;
 }
@@ -751,6 +967,7 @@ void dctrl_create(void **p, int max_decoders, int cache_size) {
   jvd->cache_size = cache_size;
 
   pthread_mutex_init(&jvd->lock_busy, NULL);
+  pthread_cond_init(&jvd->probe_cond, NULL);
   pthread_mutex_init(&jvd->lock_jvo, NULL);
   pthread_rwlock_init(&jvd->lock_vml, NULL);
   pthread_rwlock_init(&jvd->lock_jdh, NULL);
@@ -765,11 +982,16 @@ void dctrl_create(void **p, int max_decoders, int cache_size) {
   HASH_ADD(hhf, jvd->jvf, id, CLKEYLEN, jvd->jvo);
 }
 
+void dctrl_set_image_cache(void *p, void *ic) {
+  ((JVD*)p)->ic = ic;
+}
+
 void dctrl_destroy(void **p) {
   JVD *jvd = (*((JVD**)p));
   clearjvo(jvd, 3, -1, -1, &jvd->lock_jvo);
   clearvid(jvd, NULL);
   pthread_mutex_destroy(&jvd->lock_busy);
+  pthread_cond_destroy(&jvd->probe_cond);
   pthread_mutex_destroy(&jvd->lock_jvo);
   pthread_rwlock_destroy(&jvd->lock_vml);
   pthread_rwlock_destroy(&jvd->lock_jdh);
@@ -784,38 +1006,243 @@ unsigned short dctrl_get_id(void *vc, void *p, const char *fn) {
 }
 
 
-int dctrl_decode(void *p, unsigned short id, int64_t frame, uint8_t *b, int w, int h, int fmt) {
+int dctrl_decode(void *p, unsigned short id, int64_t frame, uint8_t *b, int w, int h, int fmt, const VCrop *crop, int flags, VDecodeThrough *dt) {
   int err = 0;
   void *dec = dctrl_get_decoder(p, id, fmt, frame, &err);
   if (!dec) {
     dlog(DLOG_WARNING, "DCTL: no decoder available.\n");
     return err;
   }
-  int rv = xdctrl_decode(dec, frame, b, w, h);
+  /* share of the budget, used if the decoder re-opens its codec */
+  ff_set_threads(((JVOBJECT*)dec)->decoder, codec_threads((JVD*)p));
+  if (dt && reverse_access((JVD*)p, id, VDEC_GET_CLIENT(flags), frame, w, h, fmt) && dt->reverse_budget > 0) {
+    /* decode the frames preceding the requested one in the GOP once,
+     * they are about to be requested next */
+    debugmsg(DEBUG_DCTL, "DCTL: reverse access id:%d client:%d frame:%"PRIlld"\n", id, VDEC_GET_CLIENT(flags), (long long) frame);
+    dt->reverse = 1;
+    if (dt->budget < dt->reverse_budget) dt->budget = dt->reverse_budget;
+  }
+  int rv = xdctrl_decode(dec, frame, b, w, h, crop, flags, dt);
+  index_state((JVD*)p, id, my_indexed(((JVOBJECT*)dec)->decoder));
   dctrl_release_decoder(dec);
   return (rv);
 }
 
 int dctrl_get_info(void *p, unsigned short id, VInfo *i) {
   int err = 0;
+  if (!get_info_cached((JVD*)p, id, NULL, i)) return(0);
   JVOBJECT *jvo = (JVOBJECT*) dctrl_get_decoder(p, id, AV_PIX_FMT_NONE, -1, &err);
   if (!jvo) return err;
   my_get_info(jvo->decoder, i);
   jvo->hitcount_info++;
   dctrl_release_infolock(jvo);
+  set_info_cached((JVD*)p, id, NULL, i);
   return(0);
 }
 
+/* open a file without a decoder object. Probes of all requests together
+ * are limited to max_objects, like decoders. */
+static int probe_limited(JVD *jvd, const char *fn, VInfo *i) {
+  int rv;
+  pthread_mutex_lock(&jvd->lock_busy);
+  while (jvd->probing >= (jvd->max_objects > 0 ? jvd->max_objects : 1)) {
+    pthread_cond_wait(&jvd->probe_cond, &jvd->lock_busy);
+  }
+  jvd->probing++;
+  pthread_mutex_unlock(&jvd->lock_busy);
+
+  BUSYADD(jvd)
+  rv = my_probe_info(fn, i) ? 500 : 0;
+  BUSYDEC(jvd)
+
+  pthread_mutex_lock(&jvd->lock_busy);
+  jvd->probing--;
+  pthread_cond_signal(&jvd->probe_cond);
+  pthread_mutex_unlock(&jvd->lock_busy);
+  if (rv) {
+    dlog(DLOG_ERR, "DCTL: Cannot probe file: '%s'\n", fn);
+  }
+  return rv;
+}
+
+int dctrl_probe_info(void *p, unsigned short id, VInfo *i) {
+  JVD *jvd = (JVD*)p;
+  char *fn;
+  int rv;
+  if (!get_info_cached(jvd, id, NULL, i)) return(0);
+  if (!(fn = dup_fn(jvd, id))) return(500);
+  if (!(rv = probe_limited(jvd, fn, i))) {
+    set_info_cached(jvd, id, NULL, i);
+  }
+  free(fn);
+  return(rv);
+}
+
+int dctrl_probe_file(void *p, const char *fn, VInfo *i) {
+  JVD *jvd = (JVD*)p;
+  int rv;
+  if (!get_info_cached(jvd, 0, fn, i)) return(0);
+  if (!(rv = probe_limited(jvd, fn, i))) {
+    /* refresh the info of a file that is already mapped, don't add it */
+    set_info_cached(jvd, 0, fn, i);
+  }
+  return(rv);
+}
+
 int dctrl_get_info_scale(void *p, unsigned short id, VInfo *i, int w, int h, int fmt) {
+  return dctrl_get_info_crop(p, id, i, w, h, fmt, NULL);
+}
+
+int dctrl_get_info_crop(void *p, unsigned short id, VInfo *i, int w, int h, int fmt, VCrop *crop) {
   int err = 0;
   JVOBJECT *jvo = (JVOBJECT*) dctrl_get_decoder(p, id, fmt, -1, &err);
   if (!jvo) return err;
-  my_get_info_canonical(jvo->decoder, i, w, h);
+  my_get_info_canonical(jvo->decoder, i, w, h, crop);
   jvo->hitcount_info++;
   dctrl_release_infolock(jvo);
   return(0);
 }
 
+int dctrl_get_index(void *p, unsigned short id, FrameIndex **fi) {
+  int err = 0;
+  JVOBJECT *jvo;
+  *fi = findex_lookup(get_fn((JVD*)p, id));
+  if (*fi) return 0;
+  /* building the index moves the decoder's file position -> exclusive lock */
+  jvo = (JVOBJECT*) dctrl_get_decoder(p, id, AV_PIX_FMT_NONE, 0, &err);
+  if (!jvo) return err;
+  jvo->lru = time(NULL);
+  if (my_get_index(jvo->decoder, fi)) {
+    *fi = NULL;
+    err = -1;
+  }
+  jvo->frame = -1;
+  dctrl_release_decoder(jvo);
+  return(err);
+}
+
+int dctrl_get_packet(void *p, unsigned short id, int64_t frame, uint8_t **buf, size_t *len) {
+  int err = 0;
+  JVOBJECT *jvo;
+  *buf = NULL;
+  *len = 0;
+  /* any open decoder of the file will do, the pixel-format is irrelevant */
+  jvo = (JVOBJECT*) dctrl_get_decoder(p, id, AV_PIX_FMT_NONE, frame, &err);
+  if (!jvo) return err;
+  jvo->lru = time(NULL);
+  jvo->hitcount_decoder++;
+  err = my_get_packet(jvo->decoder, frame, buf, len);
+  jvo->frame = frame;
+  index_state((JVD*)p, id, my_indexed(jvo->decoder));
+  dctrl_release_decoder(jvo);
+  return err ? -1 : 0;
+}
+
+int dctrl_decoders_busy(void *p) {
+  JVD *jvd = (JVD*)p;
+  JVOBJECT *cptr;
+  int busy = 0;
+  pthread_mutex_lock(&jvd->lock_jvo);
+  for (cptr = jvd->jvo; cptr; cptr = cptr->next) {
+    if (cptr->flags&(VOF_USED|VOF_PENDING)) busy++;
+  }
+  pthread_mutex_unlock(&jvd->lock_jvo);
+  return busy;
+}
+
+/* free idle decoder objects, least recently used first, until at most
+ * max_objects remain. Decoders that are in use are retained. */
+static void trimjvo(JVD *jvd) {
+  int total = 0, freed = 0;
+  JVOBJECT *cptr;
+
+  pthread_mutex_lock(&jvd->lock_busy);
+  jvd->purge_in_progress++;
+  while (jvd->busycnt > 0) {
+    pthread_mutex_unlock(&jvd->lock_busy);
+    mymsleep(5);
+    pthread_mutex_lock(&jvd->lock_busy);
+  }
+
+  pthread_mutex_lock(&jvd->lock_jvo);
+  for (cptr = jvd->jvo; cptr; cptr = cptr->next) total++;
+
+  while (total > jvd->max_objects) {
+    JVOBJECT *prev = jvd->jvo, *lprev = NULL, *lru = NULL;
+    time_t lrut = time(NULL) + 1;
+    /* the list-head is never freed */
+    for (cptr = jvd->jvo->next; cptr; prev = cptr, cptr = cptr->next) {
+      if (cptr->flags&(VOF_USED|VOF_PENDING|VOF_INFO)) continue;
+      if (cptr->lru < lrut) {
+        lrut = cptr->lru;
+        lru = cptr;
+        lprev = prev;
+      }
+    }
+    if (!lru) break;
+
+    if (lru->flags&VOF_OPEN) {
+      my_destroy(&lru->decoder);
+      lru->decoder = NULL;
+    }
+    hashref_delete_jvo(jvd, lru);
+    lprev->next = lru->next;
+    pthread_mutex_destroy(&lru->lock);
+    free(lru);
+    total--;
+    freed++;
+  }
+  pthread_mutex_unlock(&jvd->lock_jvo);
+
+  jvd->purge_in_progress--;
+  pthread_mutex_unlock(&jvd->lock_busy);
+
+  debugmsg(DEBUG_DCTL, "DCTL: trim freed %d decoder(s), %d remain (max %d)\n", freed, total, jvd->max_objects);
+}
+
+/* forget least recently used files until at most cache_size remain */
+static void trimvid(JVD *jvd) {
+  VidMap *vm, *tmp;
+  pthread_rwlock_wrlock(&jvd->lock_vml);
+  while (HASH_COUNT(jvd->vml) > jvd->cache_size) {
+    VidMap *vlru = NULL;
+    time_t lru = time(NULL) + 1;
+    HASH_ITER(hh, jvd->vml, vm, tmp) {
+      if (vm->lru < lru) {
+        lru = vm->lru;
+        vlru = vm;
+      }
+    }
+    if (!vlru) break;
+    HASH_DEL(jvd->vml, vlru);
+    HASH_DELETE(hr, jvd->vmr, vlru);
+    clearjvo(jvd, 1, vlru->id, -1, &jvd->lock_jvo);
+    free(vlru->fn);
+    free(vlru);
+  }
+  pthread_rwlock_unlock(&jvd->lock_vml);
+}
+
+void dctrl_resize(void *p, int max_decoders, int cache_size) {
+  JVD *jvd = (JVD*)p;
+  if (max_decoders > 0 && max_decoders != jvd->max_objects) {
+    const int shrink = max_decoders < jvd->max_objects;
+    jvd->max_objects = max_decoders;
+    if (shrink) trimjvo(jvd);
+  }
+  if (cache_size > 0 && cache_size != jvd->cache_size) {
+    const int shrink = cache_size < jvd->cache_size;
+    jvd->cache_size = cache_size;
+    if (shrink) trimvid(jvd);
+  }
+}
+
+void dctrl_set_cpu_budget(void *p, int cpus) {
+  JVD *jvd = (JVD*)p;
+  jvd->cpu_budget = cpus > 0 ? cpus : 0;
+  debugmsg(DEBUG_DCTL, "DCTL: codec thread budget %d\n", jvd->cpu_budget > 0 ? jvd->cpu_budget : av_cpu_count());
+}
+
 void dctrl_cache_clear(void *vc, void *p, int f, int id) {
   JVD *jvd = (JVD*)p;
   clearjvo(jvd, f, id, -1, &jvd->lock_jvo);
@@ -865,14 +1292,16 @@ void dctrl_info_html (void *p, char **m, size_t *o, size_t *s, int tbl) {
   VidMap *vm, *tmp;
   if (tbl&1) {
     rprintf("<h3>File/ID Mapping:</h3>\n");
-    rprintf("<p>max available: %d</p>\n", ((JVD*)p)->cache_size);
+    rprintf("<p>max available: %d, info cache-hits: %d, cache-misses: %d</p>\n",
+        ((JVD*)p)->cache_size, ((JVD*)p)->info_hits, ((JVD*)p)->info_miss);
     rprintf("<table style=\"text-align:center;width:100%%\">\n");
   } else {
     if (tbl&2) {
       rprintf("<table style=\"text-align:center;width:100%%\">\n");
     }
     rprintf("<tr><td colspan=\"8\" class=\"left\"><h3>File Mapping:</h3></td></tr>\n");
-    rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d</td></tr>\n", ((JVD*)p)->cache_size);
+    rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d, info cache-hits: %d, cache-misses: %d</td></tr>\n",
+        ((JVD*)p)->cache_size, ((JVD*)p)->info_hits, ((JVD*)p)->info_miss);
   }
   rprintf("<tr><th>#</th><th>file-id</th><th></th><th>Filename</th><th></th><th></th><th></th><th>LRU</th></tr>\n");
   rprintf("\n");
@@ -892,12 +1321,13 @@ void dctrl_info_html (void *p, char **m, size_t *o, size_t *s, int tbl) {
   i = 1;
   if(tbl&4) {
     rprintf("<h3>Decoder Objects:</h3>\n");
-    rprintf("<p>max available: %d, busy: %d%s</p>\n", ((JVD*)p)->max_objects, ((JVD*)p)->busycnt, ((JVD*)p)->purge_in_progress?" (purge queued)":"");
+    rprintf("<p>max available: %d, busy: %d, codec threads: %d%s</p>\n", ((JVD*)p)->max_objects, ((JVD*)p)->busycnt,
+        codec_threads((JVD*)p), ((JVD*)p)->purge_in_progress?" (purge queued)":"");
     rprintf("<table style=\"text-align:center;width:100%%\">\n");
   } else {
     rprintf("<tr><td colspan=\"8\" class=\"left\"><h3>Decoder Objects:</h3></td></tr>\n");
-    rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d, busy: %d%s</td></tr>\n",
-        ((JVD*)p)->max_objects, ((JVD*)p)->busycnt, ((JVD*)p)->purge_in_progress?" (purge queued)":"");
+    rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d, busy: %d, codec threads: %d%s</td></tr>\n",
+        ((JVD*)p)->max_objects, ((JVD*)p)->busycnt, codec_threads((JVD*)p), ((JVD*)p)->purge_in_progress?" (purge queued)":"");
   }
   rprintf("<tr><th>#</th><th>file-id</th><th>Flags</th><th>Filename</th><th>Hitcount</th><th>PixFmt</th><th>Frame#</th><th>LRU</th></tr>\n");
   rprintf("\n");
@@ -26,12 +26,21 @@
 #define _DECODER_CTRL_H
 
 #include "vinfo.h"
+#include "frame_index.h"
 
 /** create and allocate a decoder control object
  * @param p pointer to allocated object
  */
 void dctrl_create(void **p, int max_decoders, int cache_size);
 
+/** image cache whose entries are invalidated when a file-ID is
+ * released or re-used (frame-cache entries are invalidated via the
+ * \a vc parameter of \ref dctrl_get_id)
+ * @param p decoder control object
+ * @param ic image cache object
+ */
+void dctrl_set_image_cache(void *p, void *ic);
+
 /** close and destroy a decoder control object
  * @param p object pointer to free
  */
@@ -61,6 +70,27 @@ void dctrl_info_html(void *p, char **m, size_t *o, size_t *s, int tbl);
  * @return 0 on success, -1 otherwise
  */
 int dctrl_get_info(void *p, unsigned short id, VInfo *i);
+/**
+ * request VInfo video-info without allocating a decoder-object.
+ * The file is probed directly unless the information is cached already.
+ * This function is safe to call concurrently for different files.
+ * @param p  pointer to a decoder-control object
+ * @param id id of the file
+ * @param i returned data
+ * @return 0 on success, 500 if the file cannot be opened
+ */
+int dctrl_probe_info(void *p, unsigned short id, VInfo *i);
+/**
+ * like \ref dctrl_probe_info, for a file that does not need an ID.
+ * The file is not added to the file-ID map, so it does not displace
+ * files that are being served. Concurrent probes of all callers are
+ * limited to the max. number of decoders.
+ * @param p  pointer to a decoder-control object
+ * @param fn file name
+ * @param i returned data
+ * @return 0 on success, 500 if the file cannot be opened
+ */
+int dctrl_probe_file(void *p, const char *fn, VInfo *i);
 /**
  * set new scaling factors and return updated VInfo
  * @param p  pointer to a decoder-control object
@@ -72,10 +102,73 @@ int dctrl_get_info(void *p, unsigned short id, VInfo *i);
  */
 int dctrl_get_info_scale(void *p, unsigned short id, VInfo *i, int w, int h, int fmt);
 
+/**
+ * like \ref dctrl_get_info_scale for a region of the source.
+ * The aspect-ratio and default geometry (1:1) are those of the region.
+ * @param crop source region; clamped to the picture and aligned to chroma
+ * sub-sampling in place. It is cleared if it covers the complete picture.
+ * May be NULL.
+ * @return 0 on success, -1 otherwise
+ */
+int dctrl_get_info_crop(void *p, unsigned short id, VInfo *i, int w, int h, int fmt, VCrop *crop);
+
+/**
+ * look up or build the frame/keyframe index for the given decoder-object
+ * @param p  pointer to a decoder-control object
+ * @param id id of the decoder
+ * @param fi returned index, release with findex_release()
+ * @return 0 on success, 503 if no decoder is available, -1 or 500 otherwise
+ */
+int dctrl_get_index(void *p, unsigned short id, FrameIndex **fi);
+
+/**
+ * read the compressed frame without decoding it.
+ * Only available if every frame of the file is a stand-alone image
+ * at the file's geometry (VInfo.packet_fmt != VPKT_NONE, e.g. MJPEG).
+ * JPEG frames lacking huffman tables (AVI1) are completed.
+ * @param p  pointer to a decoder-control object
+ * @param id id of the decoder
+ * @param frame frame-number
+ * @param buf returned image data, free() after use
+ * @param len returned size of \a buf in bytes
+ * @return 0 on success, 503 if no decoder is available, -1 otherwise
+ */
+int dctrl_get_packet(void *p, unsigned short id, int64_t frame, uint8_t **buf, size_t *len);
+
 /**
  * used by the frame-cache to decode a frame
+ * @param crop source region to render, NULL for the complete frame
+ * @param flags VDEC_* flags
+ * @param dt optional, receives frames decoded on the way to \a frame
+ */
+int dctrl_decode(void *p, unsigned short vid, int64_t frame, uint8_t *b, int w, int h, int fmt, const VCrop *crop, int flags, VDecodeThrough *dt);
+
+/**
+ * count decoders that are currently decoding or opening a file.
+ * The value is a snapshot and may change right after the call.
+ * @param p  pointer to a decoder-control object
+ * @return number of busy decoder objects
+ */
+int dctrl_decoders_busy(void *p);
+
+/**
+ * change the decoder limit and the number of files kept in the file-map.
+ * When shrinking, idle decoders and files are closed least recently used
+ * first, decoders that are in use remain open until the next resize.
+ * @param p  pointer to a decoder-control object
+ * @param max_decoders max. number of decoder objects, 0: unchanged
+ * @param cache_size max. number of files in the file-map, 0: unchanged
+ */
+void dctrl_resize(void *p, int max_decoders, int cache_size);
+
+/**
+ * set the number of CPUs that decoders may use for codec threads.
+ * It is shared equally by the decoders that are busy when a codec is
+ * opened or re-opened (at least one thread each).
+ * @param p  pointer to a decoder-control object
+ * @param cpus total number of codec threads, 0: number of CPUs
  */
-int dctrl_decode(void *p, unsigned short vid, int64_t frame, uint8_t *b, int w, int h, int fmt);
+void dctrl_set_cpu_budget(void *p, int cpus);
 
 /**
  */
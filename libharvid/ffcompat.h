@@ -149,6 +149,23 @@ av_frame_alloc ()
 }
 #endif
 
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 78, 100)
+static inline int
+avformat_index_get_entries_count (const AVStream* st)
+{
+	return st->nb_index_entries;
+}
+
+static inline const AVIndexEntry*
+avformat_index_get_entry (AVStream* st, int idx)
+{
+	if (idx < 0 || idx >= st->nb_index_entries) {
+		return NULL;
+	}
+	return &st->index_entries[idx];
+}
+#endif
+
 static inline void
 register_codecs_compat ()
 {
@@ -20,7 +20,12 @@
 #include <stdint.h>     /* uint8_t */
 #include <stdlib.h>     /* calloc et al.*/
 #include <string.h>     /* memset */
+#include <strings.h>    /* strcasecmp */
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <limits.h>
 #include <time.h>
 #include <math.h>
 #include <sys/time.h>
@@ -28,15 +33,30 @@
 #include <assert.h>
 
 #include "vinfo.h"
+#include "sws_pool.h"
+#include "media_io.h"
+#include "image_seq.h"
 #include "ffdecoder.h"
+#include "frame_index.h"
 
 #include "ffcompat.h"
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 
+//#define HASH_EMIT_KEYS 3
+#define HASH_FUNCTION HASH_SFH
+#include "uthash.h"
+
 #ifndef MAX
 #define MAX(A,B) ( ( (A) > (B) ) ? (A) : (B) )
 #endif
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+typedef struct FfTemplate FfTemplate;
+
 /* ffmpeg source */
 typedef struct {
   /* file specific decoder settings */
@@ -45,6 +65,8 @@ typedef struct {
   /* Video File Info */
   int   movie_width;  ///< original file geometry
   int   movie_height; ///< original file geometry
+  int   src_width;  ///< coded geometry, the codec's is reduced when decoding at lowres
+  int   src_height; ///< coded geometry
   int   out_width;  ///< aspect scaled geometry
   int   out_height; ///< aspect scaled geometry
 
@@ -58,6 +80,7 @@ typedef struct {
   int64_t tpf;
   int64_t avprev;
   int64_t stream_pts_offset;
+  int64_t pkt_next; ///< timestamp expected for the next packet read by ff_get_packet()
   /* */
   uint8_t *internal_buffer; //< if !NULL this buffer is free()d on destroy
   uint8_t *buffer;
@@ -65,13 +88,28 @@ typedef struct {
   int   buf_height; ///< current geometry for allocated buffer
   int   videoStream;
   int   render_fmt;  //< pFrame/buffer output format (RGB24)
+  VCrop crop;        //< source region of interest, w,h = 0: complete frame
+  /* codec threading */
+  int   threads;     //< max. codec threads, set before calling ff_open_movie()
+  int   thread_type; //< current FF_THREAD_* of pCodecCtx, 0: single threaded
+  int   seq_run;     //< number of consecutive sequential frame requests
+  int   seek_run;    //< number of consecutive non-sequential frame requests
+  int64_t last_frame;
+  int   draft;       //< current request allows reduced resolution decoding
+  int   lowres;      //< current lowres of pCodecCtx
+  int   scaler;      //< VSCALE_* of the current request
   /* ffmpeg internals*/
   AVPacket          packet;
   AVFormatContext   *pFormatCtx;
   AVCodecContext    *pCodecCtx;
   AVFrame           *pFrame;
   AVFrame           *pFrameFMT;
-  struct SwsContext *pSWSCtx;
+  FrameIndex        *fidx; ///< shared frame index, NULL if not (yet) available
+  time_t             fidx_check; ///< last time a missing index was looked up
+  FfTemplate        *tmpl; ///< shared per-file state, NULL if not available
+  VDecodeThrough    *dt;   ///< receives intermediate frames, only during ff_render()
+  MediaIO           *mio;  ///< file I/O of pFormatCtx, NULL: libavformat's file protocol
+  ImgSeq            *seq;  ///< numbered image sequence, there is no pFormatCtx
 } ffst;
 
 /* Option flags and global variables */
@@ -81,6 +119,28 @@ extern int want_verbose;
 static pthread_mutex_t avcodec_lock;
 static const AVRational c1_Q = { 1, 1 };
 
+/* libavcodec serializes non thread-safe codec initialization itself
+ * since the lock-manager was removed, older versions need a global lock
+ * around avcodec_open2() and avcodec_close() -- which is also called
+ * by avformat_find_stream_info(). */
+static inline void ff_codec_lock(void) {
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+  pthread_mutex_lock(&avcodec_lock);
+#endif
+}
+
+static inline void ff_codec_unlock(void) {
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+  pthread_mutex_unlock(&avcodec_lock);
+#endif
+}
+
+#define FF_MAX_THREADS 16 ///< upper limit of codec threads per decoder
+#define FF_SEQ_FRAMES 8   ///< sequential requests before switching to frame-threading
+#define FF_SEQ_SEEKS 2    ///< random-access requests before switching back to slice-threading
+#define FF_PREFETCH_TAIL 65536 ///< bytes read ahead beyond the last indexed packet of a GOP
+#define FF_INDEX_SCANS 2  ///< max. number of concurrent background index scans
+
 //#define SCALE_UP  ///< positive pixel-aspect scales up X axis - else positive pixel-aspect scales down Y-Axis.
 
 //--------------------------------------------
@@ -126,12 +186,22 @@ static void render_empty_frame(ffst *ff, uint8_t* buf, int w, int h, int xoff, i
       }
       break;
     case AV_PIX_FMT_YUV440P:
+    case AV_PIX_FMT_YUV422P:
       {
 	size_t Ylen = w * h;
 	memset(buf, 0, Ylen);
 	memset(buf+Ylen, 0x80, Ylen);
       }
       break;
+    case AV_PIX_FMT_NV12:
+      {
+	size_t Ylen = w * h;
+	memset(buf, 0, Ylen);
+	memset(buf+Ylen, 0x80, Ylen/2);
+      }
+      break;
+    case AV_PIX_FMT_GRAY8:
+    case AV_PIX_FMT_RGB565:
     case AV_PIX_FMT_BGR24:
     case AV_PIX_FMT_RGB24:
     case AV_PIX_FMT_RGBA:
@@ -149,6 +219,9 @@ static void render_empty_frame(ffst *ff, uint8_t* buf, int w, int h, int xoff, i
   switch (ff->render_fmt) {
     case AV_PIX_FMT_YUV420P:
     case AV_PIX_FMT_YUV440P:
+    case AV_PIX_FMT_YUV422P:
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_GRAY8:
       for (x = 0, y = 0; x < w-1; x++, y = h * x / w) {
 	int off = (x + w * y);
 	buf[off]=127; buf[off+1]=127;
@@ -165,6 +238,14 @@ static void render_empty_frame(ffst *ff, uint8_t* buf, int w, int h, int xoff, i
 	buf[off] = 127; buf[off+1] = 127;
       }
       break;
+    case AV_PIX_FMT_RGB565:
+      for (x = 0, y = 0; x < w-1; x++, y = h * x / w) {
+	int off = 2 * (x + w * y);
+	buf[off]=255; buf[off+1]=255;
+	off = 2 * (x + w * (h - y - 1));
+	buf[off]=255; buf[off+1]=255;
+      }
+      break;
     case AV_PIX_FMT_RGB24:
     case AV_PIX_FMT_BGR24:
       for (x = 0, y = 0; x < w-1; x++, y = h * x / w) {
@@ -193,6 +274,15 @@ static void render_empty_frame(ffst *ff, uint8_t* buf, int w, int h, int xoff, i
 #endif
 }
 
+/* geometry of the source, independent of lowres decoding */
+static inline int ff_src_width(ffst *ff) {
+  return ff->lowres ? ff->src_width : ff->pCodecCtx->width;
+}
+
+static inline int ff_src_height(ffst *ff) {
+  return ff->lowres ? ff->src_height : ff->pCodecCtx->height;
+}
+
 static double ff_get_aspectratio(void *ptr) {
   ffst *ff = (ffst*)ptr;
   double aspect_ratio;
@@ -200,34 +290,122 @@ static double ff_get_aspectratio(void *ptr) {
     aspect_ratio = 0;
   else
     aspect_ratio = av_q2d(ff->pCodecCtx->sample_aspect_ratio)
-                   * (double)ff->pCodecCtx->width / (double)ff->pCodecCtx->height;
+                   * (double)ff_src_width(ff) / (double)ff_src_height(ff);
   if (aspect_ratio <= 0.0)
-    aspect_ratio = (double)ff->pCodecCtx->width / (double)ff->pCodecCtx->height;
+    aspect_ratio = (double)ff_src_width(ff) / (double)ff_src_height(ff);
   return (aspect_ratio);
 }
 
-static void ff_caononicalize_size2(void *ptr, int *w, int *h) {
+/* aspect-ratio of the given source region */
+static double ff_get_crop_aspectratio(ffst *ff, const VCrop *crop) {
+  double sar = 1.0;
+  if (!VCROP_ACTIVE(crop)) {
+    return ff_get_aspectratio(ff);
+  }
+  if (ff->pCodecCtx->sample_aspect_ratio.num > 0 && ff->pCodecCtx->sample_aspect_ratio.den > 0) {
+    sar = av_q2d(ff->pCodecCtx->sample_aspect_ratio);
+  }
+  return sar * (double)crop->w / (double)crop->h;
+}
+
+/* clamp the region of interest to the decoded picture and align it to
+ * the chroma sub-sampling of the source. Cropping is disabled if it covers
+ * the complete picture or if the source pixel-format does not allow it. */
+static void ff_normalize_crop(ffst *ff, VCrop *crop) {
+  const AVPixFmtDescriptor *desc;
+  int ax, ay;
+  const int W = ff->pCodecCtx ? ff_src_width(ff) : 0;
+  const int H = ff->pCodecCtx ? ff_src_height(ff) : 0;
+
+  if (!VCROP_ACTIVE(crop) || !ff->pCodecCtx) {
+    if (crop) memset(crop, 0, sizeof(VCrop));
+    return;
+  }
+
+  desc = av_pix_fmt_desc_get(ff->pCodecCtx->pix_fmt);
+  if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))) {
+    memset(crop, 0, sizeof(VCrop));
+    return;
+  }
+
+  ax = (1 << desc->log2_chroma_w) - 1;
+  ay = (1 << desc->log2_chroma_h) - 1;
+  if (crop->x < 0) crop->x = 0;
+  if (crop->y < 0) crop->y = 0;
+  crop->x &= ~ax;
+  crop->y &= ~ay;
+  if (crop->x + crop->w > W) crop->w = W - crop->x;
+  if (crop->y + crop->h > H) crop->h = H - crop->y;
+
+  if (crop->w < 1 || crop->h < 1
+      || (crop->x == 0 && crop->y == 0 && crop->w == W && crop->h == H)) {
+    memset(crop, 0, sizeof(VCrop));
+  }
+}
+
+/* byte offsets of the top-left corner of the source region in each plane */
+static void ff_crop_offsets(ffst *ff, const AVFrame *f, int offsets[4]) {
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(f->format);
+  int c, p;
+  memset(offsets, 0, 4 * sizeof(int));
+  for (p = 0; p < 4; ++p) {
+    for (c = 0; c < desc->nb_components; ++c) {
+      const AVComponentDescriptor *cd = &desc->comp[c];
+      if (cd->plane != p) continue;
+      /* chroma planes are sub-sampled */
+      const int chroma = (c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB);
+      const int x = chroma ? ff->crop.x >> desc->log2_chroma_w : ff->crop.x;
+      const int y = chroma ? ff->crop.y >> desc->log2_chroma_h : ff->crop.y;
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(55, 0, 100)
+      const int step = cd->step_minus1 + 1;
+#else
+      const int step = cd->step;
+#endif
+      offsets[p] = y * f->linesize[p] + x * step;
+      break; // first component of the plane determines the pixel step
+    }
+  }
+}
+
+/* check if the first plane of the given pixel-format is 8bit luma
+ * that can be used as-is for grayscale output */
+static int ff_luma_is_gray8(enum AVPixelFormat fmt) {
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL))) {
+    return 0;
+  }
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(55, 0, 100)
+  return desc->comp[0].plane == 0 && desc->comp[0].step_minus1 == 0 && desc->comp[0].depth_minus1 == 7 && desc->comp[0].shift == 0;
+#else
+  return desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].depth == 8 && desc->comp[0].shift == 0;
+#endif
+}
+
+static void ff_caononicalize_size2(void *ptr, int *w, int *h, const VCrop *crop) {
   ffst *ff = (ffst*)ptr;
-  double aspect_ratio = ff_get_aspectratio(ptr);
+  double aspect_ratio = ff_get_crop_aspectratio(ff, crop);
   if (!w || !h) return;
 
   if ((*h) < 16 && (*w) > 15) (*h) = (int) floorf((float)(*w)/aspect_ratio);
   else if ((*h) > 15  && (*w) < 16) (*w) = (int) floorf((float)(*h)*aspect_ratio);
 
   if ((*w) < 16 || (*h) < 16) {
+    /* 1:1 - use the geometry of the source region */
 #ifdef SCALE_UP
-    (*w) = (int) floor((double)ff->pCodecCtx->height * aspect_ratio);
-    (*h) = ff->pCodecCtx->height;
+    const int sh = VCROP_ACTIVE(crop) ? crop->h : ff_src_height(ff);
+    (*w) = (int) floor((double)sh * aspect_ratio);
+    (*h) = sh;
 #else
-    (*w) = ff->pCodecCtx->width ;
-    (*h) = (int) floor((double)ff->pCodecCtx->width / aspect_ratio);
+    const int sw = VCROP_ACTIVE(crop) ? crop->w : ff_src_width(ff);
+    (*w) = sw;
+    (*h) = (int) floor((double)sw / aspect_ratio);
 #endif
   }
 }
 
 static void ff_caononical_size(void *ptr) {
   ffst *ff = (ffst*)ptr;
-  ff_caononicalize_size2(ptr, &ff->out_width, &ff->out_height);
+  ff_caononicalize_size2(ptr, &ff->out_width, &ff->out_height, &ff->crop);
 }
 
 static void ff_init_moviebuffer(void *ptr) {
@@ -265,6 +443,292 @@ static void ff_init_moviebuffer(void *ptr) {
 #endif
 }
 
+//--------------------------------------------
+// Per-file templates
+//--------------------------------------------
+
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(59, 0, 100)
+typedef AVInputFormat FfInputFormat;
+#else
+typedef const AVInputFormat FfInputFormat;
+#endif
+
+/* open the demuxer, reading the file with harvid's own buffered I/O if enabled */
+static int ff_open_input(ffst *ff, const char *file_name, FfInputFormat *fmt, AVDictionary **opts) {
+  int rv;
+  assert(!ff->pFormatCtx && !ff->mio);
+  if ((ff->mio = mediaio_open(file_name))) {
+    ff->pFormatCtx = avformat_alloc_context();
+    ff->pFormatCtx->pb = mediaio_avio(ff->mio);
+    ff->pFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+  }
+  if ((rv = avformat_open_input(&ff->pFormatCtx, file_name, fmt, opts)) < 0) {
+    mediaio_close(ff->mio);
+    ff->mio = NULL;
+  }
+  return rv;
+}
+
+/* close the demuxer, a custom I/O context is not freed by libavformat */
+static void ff_close_format(ffst *ff) {
+  avformat_close_input(&ff->pFormatCtx);
+  mediaio_close(ff->mio);
+  ff->mio = NULL;
+}
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+#define FF_TEMPLATES
+#endif
+
+#define FF_TEMPLATE_CACHE_SIZE 256 ///< max number of unused file templates to keep
+#define FF_PROBE_SIZE 4096         ///< probesize when cloning a decoder from a template
+
+/** immutable per-file state, shared by all decoders of the same file.
+ * Decoders for a file that was opened before are cloned from it:
+ * only the container header is read, avformat_find_stream_info()
+ * and the index lookup are skipped. */
+struct FfTemplate {
+  FileKey key;
+#ifdef FF_TEMPLATES
+  FfInputFormat *iformat;
+  AVCodecParameters *par; ///< video stream parameters incl. codec extradata
+#endif
+  unsigned int nb_streams;
+  int videoStream;
+  AVRational time_base;   ///< video stream time-base
+  int64_t start_time;     ///< video stream start time
+  int64_t fmt_start_time; ///< container start time
+  /* file information, as computed by ff_open_movie() */
+  double duration;
+  double framerate;
+  TimecodeRate tc;
+  double file_frame_offset;
+  long frames;
+  int64_t tpf;
+  FrameIndex *fidx; ///< referenced while the template is in use, NULL if not available
+  int refcnt;       ///< decoders using this template
+  uint64_t lru;
+  UT_hash_handle hh;
+};
+
+static pthread_mutex_t ff_template_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#ifdef FF_TEMPLATES
+static FfTemplate *ff_templates = NULL;
+static uint64_t ff_template_seq = 0;
+
+static void ft_free(FfTemplate *ft) {
+  assert(!ft->fidx);
+  avcodec_parameters_free(&ft->par);
+  free(ft);
+}
+
+/* evict least recently used templates that are not in use
+ * NB. ff_template_lock must be held */
+static void ft_evict(unsigned int max_count) {
+  while (HASH_COUNT(ff_templates) > max_count) {
+    FfTemplate *ft, *tmp, *flru = NULL;
+    HASH_ITER(hh, ff_templates, ft, tmp) {
+      if (ft->refcnt > 0) continue;
+      if (!flru || ft->lru < flru->lru) flru = ft;
+    }
+    if (!flru) break;
+    HASH_DEL(ff_templates, flru);
+    ft_free(flru);
+  }
+}
+
+/* codec parameters of the video stream */
+static AVCodecParameters *ff_codecpar(ffst *ff) {
+  if (ff->tmpl) return ff->tmpl->par;
+  return ff->pFormatCtx->streams[ff->videoStream]->codecpar;
+}
+#endif
+
+/* drop a decoder's reference to its template.
+ * The frame index is only kept alive while the file is in use */
+static void ff_template_release(FfTemplate *ft) {
+  FrameIndex *fi = NULL;
+  if (!ft) return;
+  pthread_mutex_lock(&ff_template_lock);
+  assert(ft->refcnt > 0);
+  if (--ft->refcnt == 0) {
+    fi = ft->fidx;
+    ft->fidx = NULL;
+  }
+#ifdef FF_TEMPLATES
+  ft_evict(FF_TEMPLATE_CACHE_SIZE);
+#endif
+  pthread_mutex_unlock(&ff_template_lock);
+  findex_release(fi);
+}
+
+/* share the state of a freshly opened and probed file with later decoders */
+static void ff_template_publish(ffst *ff, const FileKey *k) {
+#ifdef FF_TEMPLATES
+  AVFormatContext *fc = ff->pFormatCtx;
+  AVStream *avs = fc->streams[ff->videoStream];
+  FfTemplate *ft, *tmp;
+
+  if (ff->tmpl) {
+    /* cloned, keep the index in case the template had none */
+    pthread_mutex_lock(&ff_template_lock);
+    if (!ff->tmpl->fidx && ff->fidx) {
+      ff->tmpl->fidx = findex_ref(ff->fidx);
+    }
+    pthread_mutex_unlock(&ff_template_lock);
+    return;
+  }
+  if (fc->ctx_flags & AVFMTCTX_NOHEADER) {
+    return; // streams are only discovered while reading packets
+  }
+  ft = calloc(1, sizeof(FfTemplate));
+  if (!(ft->par = avcodec_parameters_alloc()) || avcodec_parameters_copy(ft->par, avs->codecpar) < 0) {
+    ft_free(ft);
+    return;
+  }
+  memcpy(&ft->key, k, sizeof(FileKey));
+  ft->iformat = fc->iformat;
+  ft->nb_streams = fc->nb_streams;
+  ft->videoStream = ff->videoStream;
+  ft->time_base = avs->time_base;
+  ft->start_time = avs->start_time;
+  ft->fmt_start_time = fc->start_time;
+  ft->duration = ff->duration;
+  ft->framerate = ff->framerate;
+  memcpy(&ft->tc, &ff->tc, sizeof(TimecodeRate));
+  ft->file_frame_offset = ff->file_frame_offset;
+  ft->frames = ff->frames;
+  ft->tpf = ff->tpf;
+  ft->refcnt = 1;
+
+  pthread_mutex_lock(&ff_template_lock);
+  ft->lru = ++ff_template_seq;
+  HASH_FIND(hh, ff_templates, k, sizeof(FileKey), tmp);
+  if (tmp && tmp->refcnt > 0) {
+    /* a concurrent open of the same file was faster */
+    ft_free(ft);
+    ft = tmp;
+    ft->refcnt++;
+    ft->lru = ff_template_seq;
+  } else {
+    if (tmp) {
+      HASH_DEL(ff_templates, tmp);
+      ft_free(tmp);
+    }
+    HASH_ADD(hh, ff_templates, key, sizeof(FileKey), ft);
+    ft_evict(FF_TEMPLATE_CACHE_SIZE);
+  }
+  if (!ft->fidx && ff->fidx) {
+    ft->fidx = findex_ref(ff->fidx);
+  }
+  pthread_mutex_unlock(&ff_template_lock);
+  ff->tmpl = ft;
+#endif
+}
+
+/* open a file by cloning a template of a previous open.
+ * Only the container header is read, stream information and the
+ * frame index are taken from the template.
+ * @return 0 on success, -1 if the file needs to be opened and probed regularly */
+static int ff_template_open(ffst *ff, const char *file_name, const FileKey *k) {
+#ifdef FF_TEMPLATES
+  FfTemplate *ft = NULL;
+  AVFormatContext *fc;
+  AVStream *avs;
+  AVDictionary *opts = NULL;
+  int rv;
+
+  pthread_mutex_lock(&ff_template_lock);
+  HASH_FIND(hh, ff_templates, k, sizeof(FileKey), ft);
+  if (ft) {
+    ft->refcnt++;
+    ft->lru = ++ff_template_seq;
+  }
+  pthread_mutex_unlock(&ff_template_lock);
+  if (!ft) {
+    return -1;
+  }
+
+  /* the demuxer is known, only the header needs to be read */
+  av_dict_set_int(&opts, "probesize", FF_PROBE_SIZE, 0);
+  av_dict_set_int(&opts, "analyzeduration", AV_TIME_BASE / 10, 0);
+  rv = ff_open_input(ff, file_name, ft->iformat, &opts);
+  av_dict_free(&opts);
+
+  fc = ff->pFormatCtx;
+  if (rv < 0
+      || (fc->ctx_flags & AVFMTCTX_NOHEADER)
+      || fc->nb_streams != ft->nb_streams
+      || fc->streams[ft->videoStream]->codecpar->codec_id != ft->par->codec_id
+      || av_cmp_q(fc->streams[ft->videoStream]->time_base, ft->time_base)) {
+    if (rv >= 0) ff_close_format(ff);
+    ff_template_release(ft);
+    return -1;
+  }
+
+  avs = fc->streams[ft->videoStream];
+  avs->start_time = ft->start_time;
+  fc->start_time = ft->fmt_start_time;
+
+  ff->tmpl = ft;
+  ff->videoStream = ft->videoStream;
+  ff->duration = ft->duration;
+  ff->framerate = ft->framerate;
+  memcpy(&ff->tc, &ft->tc, sizeof(TimecodeRate));
+  ff->file_frame_offset = ft->file_frame_offset;
+  ff->frames = ft->frames;
+  ff->tpf = ft->tpf;
+
+  pthread_mutex_lock(&ff_template_lock);
+  if (ft->fidx) ff->fidx = findex_ref(ft->fidx);
+  pthread_mutex_unlock(&ff_template_lock);
+
+  if (want_verbose)
+    fprintf(stdout, "cloned decoder from template for %s\n", file_name);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+static void ff_template_clear(void) {
+#ifdef FF_TEMPLATES
+  FfTemplate *ft, *tmp;
+  pthread_mutex_lock(&ff_template_lock);
+  HASH_ITER(hh, ff_templates, ft, tmp) {
+    if (ft->refcnt > 0) continue;
+    HASH_DEL(ff_templates, ft);
+    ft_free(ft);
+  }
+  pthread_mutex_unlock(&ff_template_lock);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Background index scans
+
+/* files that are scanned in the background */
+typedef struct {
+  char *fn;
+  UT_hash_handle hh;
+} FfScan;
+
+static pthread_mutex_t ff_scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ff_scan_done = PTHREAD_COND_INITIALIZER;
+static FfScan *ff_scans = NULL;
+static int ff_scan_abort = 0;
+
+/* abort background scans and wait for them to finish */
+static void ff_scan_stop(void) {
+  pthread_mutex_lock(&ff_scan_lock);
+  ff_scan_abort = 1;
+  while (HASH_COUNT(ff_scans) > 0) {
+    pthread_cond_wait(&ff_scan_done, &ff_scan_lock);
+  }
+  pthread_mutex_unlock(&ff_scan_lock);
+}
+
 void ff_initialize (void) {
   if (want_verbose) fprintf(stdout, "FFMPEG: registering codecs.\n");
   register_codecs_compat ();
@@ -277,6 +741,9 @@ void ff_initialize (void) {
 }
 
 void ff_cleanup (void) {
+  ff_scan_stop();
+  ff_template_clear();
+  swspool_clear();
   pthread_mutex_destroy(&avcodec_lock);
 }
 
@@ -284,6 +751,12 @@ int ff_close_movie(void *ptr) {
   ffst *ff = (ffst*)ptr;
   if(ff->current_file) free(ff->current_file);
   ff->current_file = NULL;
+  findex_release(ff->fidx);
+  ff->fidx = NULL;
+  ff_template_release(ff->tmpl);
+  ff->tmpl = NULL;
+  imgseq_close(ff->seq);
+  ff->seq = NULL;
 
   if (!ff->pFrameFMT) return(-1);
   if (ff->out_width < 0 || ff->out_height < 0) {
@@ -295,11 +768,10 @@ int ff_close_movie(void *ptr) {
   if (ff->pFrameFMT) av_free(ff->pFrameFMT);
   if (ff->pFrame) av_free(ff->pFrame);
   ff->buffer = NULL;ff->pFrameFMT = ff->pFrame = NULL;
-  pthread_mutex_lock(&avcodec_lock);
+  ff_codec_lock();
   avcodec_free_context(&ff->pCodecCtx);
-  avformat_close_input(&ff->pFormatCtx);
-  pthread_mutex_unlock(&avcodec_lock);
-  if (ff->pSWSCtx) sws_freeContext(ff->pSWSCtx);
+  ff_codec_unlock();
+  ff_close_format(ff);
   return (0);
 }
 
@@ -348,56 +820,153 @@ static void ff_set_framerate(ffst *ff) {
     ff->tc.drop = 1;
 }
 
-int ff_open_movie(void *ptr, char *file_name, int render_fmt) {
-  int i;
-#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 0, 100)
-  AVCodec *pCodec;
+static FrameIndex *ff_build_index(ffst *ff, int scan);
+
+/* configure threading of a codec context prior to avcodec_open2()
+ * @return the effective FF_THREAD_* type, 0 if single threaded */
+static int ff_codec_threads(AVCodecContext *ctx, const AVCodec *codec, int threads, int type) {
+  ctx->thread_count = 1;
+#if defined AV_CODEC_CAP_FRAME_THREADS && defined AV_CODEC_CAP_SLICE_THREADS
+  if (threads < 2) {
+    return 0;
+  }
+  if (type == FF_THREAD_FRAME && !(codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)) {
+    type = FF_THREAD_SLICE;
+  }
+  if (type == FF_THREAD_SLICE && !(codec->capabilities & AV_CODEC_CAP_SLICE_THREADS)) {
+    return 0;
+  }
+  ctx->thread_count = threads;
+  ctx->thread_type = type;
+  return type;
 #else
-  AVCodec const* pCodec;
+  return 0;
 #endif
-  ffst *ff = (ffst*) ptr;
+}
 
-  if (ff->pFrameFMT) {
-    if (ff->current_file && !strcmp(file_name, ff->current_file)) return(0);
-    /* close currently open movie */
-    if (!want_quiet)
-      fprintf(stderr, "replacing current video file buffer\n");
-    ff_close_movie(ff);
+/* re-open the codec with a different threading model or lowres factor.
+ * The decoder state is lost, the next frame request seeks. */
+static int ff_reopen_codec(ffst *ff, int type, int lowres) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+  AVCodecContext *ctx;
+  const AVCodec *codec = avcodec_find_decoder(ff->pCodecCtx->codec_id);
+  int tt;
+  if (!codec || !(ctx = avcodec_alloc_context3(NULL))) {
+    return -1;
   }
+  avcodec_parameters_to_context (ctx, ff_codecpar(ff));
+  tt = ff_codec_threads(ctx, codec, ff->threads, type);
+  if (tt == ff->thread_type && lowres == ff->lowres) {
+    avcodec_free_context(&ctx);
+    return -1;
+  }
+  ctx->lowres = lowres;
 
-  // initialize values
-  ff->pFormatCtx = NULL;
-  ff->pFrameFMT = NULL;
-  ff->movie_width  = 320;
-  ff->movie_height = 180;
-  ff->buf_width = ff->buf_height = 0;
-  ff->movie_height = 180;
-  ff->framerate = ff->duration = ff->frames = 1;
-  ff->file_frame_offset = 0.0;
-  ff->videoStream = -1;
-  ff->tpf = 1;
+  ff_codec_lock();
+  if (avcodec_open2(ctx, codec, NULL) < 0) {
+    ff_codec_unlock();
+    avcodec_free_context(&ctx);
+    return -1;
+  }
+  av_frame_unref(ff->pFrame);
+  avcodec_free_context(&ff->pCodecCtx);
+  ff_codec_unlock();
+
+  ff->pCodecCtx = ctx;
+  ff->thread_type = tt;
+  ff->lowres = lowres;
   ff->avprev = -1;
-  ff->stream_pts_offset = AV_NOPTS_VALUE;
-  ff->render_fmt = render_fmt;
+  if (want_verbose)
+    fprintf(stdout, "%s-threading with %d threads, lowres: %d\n", tt == FF_THREAD_FRAME ? "frame" : "slice", ff->threads, lowres);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+/* slice-threading keeps the latency of single frame (seek) requests low,
+ * frame-threading has the better throughput for sequential playback.
+ * Switch according to the recent request pattern of this decoder. */
+static void ff_thread_policy(ffst *ff, int64_t frame) {
+#ifdef AV_CODEC_CAP_FRAME_THREADS
+  const int can_frame = ff->pCodecCtx->codec && (ff->pCodecCtx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS);
+#else
+  const int can_frame = 0;
+#endif
+  if (ff->threads < 2 || !can_frame) {
+    return;
+  }
+  if (frame == ff->last_frame + 1) {
+    if (ff->seq_run < FF_SEQ_FRAMES) ++ff->seq_run;
+    ff->seek_run = 0;
+  } else if (frame != ff->last_frame) {
+    if (ff->seek_run < FF_SEQ_SEEKS) ++ff->seek_run;
+    ff->seq_run = 0;
+  }
+  ff->last_frame = frame;
+
+  if (ff->seq_run >= FF_SEQ_FRAMES && ff->thread_type != FF_THREAD_FRAME) {
+    ff_reopen_codec(ff, FF_THREAD_FRAME, ff->lowres);
+  } else if (ff->seek_run >= FF_SEQ_SEEKS && ff->thread_type == FF_THREAD_FRAME) {
+    ff_reopen_codec(ff, FF_THREAD_SLICE, ff->lowres);
+  }
+}
+
+/* lowres factor for draft requests: the codec decodes at 1/2^n of the
+ * source resolution, as long as that is still at least twice the output
+ * geometry. The result may differ slightly from a full resolution decode,
+ * draft frames are cached separately (VDEC_QUALITY). */
+static int ff_draft_lowres(ffst *ff) {
+  const AVCodec *codec = ff->pCodecCtx->codec;
+  const int sw = ff_src_width(ff);
+  const int sh = ff_src_height(ff);
+  int lowres = 0;
+  if (!ff->draft || !codec || VCROP_ACTIVE(&ff->crop) || ff->out_width < 1 || ff->out_height < 1) {
+    return 0;
+  }
+  while (lowres < codec->max_lowres
+      && (sw >> (lowres + 1)) >= 2 * ff->out_width
+      && (sh >> (lowres + 1)) >= 2 * ff->out_height) {
+    ++lowres;
+  }
+  return lowres;
+}
+
+static void ff_quality_policy(ffst *ff) {
+  const int lowres = ff_draft_lowres(ff);
+  if (lowres != ff->lowres) {
+    ff_reopen_codec(ff, ff->thread_type ? ff->thread_type : FF_THREAD_SLICE, lowres);
+  }
+}
+
+static void ff_close_input(ffst *ff) {
+  ff_close_format(ff);
+  ff_template_release(ff->tmpl);
+  ff->tmpl = NULL;
+}
+
+/* open and probe a file, find the video stream and its timing */
+static int ff_probe_movie(ffst *ff, const char *file_name) {
+  int i;
 
   /* Open video file */
-  if(avformat_open_input(&ff->pFormatCtx, file_name, NULL, NULL) <0)
+  if (ff_open_input(ff, file_name, NULL, NULL) <0)
   {
     if (!want_quiet)
       fprintf(stderr, "Cannot open video file %s\n", file_name);
     return (-1);
   }
 
-  pthread_mutex_lock(&avcodec_lock);
   /* Retrieve stream information */
-  if(avformat_find_stream_info(ff->pFormatCtx, NULL) < 0) {
+  ff_codec_lock();
+  if (avformat_find_stream_info(ff->pFormatCtx, NULL) < 0) {
+    ff_codec_unlock();
     if (!want_quiet)
       fprintf(stderr, "Cannot find stream information in file %s\n", file_name);
-    avformat_close_input(&ff->pFormatCtx);
-    pthread_mutex_unlock(&avcodec_lock);
+    ff_close_format(ff);
     return (-1);
   }
-  pthread_mutex_unlock(&avcodec_lock);
+  ff_codec_unlock();
 
   if (want_verbose) av_dump_format(ff->pFormatCtx, 0, file_name, 0);
 
@@ -422,7 +991,7 @@ int ff_open_movie(void *ptr, char *file_name, int render_fmt) {
   if(ff->videoStream == -1) {
     if (!want_quiet)
       fprintf(stderr, "Cannot find a video stream in file %s\n", file_name);
-    avformat_close_input(&ff->pFormatCtx);
+    ff_close_format(ff);
     return (-1);
   }
 
@@ -449,41 +1018,287 @@ int ff_open_movie(void *ptr, char *file_name, int render_fmt) {
   }
 
   ff->file_frame_offset = ff->framerate*((double) ff->pFormatCtx->start_time/ (double) AV_TIME_BASE);
+  return (0);
+}
 
-  if (want_verbose) {
-    fprintf(stdout, "frame rate: %g\n", ff->framerate);
-    fprintf(stdout, "length in seconds: %g\n", ff->duration);
-    fprintf(stdout, "total frames: %ld\n", ff->frames);
-    fprintf(stdout, "start offset: %.0f [frames]\n", ff->file_frame_offset);
+//--------------------------------------------
+// Image sequences
+//--------------------------------------------
+
+static enum AVCodecID ff_image_codec(const char *suffix) {
+  const char *ext = strrchr(suffix, '.');
+  if (!ext) return AV_CODEC_ID_NONE;
+  if (!strcasecmp(ext, ".dpx")) return AV_CODEC_ID_DPX;
+  if (!strcasecmp(ext, ".exr")) return AV_CODEC_ID_EXR;
+  if (!strcasecmp(ext, ".tif") || !strcasecmp(ext, ".tiff")) return AV_CODEC_ID_TIFF;
+  if (!strcasecmp(ext, ".png")) return AV_CODEC_ID_PNG;
+  if (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg")) return AV_CODEC_ID_MJPEG;
+  if (!strcasecmp(ext, ".bmp")) return AV_CODEC_ID_BMP;
+  if (!strcasecmp(ext, ".tga")) return AV_CODEC_ID_TARGA;
+  return AV_CODEC_ID_NONE;
+}
+
+/* read the file of a video-frame into a packet */
+static int ff_seq_read(ffst *ff, int64_t frame, AVPacket *packet) {
+  char fn[1024];
+  struct stat sb;
+  int64_t off = 0;
+  int fd;
+
+  if (!imgseq_frame_path(ff->seq, frame, fn, sizeof(fn))) {
+    return -1;
+  }
+  if ((fd = open(fn, O_RDONLY | O_BINARY)) < 0) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot open image %s\n", fn);
+    return -1;
+  }
+  if (fstat(fd, &sb) || sb.st_size <= 0 || sb.st_size > INT_MAX / 2 || av_new_packet(packet, sb.st_size) < 0) {
+    close(fd);
+    return -1;
+  }
+  while (off < sb.st_size) {
+    const ssize_t n = read(fd, packet->data + off, sb.st_size - off);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    off += n;
+  }
+  close(fd);
+  if (off != sb.st_size) {
+    av_packet_unref (packet);
+    return -1;
   }
+  packet->pts = packet->dts = frame;
+  packet->flags |= AV_PKT_FLAG_KEY;
+  return 0;
+}
 
-  // Get a pointer to the codec context for the video stream
-#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
-  ff->pCodecCtx = avcodec_alloc_context3(NULL);
-  avcodec_parameters_to_context (ff->pCodecCtx, ff->pFormatCtx->streams[ff->videoStream]->codecpar);
-#elif LIBAVFORMAT_BUILD > 4629
-  ff->pCodecCtx = ff->pFormatCtx->streams[ff->videoStream]->codec;
+/* decode a video-frame of a sequence, there is no state to seek:
+ * every image is decoded on its own */
+static int ff_seq_decode(ffst *ff, int64_t frame) {
+  AVPacket *packet = &ff->packet;
+  int err, frameFinished = 0;
+
+  if (ff->avprev == frame) {
+    return 0;
+  }
+  ff->avprev = -1;
+  if (ff_seq_read(ff, frame, packet)) {
+    return -1;
+  }
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(52, 21, 0)
+  err = avcodec_decode_video (ff->pCodecCtx, ff->pFrame, &frameFinished, packet->data, packet->size);
+#elif LIBAVCODEC_VERSION_INT < AV_VERSION_INT(57, 106, 102)
+  err = avcodec_decode_video2 (ff->pCodecCtx, ff->pFrame, &frameFinished, packet);
 #else
-  ff->pCodecCtx = &(ff->pFormatCtx->streams[ff->videoStream]->codec);
+  /* drain right away, nothing is carried over to the next image */
+  err = avcodec_send_packet (ff->pCodecCtx, packet);
+  if (err >= 0) {
+    avcodec_send_packet (ff->pCodecCtx, NULL);
+    err = avcodec_receive_frame (ff->pCodecCtx, ff->pFrame);
+    frameFinished = err >= 0;
+  }
+  avcodec_flush_buffers (ff->pCodecCtx);
 #endif
+  av_packet_unref (packet);
 
-// FIXME: don't scale here - announce aspect ratio
-// out_width/height remains in aspect 1:1
-#ifdef SCALE_UP
-  ff->movie_width = (int) floor((double)ff->pCodecCtx->height * ff_get_aspectratio(ff));
-  ff->movie_height = ff->pCodecCtx->height;
+  if (err < 0 || !frameFinished) {
+    return -1;
+  }
+  ff->avprev = frame;
+  return 0;
+}
+
+/* open a numbered image sequence, frame N maps directly to a file.
+ * The geometry is that of the first image. */
+static int ff_open_sequence(ffst *ff, const char *file_name) {
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 0, 100)
+  AVCodec *pCodec;
 #else
-  ff->movie_width = ff->pCodecCtx->width;
-  ff->movie_height = (int) floor((double)ff->pCodecCtx->width / ff_get_aspectratio(ff));
+  AVCodec const* pCodec;
 #endif
 
-  // somewhere around LIBAVFORMAT_BUILD  4630
-#ifdef AVFMT_FLAG_GENPTS
-  if (ff->want_genpts) {
-    ff->pFormatCtx->flags |= AVFMT_FLAG_GENPTS;
-//  ff->pFormatCtx->flags |= AVFMT_FLAG_IGNIDX;
+  if (!(ff->seq = imgseq_open(file_name))) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot find image sequence %s\n", file_name);
+    return (-1);
   }
-#endif
+
+  ff->tc.num = ff->seq->fps_num;
+  ff->tc.den = ff->seq->fps_den;
+  ff->tc.drop = 0;
+  ff->framerate = (double) ff->tc.num / (double) ff->tc.den;
+  if (floor(ff->framerate * 100.0) == 2997)
+    ff->tc.drop = 1;
+  ff->frames = ff->seq->last - ff->seq->first + 1;
+  ff->duration = ff->frames / ff->framerate;
+  ff->videoStream = 0;
+
+  if (want_verbose) {
+    fprintf(stdout, "image sequence: %"PRId64" files, first: %"PRId64" last: %"PRId64"\n",
+        ff->seq->count, ff->seq->first, ff->seq->last);
+    fprintf(stdout, "frame rate: %g\n", ff->framerate);
+    fprintf(stdout, "total frames: %ld\n", ff->frames);
+  }
+
+  pCodec = avcodec_find_decoder(ff_image_codec(ff->seq->suffix));
+  if (!pCodec || !(ff->pCodecCtx = avcodec_alloc_context3(pCodec))) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot find a codec for image sequence: %s\n", file_name);
+    goto fail;
+  }
+
+  /* images are independent, frame-threading has nothing to overlap */
+  ff->thread_type = ff_codec_threads(ff->pCodecCtx, pCodec, ff->threads, FF_THREAD_SLICE);
+
+  ff_codec_lock();
+  if (avcodec_open2(ff->pCodecCtx, pCodec, NULL) < 0) {
+    ff_codec_unlock();
+    if (!want_quiet)
+      fprintf(stderr, "Cannot open the codec for image sequence %s\n", file_name);
+    goto fail;
+  }
+  ff_codec_unlock();
+
+  if (!(ff->pFrame = av_frame_alloc()) || !(ff->pFrameFMT = av_frame_alloc())) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot allocate video frame buffer\n");
+    goto fail;
+  }
+
+  if (ff_seq_decode(ff, 0)) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot decode the first image of %s\n", file_name);
+    goto fail;
+  }
+
+  if (ff->pCodecCtx->sample_aspect_ratio.num == 0) {
+    ff->pCodecCtx->sample_aspect_ratio = ff->pFrame->sample_aspect_ratio;
+  }
+  ff->src_width = ff->pCodecCtx->width;
+  ff->src_height = ff->pCodecCtx->height;
+  ff->lowres = 0;
+#ifdef SCALE_UP
+  ff->movie_width = (int) floor((double)ff->pCodecCtx->height * ff_get_aspectratio(ff));
+  ff->movie_height = ff->pCodecCtx->height;
+#else
+  ff->movie_width = ff->pCodecCtx->width;
+  ff->movie_height = (int) floor((double)ff->pCodecCtx->width / ff_get_aspectratio(ff));
+#endif
+
+  if (want_verbose)
+    fprintf(stdout, "movie size:  %ix%i px\n", ff->movie_width, ff->movie_height);
+
+  ff->out_width = ff->out_height = -1;
+  ff->current_file = strdup(file_name);
+  return (0);
+
+fail:
+  if (ff->pFrameFMT) av_free(ff->pFrameFMT);
+  if (ff->pFrame) av_free(ff->pFrame);
+  ff->pFrameFMT = ff->pFrame = NULL;
+  ff_codec_lock();
+  avcodec_free_context(&ff->pCodecCtx);
+  ff_codec_unlock();
+  imgseq_close(ff->seq);
+  ff->seq = NULL;
+  return (-1);
+}
+
+/* actual frame count of an indexed file instead of the duration based estimate */
+static void ff_index_frames(ffst *ff) {
+  if (ff->fidx && ff->fidx->n_frames > 0 && ff->fidx->first_frame + ff->fidx->n_frames > 0) {
+    ff->frames = ff->fidx->first_frame + ff->fidx->n_frames;
+  }
+}
+
+int ff_open_movie(void *ptr, char *file_name, int render_fmt) {
+  int have_key;
+  FileKey fkey;
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 0, 100)
+  AVCodec *pCodec;
+#else
+  AVCodec const* pCodec;
+#endif
+  ffst *ff = (ffst*) ptr;
+
+  if (ff->pFrameFMT) {
+    if (ff->current_file && !strcmp(file_name, ff->current_file)) return(0);
+    /* close currently open movie */
+    if (!want_quiet)
+      fprintf(stderr, "replacing current video file buffer\n");
+    ff_close_movie(ff);
+  }
+
+  // initialize values
+  ff->pFormatCtx = NULL;
+  ff->pFrameFMT = NULL;
+  ff->movie_width  = 320;
+  ff->movie_height = 180;
+  ff->buf_width = ff->buf_height = 0;
+  ff->movie_height = 180;
+  ff->framerate = ff->duration = ff->frames = 1;
+  ff->file_frame_offset = 0.0;
+  ff->videoStream = -1;
+  ff->tpf = 1;
+  ff->avprev = -1;
+  ff->pkt_next = AV_NOPTS_VALUE;
+  ff->stream_pts_offset = AV_NOPTS_VALUE;
+  ff->render_fmt = render_fmt;
+  ff->thread_type = 0;
+  ff->seq_run = ff->seek_run = 0;
+  ff->last_frame = -1;
+  memset(&ff->crop, 0, sizeof(VCrop));
+
+  if (imgseq_is_pattern(file_name)) {
+    return ff_open_sequence(ff, file_name);
+  }
+
+  /* clone the per-file state of a decoder that opened this file before */
+  have_key = !findex_filekey(file_name, &fkey);
+  if (!have_key || ff_template_open(ff, file_name, &fkey)) {
+    if (ff_probe_movie(ff, file_name)) {
+      return (-1);
+    }
+  }
+
+  if (want_verbose) {
+    fprintf(stdout, "frame rate: %g\n", ff->framerate);
+    fprintf(stdout, "length in seconds: %g\n", ff->duration);
+    fprintf(stdout, "total frames: %ld\n", ff->frames);
+    fprintf(stdout, "start offset: %.0f [frames]\n", ff->file_frame_offset);
+  }
+
+  // Get a pointer to the codec context for the video stream
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+  ff->pCodecCtx = avcodec_alloc_context3(NULL);
+  avcodec_parameters_to_context (ff->pCodecCtx, ff_codecpar(ff));
+#elif LIBAVFORMAT_BUILD > 4629
+  ff->pCodecCtx = ff->pFormatCtx->streams[ff->videoStream]->codec;
+#else
+  ff->pCodecCtx = &(ff->pFormatCtx->streams[ff->videoStream]->codec);
+#endif
+  ff->src_width = ff->pCodecCtx->width;
+  ff->src_height = ff->pCodecCtx->height;
+  ff->lowres = 0;
+
+// FIXME: don't scale here - announce aspect ratio
+// out_width/height remains in aspect 1:1
+#ifdef SCALE_UP
+  ff->movie_width = (int) floor((double)ff->pCodecCtx->height * ff_get_aspectratio(ff));
+  ff->movie_height = ff->pCodecCtx->height;
+#else
+  ff->movie_width = ff->pCodecCtx->width;
+  ff->movie_height = (int) floor((double)ff->pCodecCtx->width / ff_get_aspectratio(ff));
+#endif
+
+  // somewhere around LIBAVFORMAT_BUILD  4630
+#ifdef AVFMT_FLAG_GENPTS
+  if (ff->want_genpts) {
+    ff->pFormatCtx->flags |= AVFMT_FLAG_GENPTS;
+//  ff->pFormatCtx->flags |= AVFMT_FLAG_IGNIDX;
+  }
+#endif
 
   if (want_verbose)
     fprintf(stdout, "movie size:  %ix%i px\n", ff->movie_width, ff->movie_height);
@@ -493,26 +1308,29 @@ int ff_open_movie(void *ptr, char *file_name, int render_fmt) {
   if(pCodec == NULL) {
     if (!want_quiet)
       fprintf(stderr, "Cannot find a codec for file: %s\n", file_name);
-    avformat_close_input(&ff->pFormatCtx);
+    ff_close_input(ff);
     return(-1);
   }
 
+  // start with low-latency threading, see ff_thread_policy()
+  ff->thread_type = ff_codec_threads(ff->pCodecCtx, pCodec, ff->threads, FF_THREAD_SLICE);
+
   // Open codec
-  pthread_mutex_lock(&avcodec_lock);
+  ff_codec_lock();
   if(avcodec_open2(ff->pCodecCtx, pCodec, NULL) < 0) {
     if (!want_quiet)
       fprintf(stderr, "Cannot open the codec for file %s\n", file_name);
-    pthread_mutex_unlock(&avcodec_lock);
-    avformat_close_input(&ff->pFormatCtx);
+    ff_codec_unlock();
+    ff_close_input(ff);
     return(-1);
   }
-  pthread_mutex_unlock(&avcodec_lock);
+  ff_codec_unlock();
 
   if (!(ff->pFrame = av_frame_alloc())) {
     if (!want_quiet)
       fprintf(stderr, "Cannot allocate video frame buffer\n");
     avcodec_free_context(&ff->pCodecCtx);
-    avformat_close_input(&ff->pFormatCtx);
+    ff_close_input(ff);
     return(-1);
   }
 
@@ -521,16 +1339,309 @@ int ff_open_movie(void *ptr, char *file_name, int render_fmt) {
       fprintf(stderr, "Cannot allocate display frame buffer\n");
     av_free(ff->pFrame);
     avcodec_free_context(&ff->pCodecCtx);
-    avformat_close_input(&ff->pFormatCtx);
+    ff_close_input(ff);
     return(-1);
   }
 
   ff->out_width = ff->out_height = -1;
 
   ff->current_file = strdup(file_name);
+  /* use a cached index. Building one is deferred until a seek needs it
+   * (see ff_need_index()), probing a file must not read all of it. */
+  if (!ff->fidx) {
+    ff->fidx = findex_lookup(file_name);
+  }
+  ff->fidx_check = 0;
+  ff_index_frames(ff);
+  if (have_key) {
+    ff_template_publish(ff, &fkey);
+  }
   return(0);
 }
 
+static FrameIndex *ff_scan_index(ffst *ff) {
+  AVStream *v_stream = ff->pFormatCtx->streams[ff->videoStream];
+  AVCodecParserContext *parser;
+  AVCodecContext *pctx;
+  FrameIndex *fi;
+  int i;
+
+  const int64_t start = v_stream->start_time != AV_NOPTS_VALUE ? v_stream->start_time : 0;
+  if (av_seek_frame(ff->pFormatCtx, ff->videoStream, start, AVSEEK_FLAG_BACKWARD) < 0) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot rewind file for indexing: %s\n", ff->current_file);
+    return NULL;
+  }
+  ff->avprev = -1;
+  ff->pkt_next = AV_NOPTS_VALUE;
+
+  /* the parser is only used to look up the picture type */
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+  pctx = avcodec_alloc_context3(NULL);
+  avcodec_parameters_to_context (pctx, ff_codecpar(ff));
+#else
+  pctx = ff->pCodecCtx;
+#endif
+  if ((parser = av_parser_init(ff->pCodecCtx->codec_id))) {
+    parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+  }
+
+  /* packet-only scan, skip all other streams */
+  for (i = 0; i < ff->pFormatCtx->nb_streams; i++) {
+    if (i != ff->videoStream) ff->pFormatCtx->streams[i]->discard = AVDISCARD_ALL;
+  }
+
+  fi = findex_create(ff->frames + 1);
+  fi->source = FIDX_SRC_SCAN;
+
+  while (!ff_scan_abort && av_read_frame (ff->pFormatCtx, &ff->packet) >= 0) {
+    AVPacket *packet = &ff->packet;
+    if (packet->stream_index == ff->videoStream) {
+      const int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+      int pict_type = 0;
+      if (parser) {
+        uint8_t *pout = NULL;
+        int pout_size = 0;
+        av_parser_parse2 (parser, pctx, &pout, &pout_size,
+            packet->data, packet->size, packet->pts, packet->dts, packet->pos);
+        pict_type = parser->pict_type;
+      }
+      if (ts != AV_NOPTS_VALUE) {
+        findex_append(fi, ts, packet->pos, (packet->flags & AV_PKT_FLAG_KEY) ? FIDX_KEY : 0, pict_type);
+      }
+    }
+    av_packet_unref (&ff->packet);
+  }
+
+  for (i = 0; i < ff->pFormatCtx->nb_streams; i++) {
+    ff->pFormatCtx->streams[i]->discard = AVDISCARD_DEFAULT;
+  }
+
+  if (parser) av_parser_close(parser);
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 33, 100)
+  avcodec_free_context(&pctx);
+#endif
+  if (ff_scan_abort) {
+    /* shutdown, the index is incomplete */
+    free(fi->e);
+    free(fi);
+    return NULL;
+  }
+  return fi;
+}
+
+/* build the index from the container index, if that is complete.
+ * Otherwise scan the file if \a scan is set, or return NULL. */
+static FrameIndex *ff_build_index(ffst *ff, int scan) {
+  AVStream *v_stream = ff->pFormatCtx->streams[ff->videoStream];
+  FrameIndex *fi = NULL;
+  FileKey key;
+  int i, n;
+
+  if (findex_filekey(ff->current_file, &key)) {
+    return NULL;
+  }
+
+  /* use the container index if it has an entry for every frame.
+   * Containers may index decode-timestamps, which only equal the
+   * presentation-timestamps if frames are not reordered. */
+  n = avformat_index_get_entries_count(v_stream);
+  if (n > 0 && n + 1 >= ff->frames && ff->pCodecCtx->has_b_frames == 0) {
+    fi = findex_create(n);
+    fi->source = FIDX_SRC_CONTAINER;
+    for (i = 0; i < n; ++i) {
+      const AVIndexEntry *ie = avformat_index_get_entry(v_stream, i);
+      if (!ie) break;
+#ifdef AVINDEX_DISCARD_FRAME
+      if (ie->flags & AVINDEX_DISCARD_FRAME) continue;
+#endif
+      if (ie->flags & AVINDEX_KEYFRAME) {
+        findex_append(fi, ie->timestamp, ie->pos, FIDX_KEY, AV_PICTURE_TYPE_I);
+      } else {
+        findex_append(fi, ie->timestamp, ie->pos, 0, 0);
+      }
+    }
+  } else if (scan) {
+    fi = ff_scan_index(ff);
+  }
+
+  if (!fi) {
+    return NULL;
+  }
+
+  memcpy(&fi->key, &key, sizeof(FileKey));
+  fi->tb_num = v_stream->time_base.num;
+  fi->tb_den = v_stream->time_base.den;
+  fi->fr_num = ff->tc.num;
+  fi->fr_den = ff->tc.den;
+  findex_finalize(fi);
+
+  if (want_verbose)
+    fprintf(stdout, "frame index: %"PRId64" frames, %"PRId64" keyframes (%s)\n",
+        fi->n_frames, fi->n_keyframes, findex_source_name(fi));
+  return fi;
+}
+
+/* index of an image sequence: every image is a keyframe,
+ * timestamps are frame-numbers in units of the frame-duration */
+static FrameIndex *ff_seq_index(ffst *ff) {
+  FrameIndex *fi;
+  FileKey key;
+  int64_t i;
+
+  if (findex_filekey(ff->current_file, &key)) {
+    return NULL;
+  }
+
+  fi = findex_create(ff->frames);
+  fi->source = FIDX_SRC_SEQUENCE;
+  for (i = 0; i < ff->frames; ++i) {
+    findex_append(fi, i, -1, FIDX_KEY, AV_PICTURE_TYPE_I);
+  }
+
+  memcpy(&fi->key, &key, sizeof(FileKey));
+  fi->tb_num = ff->tc.den;
+  fi->tb_den = ff->tc.num;
+  fi->fr_num = ff->tc.num;
+  fi->fr_den = ff->tc.den;
+  findex_finalize(fi);
+  return fi;
+}
+
+/**
+ * look up or build the frame index of the currently open file.
+ *
+ * NB. building the index may require to read the complete file
+ * and invalidates the current decoder position.
+ *
+ * @arg ptr handle / ff-data structure
+ * @arg fi  returned index, to be released with findex_release()
+ * @return 0 on success, -1 on error
+ */
+int ff_get_index(void *ptr, FrameIndex **fi) {
+  ffst *ff = (ffst*) ptr;
+  if (!ff->fidx && ff->seq) {
+    FrameIndex *fx = ff_seq_index(ff);
+    if (!fx) return -1;
+    ff->fidx = findex_publish(fx);
+  }
+  if (!ff->fidx) {
+    FrameIndex *fx;
+    if (!ff->pFormatCtx || ff->videoStream < 0) return -1;
+    fx = ff_build_index(ff, 1);
+    if (!fx) return -1;
+    ff->fidx = findex_publish(fx);
+    ff_index_frames(ff);
+  }
+  *fi = findex_ref(ff->fidx);
+  return 0;
+}
+
+/**
+ * check how frame-numbers map to the file.
+ *
+ * @arg ptr handle / ff-data structure
+ * @return 1 if frame-numbers and the frame count are exact (frame index,
+ * image sequence), 0 if they are estimated from the frame-rate
+ */
+int ff_indexed(void *ptr) {
+  ffst *ff = (ffst*) ptr;
+  return (ff->seq || (ff->fidx && ff->fidx->n_frames > 0)) ? 1 : 0;
+}
+
+static void *ff_scan_thread(void *arg) {
+  FfScan *s = (FfScan*) arg;
+  void *ptr = NULL;
+  ff_create(&ptr);
+  if (!ff_open_movie(ptr, s->fn, AV_PIX_FMT_RGB24)) {
+    ffst *ff = (ffst*) ptr;
+    if (!ff->fidx) {
+      FrameIndex *fx = ff_build_index(ff, 1);
+      if (fx) findex_release(findex_publish(fx));
+    }
+  }
+  ff_destroy(&ptr);
+
+  pthread_mutex_lock(&ff_scan_lock);
+  HASH_DEL(ff_scans, s);
+  pthread_cond_signal(&ff_scan_done);
+  pthread_mutex_unlock(&ff_scan_lock);
+  free(s->fn);
+  free(s);
+  return NULL;
+}
+
+/* start a background scan of the given file, unless one is in progress */
+static void ff_scan_start(const char *fn) {
+  FfScan *s;
+  pthread_t thread;
+  pthread_attr_t attr;
+
+  pthread_mutex_lock(&ff_scan_lock);
+  HASH_FIND_STR(ff_scans, fn, s);
+  if (s || ff_scan_abort || HASH_COUNT(ff_scans) >= FF_INDEX_SCANS) {
+    pthread_mutex_unlock(&ff_scan_lock);
+    return;
+  }
+  s = calloc(1, sizeof(FfScan));
+  s->fn = strdup(fn);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (pthread_create(&thread, &attr, ff_scan_thread, s)) {
+    if (!want_quiet)
+      fprintf(stderr, "Cannot start index scan of: %s\n", fn);
+    free(s->fn);
+    free(s);
+  } else {
+    HASH_ADD_KEYPTR(hh, ff_scans, s->fn, strlen(s->fn), s);
+  }
+  pthread_attr_destroy(&attr);
+  pthread_mutex_unlock(&ff_scan_lock);
+}
+
+/* a seek without an index: use a complete container index right away.
+ * A packet scan reads the whole file, it runs in the background and
+ * seeks use estimated timestamps until it is available. */
+static void ff_need_index(ffst *ff) {
+  FrameIndex *fx;
+  const time_t now = time(NULL);
+  if (ff->fidx || !ff->current_file || ff->fidx_check == now) return;
+  ff->fidx_check = now;
+
+  if ((ff->fidx = findex_lookup(ff->current_file))) {
+    ff_index_frames(ff);
+    return;
+  }
+  if ((fx = ff_build_index(ff, 0))) {
+    ff->fidx = findex_publish(fx);
+    ff_index_frames(ff);
+    return;
+  }
+  ff_scan_start(ff->current_file);
+}
+
+/* map a frame-number to the timestamp of the frame.
+ * With an index this is exact (also for variable frame-rate),
+ * and \a kf_pts is set to the timestamp of the preceding keyframe.
+ * @return stream timestamp or AV_NOPTS_VALUE if the frame does not exist */
+static int64_t ff_frame_pts(ffst *ff, int64_t framenumber, int64_t *kf_pts, int64_t *gop) {
+  if (kf_pts) *kf_pts = AV_NOPTS_VALUE;
+  if (gop) *gop = 0;
+  if (ff->fidx && ff->fidx->n_frames > 0) {
+    int64_t k, n = findex_frame_entry(ff->fidx, framenumber);
+    if (n < 0) return AV_NOPTS_VALUE;
+    if ((k = findex_keyframe_before(ff->fidx, n)) >= 0) {
+      if (kf_pts) *kf_pts = ff->fidx->e[k].pts;
+      if (gop) *gop = n - k;
+    }
+    return ff->fidx->e[n].pts;
+  } else {
+    const AVRational fr_Q = { ff->tc.den, ff->tc.num };
+    if (framenumber < 0 || framenumber >= ff->frames) return AV_NOPTS_VALUE;
+    return av_rescale_q(framenumber, fr_Q, ff->pFormatCtx->streams[ff->videoStream]->time_base);
+  }
+}
+
 static uint64_t parse_pts_from_frame (AVFrame *f) {
   uint64_t pts = AV_NOPTS_VALUE;
   static uint8_t pts_warn = 0; // should be per decoder
@@ -584,30 +1695,91 @@ static uint64_t parse_pts_from_frame (AVFrame *f) {
   return pts;
 }
 
+static void ff_scale_frame(ffst *ff);
+
+/* pass a frame that was decoded on the way to the target frame on,
+ * converted to the geometry and format of the current request.
+ * Only the frames immediately preceding the target are passed on,
+ * as many as the budget allows (frames are decoded in order, the
+ * remaining budget shrinks along with the distance to the target). */
+static void ff_decode_through(ffst *ff, int64_t pts, int64_t target_pts) {
+  VDecodeThrough *dt = ff->dt;
+  uint8_t *buf, *prev;
+  int64_t n, t, frame;
+  if (!dt || dt->budget <= 0 || !ff->fidx || ff->want_ignstart) return;
+  n = findex_find_pts(ff->fidx, pts);
+  if (n < 0 || ff->fidx->e[n].pts != pts) return;
+  t = findex_find_pts(ff->fidx, target_pts);
+  if (n >= t || t - n > dt->budget) return;
+  frame = findex_frame_number(ff->fidx, n);
+  if (!(buf = dt->get(dt->arg, frame))) return;
+  dt->budget--;
+  prev = ff->buffer;
+  ff_set_bufferptr(ff, buf);
+  ff_scale_frame(ff);
+  ff_set_bufferptr(ff, prev);
+  dt->done(dt->arg, frame, buf);
+}
+
+/* ask the I/O layer to read the GOP of index entry \a n ahead: from its
+ * keyframe \a k up to the next keyframe. Packets of a GOP are not necessarily
+ * stored in presentation order, hence the min/max. */
+static void ff_prefetch_gop(ffst *ff, int64_t k, int64_t n) {
+  const FrameIndex *fi = ff->fidx;
+  int64_t i, lo = -1, hi = -1;
+  if (!ff->mio || !fi || k < 0) return;
+  for (i = k; i < fi->n_frames && (i <= n || !(fi->e[i].flags & FIDX_KEY)); ++i) {
+    const int64_t pos = fi->e[i].pos;
+    if (pos < 0) continue;
+    if (lo < 0 || pos < lo) lo = pos;
+    if (pos > hi) hi = pos;
+  }
+  if (lo < 0) return;
+  mediaio_prefetch(ff->mio, lo, hi - lo + FF_PREFETCH_TAIL);
+}
+
 static int my_seek_frame (ffst *ff, AVPacket *packet, int64_t framenumber) {
-  AVStream *v_stream;
   int rv = 0;
-  int64_t timestamp;
+  int64_t timestamp, kf_pts, gop;
 
   if (ff->videoStream < 0) return (0);
-  v_stream = ff->pFormatCtx->streams[ff->videoStream];
 
   if (ff->want_ignstart)
     framenumber += (int64_t) rint(ff->framerate * ((double)ff->pFormatCtx->start_time / (double)AV_TIME_BASE));
 
-  if (framenumber < 0 || framenumber >= ff->frames) {
-    return -1;
+  if (!ff->fidx) {
+    ff_need_index(ff);
   }
 
-  const AVRational fr_Q = { ff->tc.den, ff->tc.num };
-  timestamp = av_rescale_q(framenumber, fr_Q, v_stream->time_base);
+  timestamp = ff_frame_pts(ff, framenumber, &kf_pts, &gop);
+  if (timestamp == AV_NOPTS_VALUE) {
+    return -1;
+  }
 
   if (ff->avprev == timestamp) {
     return 0;
   }
 
-  if (ff->avprev < 0 || ff->avprev >= timestamp || ((ff->avprev + 32 * ff->tpf) < timestamp)) {
-    rv = av_seek_frame(ff->pFormatCtx, ff->videoStream, timestamp, AVSEEK_FLAG_BACKWARD) ;
+  ff->pkt_next = AV_NOPTS_VALUE;
+
+  int want_seek;
+  if (ff->avprev < 0 || ff->avprev >= timestamp) {
+    want_seek = 1;
+  } else if (kf_pts != AV_NOPTS_VALUE) {
+    /* only seek if there is a keyframe between the current position and the target */
+    want_seek = kf_pts > ff->avprev;
+  } else {
+    want_seek = (ff->avprev + 32 * ff->tpf) < timestamp;
+  }
+
+  if (want_seek) {
+    /* with an index, go directly to the keyframe preceding the target */
+    const int64_t seek_ts = kf_pts != AV_NOPTS_VALUE ? kf_pts : timestamp;
+    if (kf_pts != AV_NOPTS_VALUE && ff->fidx) {
+      const int64_t n = findex_frame_entry(ff->fidx, framenumber);
+      ff_prefetch_gop(ff, n - gop, n);
+    }
+    rv = av_seek_frame(ff->pFormatCtx, ff->videoStream, seek_ts, AVSEEK_FLAG_BACKWARD) ;
     maybe_avcodec_flush_buffers (ff->pCodecCtx);
   }
 
@@ -617,8 +1789,13 @@ static int my_seek_frame (ffst *ff, AVPacket *packet, int64_t framenumber) {
     return -1;
   }
 
-  int bailout = 600;
+  int bailout = 600 + gop;
   int decoded = 0;
+  int reseek = 0;
+  /* only the target is shown: with exact (indexed) timestamps, non-reference
+   * frames can be skipped, unless they are passed on (decode-through) */
+  const int skip_nonref = kf_pts != AV_NOPTS_VALUE
+    && !(ff->dt && ff->dt->budget > 0 && ff->fidx);
   while (bailout > 0) {
     int err;
     if ((err = av_read_frame (ff->pFormatCtx, packet)) < 0) {
@@ -634,6 +1811,12 @@ static int my_seek_frame (ffst *ff, AVPacket *packet, int64_t framenumber) {
       continue;
     }
 
+    /* frames after the target are kept: with reordering (and frame-threading)
+     * they are read before the target is output, the next sequential
+     * request needs them */
+    ff->pCodecCtx->skip_frame = (skip_nonref && packet->pts != AV_NOPTS_VALUE && packet->pts < timestamp)
+      ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
     int frameFinished = 0;
 #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(52, 21, 0)
     err = avcodec_decode_video (ff->pCodecCtx, ff->pFrame, &frameFinished, packet->data, packet->size);
@@ -680,11 +1863,30 @@ static int my_seek_frame (ffst *ff, AVPacket *packet, int64_t framenumber) {
 	return 0; // OK
       }
       // Cannot reliably seek to target frame
-      if (decoded == 0) {
+      /* with an index the keyframe was known: frames before the target
+       * may have been decoded, re-seek once regardless */
+      if (decoded == 0 || (kf_pts != AV_NOPTS_VALUE && !reseek)) {
+	int64_t reseek_ts;
+	reseek = 1;
 	if (want_verbose)
 	  fprintf(stdout, " PTS mismatch want: %"PRId64" got: %"PRId64" -> re-seek\n", timestamp, pts);
-	// re-seek - make a guess, since we don't know the keyframe interval
-	rv = av_seek_frame(ff->pFormatCtx, ff->videoStream, MAX(0, timestamp - ff->tpf * 25), AVSEEK_FLAG_BACKWARD) ;
+	if (kf_pts != AV_NOPTS_VALUE) {
+	  /* the keyframe is known: start over from it, or from the one before
+	   * if decoding from there did not reach the target */
+	  const int64_t n = findex_frame_entry(ff->fidx, framenumber);
+	  int64_t k = n - gop;
+	  if (want_seek && k > 0) {
+	    const int64_t kp = findex_keyframe_before(ff->fidx, k - 1);
+	    if (kp >= 0) k = kp;
+	  }
+	  ff_prefetch_gop(ff, k, n);
+	  reseek_ts = ff->fidx->e[k].pts;
+	  bailout += n - k;
+	} else {
+	  // re-seek - make a guess, since we don't know the keyframe interval
+	  reseek_ts = MAX(0, timestamp - ff->tpf * 25);
+	}
+	rv = av_seek_frame(ff->pFormatCtx, ff->videoStream, reseek_ts, AVSEEK_FLAG_BACKWARD) ;
 	maybe_avcodec_flush_buffers (ff->pCodecCtx);
 	if (rv < 0) {
 	  return -3;
@@ -698,12 +1900,90 @@ static int my_seek_frame (ffst *ff, AVPacket *packet, int64_t framenumber) {
       return -2;
     }
 
+    ff_decode_through(ff, pts, timestamp);
+
     --bailout;
     ++decoded;
   }
   return -5;
 }
 
+/* convert and scale the decoded frame (or the selected region of it)
+ * into the output buffer */
+/* swscale algorithm of the current request */
+static int ff_sws_flags(ffst *ff, int src_w, int src_h) {
+  switch (ff->scaler) {
+    case VSCALE_FAST:     return SWS_FAST_BILINEAR;
+    case VSCALE_BILINEAR: return SWS_BILINEAR;
+    case VSCALE_BICUBIC:  return SWS_BICUBIC;
+    case VSCALE_AREA:     return SWS_AREA;
+    case VSCALE_LANCZOS:  return SWS_LANCZOS;
+    default: break;
+  }
+  /* bicubic does not pay off when downscaling (thumbnails),
+   * the bilinear filter is widened with the ratio and does not alias */
+  if (2 * ff->out_width <= src_w && 2 * ff->out_height <= src_h) {
+    return SWS_BILINEAR;
+  }
+  return SWS_BICUBIC;
+}
+
+static void ff_scale_frame(ffst *ff) {
+  const uint8_t *src[4];
+  int stride[4], offsets[4], i;
+  struct SwsContext *sws;
+  SwsKey k;
+  void *sh;
+  enum AVPixelFormat src_fmt = ff->pCodecCtx->pix_fmt;
+  int src_w = ff->pCodecCtx->width;
+  int src_h = ff->pCodecCtx->height;
+
+  memset(offsets, 0, sizeof(offsets));
+  memset(&k, 0, sizeof(SwsKey)); // the key is hashed as-is
+  if (VCROP_ACTIVE(&ff->crop) && ff->pFrame->format == ff->pCodecCtx->pix_fmt
+      && ff->crop.x + ff->crop.w <= ff->pFrame->width
+      && ff->crop.y + ff->crop.h <= ff->pFrame->height) {
+    ff_crop_offsets(ff, ff->pFrame, offsets);
+    src_w = ff->crop.w;
+    src_h = ff->crop.h;
+  }
+
+  for (i = 0; i < 4; ++i) {
+    src[i] = ff->pFrame->data[i] ? ff->pFrame->data[i] + offsets[i] : NULL;
+    stride[i] = ff->pFrame->linesize[i];
+  }
+
+  if (ff->render_fmt == AV_PIX_FMT_GRAY8 && ff_luma_is_gray8(src_fmt)) {
+    /* grayscale output: only use the luma plane, skip chroma conversion */
+    const int full_range = ff->pCodecCtx->color_range == AVCOL_RANGE_JPEG
+      || src_fmt == AV_PIX_FMT_YUVJ420P || src_fmt == AV_PIX_FMT_YUVJ422P
+      || src_fmt == AV_PIX_FMT_YUVJ444P || src_fmt == AV_PIX_FMT_YUVJ440P;
+    for (i = 1; i < 4; ++i) {
+      src[i] = NULL;
+      stride[i] = 0;
+    }
+    src_fmt = AV_PIX_FMT_GRAY8;
+    k.expand = !full_range; // expand video-range luma
+  } else if (src_w == ff->out_width && src_h == ff->out_height
+      && (int) src_fmt == ff->render_fmt && ff->pFrame->format == src_fmt) {
+    /* native geometry and pixel-format: copy the planes, no conversion */
+    av_image_copy(ff->pFrameFMT->data, ff->pFrameFMT->linesize, src, stride, src_fmt, src_w, src_h);
+    return;
+  }
+
+  k.src_fmt = src_fmt;
+  k.src_w = src_w;
+  k.src_h = src_h;
+  k.dst_fmt = ff->render_fmt;
+  k.dst_w = ff->out_width;
+  k.dst_h = ff->out_height;
+  k.flags = ff_sws_flags(ff, src_w, src_h);
+  if ((sws = swspool_get(&k, &sh))) {
+    sws_scale(sws, src, stride, 0, src_h, ff->pFrameFMT->data, ff->pFrameFMT->linesize);
+    swspool_release(sh);
+  }
+}
+
 /**
  * seeks to frame and decodes and scales video frame
  *
@@ -715,6 +1995,9 @@ static int my_seek_frame (ffst *ff, AVPacket *packet, int64_t framenumber) {
  * @arg xoff unused - soon: x-offset of this frame to target buffer
  * @arg xw unused -  really unused
  * @arg ys unused -  soon: y-stride (aka width of container)
+ *
+ * if a source region is set (see ff_set_crop()) only that part of
+ * the decoded picture is converted and scaled.
  */
 int ff_render(void *ptr, unsigned long frame,
     uint8_t* buf, int w, int h, int xoff, int xw, int ys) {
@@ -724,9 +2007,18 @@ int ff_render(void *ptr, unsigned long frame,
     ff_init_moviebuffer(ff);
   }
 
+  if (ff->pFrameFMT && ff->pFormatCtx) {
+    ff_thread_policy(ff, frame);
+    ff_quality_policy(ff);
+  }
+
+  if (ff->pFrameFMT && ff->seq && !ff_seq_decode(ff, frame)) {
+    ff_scale_frame(ff);
+    return 0;
+  }
+
   if (ff->pFrameFMT && ff->pFormatCtx && !my_seek_frame(ff, &ff->packet, frame)) {
-    ff->pSWSCtx = sws_getCachedContext(ff->pSWSCtx, ff->pCodecCtx->width, ff->pCodecCtx->height, ff->pCodecCtx->pix_fmt, ff->out_width, ff->out_height, ff->render_fmt, SWS_BICUBIC, NULL, NULL, NULL);
-    sws_scale(ff->pSWSCtx, (const uint8_t * const*) ff->pFrame->data, ff->pFrame->linesize, 0, ff->pCodecCtx->height, ff->pFrameFMT->data, ff->pFrameFMT->linesize);
+    ff_scale_frame(ff);
     return 0;
   }
 
@@ -738,6 +2030,223 @@ int ff_render(void *ptr, unsigned long frame,
   return -1;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// compressed packet passthrough for intra-only streams
+
+/* standard huffman tables, ITU-T T.81 Annex K.3 */
+static const uint8_t dht_bits_dc_lum[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t dht_bits_dc_chr[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t dht_val_dc[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t dht_bits_ac_lum[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t dht_val_ac_lum[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t dht_bits_ac_chr[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t dht_val_ac_chr[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+#define DHT_SEGMENT_SIZE (4 + 4 * 17 + 2 * 12 + 2 * 162)
+
+static uint8_t *dht_table(uint8_t *p, int tc_th, const uint8_t *bits, const uint8_t *val, int n) {
+  *p++ = tc_th;
+  memcpy(p, bits, 16);
+  memcpy(p + 16, val, n);
+  return p + 16 + n;
+}
+
+#define RB16(P) (((P)[0] << 8) | (P)[1])
+#define RB32(P) (((uint32_t)(P)[0] << 24) | ((P)[1] << 16) | ((P)[2] << 8) | (P)[3])
+
+/* validate a JPEG packet and make it a stand-alone JFIF image:
+ * AVI1 MJPEG (motion JPEG in AVI/MOV) commonly omits the huffman
+ * tables, the standard tables are inserted in front of the scan.
+ * Packets that don't match the stream geometry (e.g. one field
+ * of interlaced MJPEG) are rejected. */
+static int mjpeg_fixup(const uint8_t *d, size_t size, int w, int h, uint8_t **out, size_t *len) {
+  size_t pos = 2;
+  size_t sos = 0;
+  int have_dht = 0;
+  int sof_w = 0, sof_h = 0;
+
+  if (size < 4 || d[0] != 0xff || d[1] != 0xd8) return -1;
+
+  while (pos + 4 <= size) {
+    int marker;
+    if (d[pos] != 0xff) return -1;
+    while (pos + 4 <= size && d[pos + 1] == 0xff) ++pos; // fill bytes
+    marker = d[pos + 1];
+    if (marker == 0xda) { sos = pos; break; }
+    if (marker == 0xc4) have_dht = 1;
+    if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc && pos + 9 <= size) {
+      sof_h = RB16(&d[pos + 5]);
+      sof_w = RB16(&d[pos + 7]);
+    }
+    pos += 2 + RB16(&d[pos + 2]);
+  }
+
+  if (sos == 0 || sof_w != w || sof_h != h) return -1;
+
+  if (have_dht) {
+    *out = malloc(size);
+    memcpy(*out, d, size);
+    *len = size;
+  } else {
+    uint8_t *p = *out = malloc(size + DHT_SEGMENT_SIZE);
+    memcpy(p, d, sos);
+    p += sos;
+    *p++ = 0xff; *p++ = 0xc4;
+    *p++ = (DHT_SEGMENT_SIZE - 2) >> 8; *p++ = (DHT_SEGMENT_SIZE - 2) & 0xff;
+    p = dht_table(p, 0x00, dht_bits_dc_lum, dht_val_dc, 12);
+    p = dht_table(p, 0x10, dht_bits_ac_lum, dht_val_ac_lum, 162);
+    p = dht_table(p, 0x01, dht_bits_dc_chr, dht_val_dc, 12);
+    p = dht_table(p, 0x11, dht_bits_ac_chr, dht_val_ac_chr, 162);
+    memcpy(p, d + sos, size - sos);
+    *len = size + DHT_SEGMENT_SIZE;
+  }
+  return 0;
+}
+
+static int png_check(const uint8_t *d, size_t size, int w, int h, uint8_t **out, size_t *len) {
+  static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  if (size < 33 || memcmp(d, sig, 8) || memcmp(d + 12, "IHDR", 4)) return -1;
+  if (RB32(d + 16) != (uint32_t) w || RB32(d + 20) != (uint32_t) h) return -1;
+  *out = malloc(size);
+  memcpy(*out, d, size);
+  *len = size;
+  return 0;
+}
+
+/* every frame is a complete image, at the displayed geometry */
+static int ff_packet_fmt(ffst *ff) {
+  if (!ff->pCodecCtx || ff->videoStream < 0) return VPKT_NONE;
+  if (ff->pCodecCtx->width != ff->movie_width || ff->pCodecCtx->height != ff->movie_height) return VPKT_NONE;
+  switch (ff->pCodecCtx->codec_id) {
+    case AV_CODEC_ID_MJPEG: return VPKT_JPEG;
+    case AV_CODEC_ID_PNG:   return VPKT_PNG;
+    default: break;
+  }
+  return VPKT_NONE;
+}
+
+int ff_get_packet(void *ptr, int64_t framenumber, uint8_t **out, size_t *len) {
+  ffst *ff = (ffst*) ptr;
+  AVPacket *packet = &ff->packet;
+  int64_t timestamp;
+  int bailout = 64;
+  int want_seek;
+  const int fmt = ff_packet_fmt(ff);
+
+  *out = NULL;
+  *len = 0;
+  if (fmt == VPKT_NONE || (!ff->pFormatCtx && !ff->seq)) return -1;
+
+  if (ff->seq) {
+    int rv;
+    if (ff_seq_read(ff, framenumber, packet)) {
+      return -1;
+    }
+    if (fmt == VPKT_JPEG) {
+      rv = mjpeg_fixup(packet->data, packet->size, ff->movie_width, ff->movie_height, out, len);
+    } else {
+      rv = png_check(packet->data, packet->size, ff->movie_width, ff->movie_height, out, len);
+    }
+    av_packet_unref (packet);
+    return rv;
+  }
+
+  if (ff->want_ignstart)
+    framenumber += (int64_t) rint(ff->framerate * ((double)ff->pFormatCtx->start_time / (double)AV_TIME_BASE));
+
+  timestamp = ff_frame_pts(ff, framenumber, NULL, NULL);
+  if (timestamp == AV_NOPTS_VALUE) {
+    return -1;
+  }
+
+  /* the file position no longer matches the decoder state */
+  ff->avprev = -1;
+
+  /* sequential access does not need to seek */
+  want_seek = timestamp != ff->pkt_next;
+  ff->pkt_next = AV_NOPTS_VALUE;
+
+  if (want_seek) {
+    if (av_seek_frame(ff->pFormatCtx, ff->videoStream, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+      return -1;
+    }
+  }
+
+  while (--bailout > 0) {
+    int64_t pts;
+    int rv;
+    if (av_read_frame (ff->pFormatCtx, packet) < 0) {
+      av_packet_unref (packet);
+      return -1;
+    }
+    if (packet->stream_index != ff->videoStream) {
+      av_packet_unref (packet);
+      continue;
+    }
+    pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (pts == AV_NOPTS_VALUE) {
+      av_packet_unref (packet);
+      return -1;
+    }
+
+    const int64_t prefuzz = ff->tpf > 10 ? 1 : 0;
+    if (pts + prefuzz < timestamp) {
+      av_packet_unref (packet);
+      continue;
+    }
+    if (pts - timestamp >= ff->tpf) {
+      av_packet_unref (packet);
+      if (!want_seek) {
+        /* not where we expected to be */
+        want_seek = 1;
+        if (av_seek_frame(ff->pFormatCtx, ff->videoStream, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+          return -1;
+        }
+        continue;
+      }
+      return -1;
+    }
+
+    if (fmt == VPKT_JPEG) {
+      rv = mjpeg_fixup(packet->data, packet->size, ff->movie_width, ff->movie_height, out, len);
+    } else {
+      rv = png_check(packet->data, packet->size, ff->movie_width, ff->movie_height, out, len);
+    }
+    av_packet_unref (packet);
+    if (!rv) {
+      ff->pkt_next = ff_frame_pts(ff, framenumber + 1, NULL, NULL);
+    }
+    return rv;
+  }
+  return -1;
+}
+
 void ff_get_info(void *ptr, VInfo *i) {
   ffst *ff = (ffst*) ptr;
   if (!i) return;
@@ -753,17 +2262,37 @@ void ff_get_info(void *ptr, VInfo *i) {
   else
     i->buffersize = 0;
   i->frames = ff->frames;
+  i->packet_fmt = ff_packet_fmt(ff);
+  i->indexed = ff_indexed(ptr);
 
   memcpy(&i->framerate, &ff->tc, sizeof(TimecodeRate));
 }
 
-void ff_get_info_canonical(void *ptr, VInfo *i, int w, int h) {
+/**
+ * read file information without keeping a decoder around.
+ *
+ * @arg file_name file to probe
+ * @arg i returned information
+ * @return 0 on success, -1 on error
+ */
+int ff_probe_info(const char *file_name, VInfo *i) {
+  void *ff = NULL;
+  int rv;
+  ff_create(&ff);
+  rv = ff_open_movie(ff, (char*) file_name, AV_PIX_FMT_RGB24);
+  if (!rv) ff_get_info(ff, i);
+  ff_destroy(&ff);
+  return rv;
+}
+
+void ff_get_info_canonical(void *ptr, VInfo *i, int w, int h, VCrop *crop) {
   ffst *ff = (ffst*) ptr;
   if (!i) return;
   ff_get_info(ptr, i);
+  ff_normalize_crop(ff, crop);
   i->out_width = w;
   i->out_height = h;
-  ff_caononicalize_size2(ptr, &i->out_width, &i->out_height);
+  ff_caononicalize_size2(ptr, &i->out_width, &i->out_height, crop);
   i->buffersize = ff_picture_bytesize(ff->render_fmt, i->out_width, i->out_height);
 }
 
@@ -772,9 +2301,15 @@ void ff_create(void **ff) {
   (*((ffst**)ff))->render_fmt = AV_PIX_FMT_RGB24;
   (*((ffst**)ff))->want_ignstart = 0;
   (*((ffst**)ff))->want_genpts = 0;
+  (*((ffst**)ff))->threads = 1;
   (*((ffst**)ff))->packet.data = NULL;
 }
 
+void ff_set_threads(void *ptr, int threads) {
+  ffst *ff = (ffst*) ptr;
+  ff->threads = threads < 1 ? 1 : (threads > FF_MAX_THREADS ? FF_MAX_THREADS : threads);
+}
+
 void ff_destroy(void **ff) {
   ff_close_movie(*((ffst**)ff));
   free(*((ffst**)ff));
@@ -803,6 +2338,31 @@ uint8_t *ff_get_bufferptr(void *ptr) {
   return ff->buffer;
 }
 
+void ff_set_scaler(void *ptr, int scaler) {
+  ffst *ff = (ffst*) ptr;
+  ff->scaler = scaler;
+}
+
+void ff_set_quality(void *ptr, int draft) {
+  ffst *ff = (ffst*) ptr;
+  ff->draft = draft;
+}
+
+void ff_set_decode_through(void *ptr, VDecodeThrough *dt) {
+  ffst *ff = (ffst*) ptr;
+  ff->dt = dt;
+}
+
+void ff_set_crop(void *ptr, const VCrop *crop) {
+  ffst *ff = (ffst*) ptr;
+  if (VCROP_ACTIVE(crop)) {
+    memcpy(&ff->crop, crop, sizeof(VCrop));
+  } else {
+    memset(&ff->crop, 0, sizeof(VCrop));
+  }
+  ff_normalize_crop(ff, &ff->crop);
+}
+
 void ff_resize(void *ptr, int w, int h, uint8_t *buf, VInfo *i) {
   ffst *ff = (ffst*) ptr;
   ff->out_width = w;
@@ -836,6 +2396,14 @@ const char * ff_fmt_to_text(int fmt) {
       return "UYVY422";
     case AV_PIX_FMT_YUV440P:
       return "YUV440P";
+    case AV_PIX_FMT_YUV422P:
+      return "YUV422P";
+    case AV_PIX_FMT_NV12:
+      return "NV12";
+    case AV_PIX_FMT_GRAY8:
+      return "GRAY8";
+    case AV_PIX_FMT_RGB565:
+      return "RGB565";
     default:
       return "?";
   }
@@ -20,16 +20,22 @@
 #define _FFDECODER_H
 
 #include <stdint.h>
+#include "frame_index.h"
 
 void ff_create(void **ff);
 void ff_destroy(void **ff);
 void ff_get_info(void *ptr, VInfo *i);
-void ff_get_info_canonical(void *ptr, VInfo *i, int w, int h);
+void ff_get_info_canonical(void *ptr, VInfo *i, int w, int h, VCrop *crop);
+int ff_probe_info(const char *file_name, VInfo *i);
 
 int ff_render(void *ptr, unsigned long frame,
     uint8_t* buf, int w, int h, int xoff, int xw, int ys);
 
+void ff_set_threads(void *ptr, int threads);
 int ff_open_movie(void *ptr, char *file_name, int render_fmt);
+int ff_get_index(void *ptr, FrameIndex **fi);
+int ff_indexed(void *ptr);
+int ff_get_packet(void *ptr, int64_t frame, uint8_t **out, size_t *len);
 int ff_close_movie(void *ptr);
 
 void ff_initialize (void);
@@ -37,6 +43,10 @@ void ff_cleanup (void);
 
 uint8_t *ff_get_bufferptr(void *ptr);
 uint8_t *ff_set_bufferptr(void *ptr, uint8_t *buf);
+void ff_set_crop(void *ptr, const VCrop *crop);
+void ff_set_decode_through(void *ptr, VDecodeThrough *dt);
+void ff_set_quality(void *ptr, int draft);
+void ff_set_scaler(void *ptr, int scaler);
 void ff_resize(void *ptr, int w, int h, uint8_t *buf, VInfo *i);
 
 int ff_picture_bytesize(int render_fmt, int w, int h);
@@ -26,6 +26,7 @@
 #include "decoder_ctrl.h"
 #include "dlog.h"
 #include "frame_cache.h"
+#include "cache_pin.h"
 #include "ffcompat.h"
 #include "ffdecoder.h"
 
@@ -42,12 +43,15 @@
 #define CLF_INUSE 2    //< currently being served
 #define CLF_VALID 4    //< cacheline is valid (has decoded frame)
 #define CLF_RELEASE 8  //<invalidate this cacheline once it's no longer in use
+#define CLF_PINNED 16  //< exempt from eviction, accounted in the PinSet
 
 typedef struct videocacheline {
   int id;         // file ID from VidMap
   short w;
   short h;
   int fmt;        // pixel format
+  int quality;    // VDEC_QUALITY() of the decoder flags
+  VCrop crop;     // source region
   int64_t frame;
   int flags;
   int refcnt;     // CLF_INUSE reference count
@@ -58,42 +62,96 @@ typedef struct videocacheline {
   UT_hash_handle hh;
 } videocacheline;
 
-/* id +w +h + fmt + frame */
+/* id +w +h + fmt + quality + crop + frame */
 #define CLKEYLEN (offsetof(videocacheline, flags) - offsetof(videocacheline, id))
 
+/* least recently used cacheline that can be evicted
+ * NB. the cache needs to be locked when calling this
+ */
+static videocacheline *lrucl(videocacheline *cache) {
+  time_t lru = time(NULL) + 1;
+  videocacheline *cl, *tmp, *clru = NULL;
+  HASH_ITER(hh, cache, cl, tmp) {
+    if (cl->flags == 0) return cl;
+    if (!(cl->flags&(CLF_DECODING|CLF_INUSE|CLF_PINNED)) && (cl->lru < lru))  {
+      lru = cl->lru;
+      clru = cl;
+    }
+  }
+  return clru;
+}
+
+static int cmp_lru(const void *a, const void *b) {
+  const videocacheline *ca = *(videocacheline* const*) a;
+  const videocacheline *cb = *(videocacheline* const*) b;
+  if (ca->lru == cb->lru) return 0;
+  return ca->lru < cb->lru ? -1 : 1;
+}
+
+/* evict least recently used cachelines until at most cfg_cachesize
+ * (unpinned) lines remain. Lines that are in use are retained.
+ * NB. the cache needs to be write-locked when calling this
+ */
+static void trimcache(videocacheline **cache, int cfg_cachesize, PinSet *pins) {
+  videocacheline *cl, *tmp, **lru;
+  int i, n = 0;
+  int excess = (int) HASH_COUNT(*cache) - pins->lines - cfg_cachesize;
+  if (excess <= 0) return;
+
+  lru = malloc(HASH_COUNT(*cache) * sizeof(videocacheline*));
+  HASH_ITER(hh, *cache, cl, tmp) {
+    if (!(cl->flags&(CLF_DECODING|CLF_INUSE|CLF_PINNED))) {
+      lru[n++] = cl;
+    }
+  }
+  qsort(lru, n, sizeof(videocacheline*), cmp_lru);
+  for (i = 0; i < n && i < excess; ++i) {
+    HASH_DEL(*cache, lru[i]);
+    assert(lru[i]->refcnt == 0);
+    av_free(lru[i]->b);
+    free(lru[i]);
+  }
+  free(lru);
+  if (i < excess) {
+    dlog(DLOG_INFO, "CACHE: %d cache-lines in use, they will be evicted later.\n", excess - i);
+  }
+}
+
 /* get a new cacheline or replace and existing one
  * NB. the cache needs to be write-locked when calling this
  * and realloccl_buf() must be called after this
  */
-static videocacheline *getcl(videocacheline **cache, int cfg_cachesize,
-    unsigned short id, short w, short h, int fmt, int64_t frame) {
+static videocacheline *getcl(videocacheline **cache, int cfg_cachesize, PinSet *pins,
+    unsigned short id, short w, short h, int fmt, int quality, const VCrop *crop, int64_t frame) {
   videocacheline *cl = NULL;
 
-  if (HASH_COUNT(*cache) >= cfg_cachesize) {
-    time_t lru = time(NULL) + 1;
-    videocacheline *tmp, *clru = NULL;
-    HASH_ITER(hh, *cache, cl, tmp) {
-      if (cl->flags == 0) return cl;
-      if (!(cl->flags&(CLF_DECODING|CLF_INUSE)) && (cl->lru < lru))  {
-        lru = cl->lru;
-        clru = cl;
-      }
+  /* pinned lines do not count against the cache-size.
+   * If the cache was shrunk while lines were in use, evict those now. */
+  while ((int) HASH_COUNT(*cache) - pins->lines >= cfg_cachesize) {
+    videocacheline *clru = lrucl(*cache);
+    if (!clru) {
+      break;
     }
-    if (clru) {
-      HASH_DEL(*cache, clru);
-      assert(clru->refcnt == 0);
-      cl = clru;
-      if (cl->b && cl->w == w && cl->h == h && cl->fmt == fmt) {
-        cl->flags = 0;
-        memset(&cl->hh, 0, sizeof(UT_hash_handle));
-      } else {
-        av_free(cl->b);
-        memset(cl, 0, sizeof(videocacheline));
-      }
+    HASH_DEL(*cache, clru);
+    assert(clru->refcnt == 0);
+    if (cl) {
+      av_free(cl->b);
+      free(cl);
+    }
+    cl = clru;
+  }
+
+  if (cl) {
+    if (cl->b && cl->w == w && cl->h == h && cl->fmt == fmt) {
+      cl->flags = 0;
+      memset(&cl->hh, 0, sizeof(UT_hash_handle));
     } else {
-      dlog(DLOG_WARNING, "CACHE: cache full - all cache-lines in use.\n");
-      return NULL;
+      av_free(cl->b);
+      memset(cl, 0, sizeof(videocacheline));
     }
+  } else if ((int) HASH_COUNT(*cache) - pins->lines >= cfg_cachesize) {
+    dlog(DLOG_WARNING, "CACHE: cache full - all cache-lines in use.\n");
+    return NULL;
   }
 
   if (!cl)
@@ -103,35 +161,72 @@ static videocacheline *getcl(videocacheline **cache, int cfg_cachesize,
   cl->w = w;
   cl->h = h;
   cl->fmt = fmt;
+  cl->quality = quality;
+  if (VCROP_ACTIVE(crop)) {
+    memcpy(&cl->crop, crop, sizeof(VCrop));
+  } else {
+    memset(&cl->crop, 0, sizeof(VCrop));
+  }
   cl->frame = frame;
   cl->lru = 0;
+  if (pinset_match(pins, id, frame, w, h, fmt)
+      && pinset_claim(pins, ff_picture_bytesize(fmt, w, h))) {
+    cl->flags |= CLF_PINNED;
+  }
   HASH_ADD(hh, *cache, id, CLKEYLEN, cl);
   return cl;
 }
 
+/* look up a cacheline, NB. the cache needs to be locked when calling this */
+static videocacheline *findcl(videocacheline *cache,
+    int64_t frame, short w, short h, int fmt, int quality, const VCrop *crop, unsigned short id) {
+  videocacheline *rv;
+  videocacheline cmp;
+  memset(&cmp, 0, sizeof(videocacheline)); // also clear padding, the key is hashed as-is
+  cmp.id = id;
+  cmp.w = w;
+  cmp.h = h;
+  cmp.fmt = fmt;
+  cmp.quality = quality;
+  if (VCROP_ACTIVE(crop)) memcpy(&cmp.crop, crop, sizeof(VCrop));
+  cmp.frame = frame;
+  HASH_FIND(hh, cache, &cmp, CLKEYLEN, rv);
+  return rv;
+}
+
 /* check if requested data exists in cache */
 static videocacheline *testclwh(videocacheline *cache,
     pthread_rwlock_t *lock,
-    int64_t frame, short w, short h, int fmt, unsigned short id) {
+    int64_t frame, short w, short h, int fmt, int quality, const VCrop *crop, unsigned short id) {
   videocacheline *rv;
-  const videocacheline cmp = {id, w, h, fmt, frame, 0, 0, 0, NULL };
   pthread_rwlock_rdlock(lock);
-  HASH_FIND(hh, cache, &cmp, CLKEYLEN, rv);
+  rv = findcl(cache, frame, w, h, fmt, quality, crop, id);
   pthread_rwlock_unlock(lock);
   return rv;
 }
 
+/* unpin a cacheline, NB. the cache needs to be write-locked */
+static void unpincl(PinSet *pins, videocacheline *cl) {
+  if (!(cl->flags & CLF_PINNED)) return;
+  cl->flags &= ~CLF_PINNED;
+  pinset_release(pins, ff_picture_bytesize(cl->fmt, cl->w, cl->h));
+}
+
 /* clear cache
  * if f==1 wait for used cachelines to become unused
  * if f==0 the cache is flushed objects in use are retained
  * time a cacheline is needed
+ * if keep_pinned is set, pinned cachelines are retained
  */
-static void clearcache(videocacheline **cache, pthread_rwlock_t *cachelock, int f, int id) {
+static void clearcache(videocacheline **cache, pthread_rwlock_t *cachelock, PinSet *pins, int f, int id, int keep_pinned) {
   videocacheline *tmp, *cl = NULL;
   HASH_ITER(hh, *cache, cl, tmp) {
     if (id >= 0 && cl->id != id) {
       continue;
     }
+    if (keep_pinned && (cl->flags & CLF_PINNED)) {
+      continue;
+    }
     if (f) {
       if (cl->flags & (CLF_DECODING|CLF_INUSE)) {
         dlog(DLOG_WARNING, "CACHE: waiting for cacheline to be unlocked.\n");
@@ -147,6 +242,7 @@ static void clearcache(videocacheline **cache, pthread_rwlock_t *cachelock, int
     }
     HASH_DEL(*cache, cl);
     assert(cl->refcnt == 0);
+    unpincl(pins, cl);
     av_free(cl->b);
     free(cl);
   }
@@ -170,27 +266,138 @@ typedef struct {
   pthread_rwlock_t lock;
   int cache_hits;
   int cache_miss;
+  PinSet pins;
+  int decode_through; ///< max. intermediate frames to cache per decode, 0: off
+  size_t reverse_budget; ///< max. bytes cached per decode when stepping backwards, 0: off
+  int cache_through;  ///< number of frames cached on the way
 } xjcd;
 
+/* state of a decode-through, frames between the keyframe and the
+ * requested frame are cached using the geometry of the request */
+typedef struct {
+  xjcd *cc;
+  unsigned short vid;
+  short w, h;
+  int fmt;
+  int quality;
+  const VCrop *crop;
+  int64_t frame;      ///< requested frame
+  time_t since;       ///< time of the request
+  const VDecodeThrough *dt;
+  videocacheline *cl; ///< line being filled
+} FcThrough;
+
+/* when stepping backwards, frames after the requested one have been
+ * served already. Evict the one furthest away to make room for the
+ * preceding frames which are still needed.
+ * NB. the cache needs to be write-locked when calling this
+ * @return 0 if a line was freed
+ */
+static int fc_evict_passed(xjcd *cc, const FcThrough *ft) {
+  videocacheline *cl, *tmp, *passed = NULL;
+  VCrop crop;
+  memset(&crop, 0, sizeof(VCrop));
+  if (VCROP_ACTIVE(ft->crop)) memcpy(&crop, ft->crop, sizeof(VCrop));
+  HASH_ITER(hh, cc->vcache, cl, tmp) {
+    if (cl->id != ft->vid || cl->w != ft->w || cl->h != ft->h || cl->fmt != ft->fmt || cl->quality != ft->quality) continue;
+    if (memcmp(&cl->crop, &crop, sizeof(VCrop))) continue;
+    if (cl->frame <= ft->frame || (cl->flags&(CLF_DECODING|CLF_INUSE|CLF_PINNED))) continue;
+    if (!passed || cl->frame > passed->frame) passed = cl;
+  }
+  if (!passed) return -1;
+  HASH_DEL(cc->vcache, passed);
+  assert(passed->refcnt == 0);
+  av_free(passed->b);
+  free(passed);
+  return 0;
+}
+
+/* check if a cacheline can be added for an intermediate frame
+ * NB. the cache needs to be write-locked when calling this */
+static int fc_through_room(xjcd *cc, const FcThrough *ft) {
+  videocacheline *clru;
+  if ((int) HASH_COUNT(cc->vcache) - cc->pins.lines < cc->cfg_cachesize) return 1;
+  /* otherwise only use free space, never evict for speculative frames */
+  if (!ft->dt->reverse) return 0;
+  if (!fc_evict_passed(cc, ft)) return 1;
+  /* evict unrelated lines, but not those added for this request */
+  clru = lrucl(cc->vcache);
+  return clru && clru->lru < ft->since;
+}
+
+static uint8_t *fc_through_get(void *arg, int64_t frame) {
+  FcThrough *ft = (FcThrough*) arg;
+  xjcd *cc = ft->cc;
+  videocacheline *cl = NULL;
+  if (frame >= ft->frame) {
+    return NULL;
+  }
+  pthread_rwlock_wrlock(&cc->lock);
+  if (!findcl(cc->vcache, frame, ft->w, ft->h, ft->fmt, ft->quality, ft->crop, ft->vid)
+      && fc_through_room(cc, ft)) {
+    cl = getcl(&cc->vcache, cc->cfg_cachesize, &cc->pins, ft->vid, ft->w, ft->h, ft->fmt, ft->quality, ft->crop, frame);
+  }
+  if (cl) {
+    cl->flags |= CLF_DECODING;
+  }
+  pthread_rwlock_unlock(&cc->lock);
+  if (!cl) {
+    return NULL;
+  }
+  realloccl_buf(cl, ft->w, ft->h, ft->fmt);
+  ft->cl = cl;
+  return cl->b;
+}
+
+static void fc_through_done(void *arg, int64_t frame, uint8_t *buf) {
+  FcThrough *ft = (FcThrough*) arg;
+  xjcd *cc = ft->cc;
+  videocacheline *cl = ft->cl;
+  assert(cl && cl->b == buf && cl->frame == frame);
+  cl->lru = time(NULL);
+  pthread_rwlock_wrlock(&cc->lock);
+  cl->flags |= CLF_VALID;
+  cl->flags &= ~CLF_DECODING;
+  cc->cache_through++;
+  pthread_rwlock_unlock(&cc->lock);
+  ft->cl = NULL;
+}
+
+/* number of frames that may be cached when stepping backwards */
+static int fc_reverse_frames(xjcd *cc, int w, int h, int fmt) {
+  size_t fs = ff_picture_bytesize(fmt, w, h);
+  size_t n;
+  if (cc->reverse_budget == 0 || fs == 0) return 0;
+  n = cc->reverse_budget / fs;
+  /* leave room for other requests */
+  if (n > (size_t) cc->cfg_cachesize / 2) n = cc->cfg_cachesize / 2;
+  return n;
+}
+
 static void fc_initialize_cache (xjcd *cc) {
   assert(!cc->vcache);
   cc->vcache = NULL;
   cc->cache_hits = 0;
   cc->cache_miss = 0;
+  cc->cache_through = 0;
+  memset(&cc->pins, 0, sizeof(PinSet));
+  cc->pins.budget = PIN_DEFAULT_BUDGET;
   pthread_rwlock_init(&cc->lock, NULL);
 }
 
 static void fc_flush_cache (xjcd *cc) {
   pthread_rwlock_wrlock(&cc->lock);
-  clearcache(&cc->vcache, &cc->lock, 1, -1);
+  clearcache(&cc->vcache, &cc->lock, &cc->pins, 1, -1, 0);
   cc->cache_hits = 0;
   cc->cache_miss = 0;
+  cc->cache_through = 0;
   pthread_rwlock_unlock(&cc->lock);
 }
 
-static videocacheline *fc_readcl(xjcd *cc, void *dc, int64_t frame, short w, short h, int fmt, unsigned short vid, int *err) {
+static videocacheline *fc_readcl(xjcd *cc, void *dc, int64_t frame, short w, short h, int fmt, const VCrop *crop, int flags, unsigned short vid, int *err) {
   /* check if the requested frame is cached */
-  videocacheline *rv = testclwh(cc->vcache, &cc->lock, frame, w, h, fmt, vid);
+  const int quality = VDEC_QUALITY(flags);
+  videocacheline *rv = testclwh(cc->vcache, &cc->lock, frame, w, h, fmt, quality, crop, vid);
   int ds;
   if (err) *err = 0;
   if (rv) {
@@ -213,7 +420,7 @@ static videocacheline *fc_readcl(xjcd *cc, void *dc, int64_t frame, short w, sho
   int timeout = 250; /* 1 second to get a buffer */
   do {
     pthread_rwlock_wrlock(&cc->lock);
-    rv = getcl(&cc->vcache, cc->cfg_cachesize, vid, w, h, fmt, frame);
+    rv = getcl(&cc->vcache, cc->cfg_cachesize, &cc->pins, vid, w, h, fmt, quality, crop, frame);
     if (rv) {
       rv->flags |= CLF_DECODING;
     }
@@ -234,7 +441,10 @@ static videocacheline *fc_readcl(xjcd *cc, void *dc, int64_t frame, short w, sho
   realloccl_buf(rv, w, h, fmt);
 
   /* fill cacheline with data - decode video */
-  if ((ds=dctrl_decode(dc, vid, frame, rv->b, w, h, fmt))) {
+  VDecodeThrough dt = { fc_through_get, fc_through_done, NULL, cc->decode_through, fc_reverse_frames(cc, w, h, fmt), 0 };
+  FcThrough ft = { cc, vid, w, h, fmt, quality, crop, frame, time(NULL), &dt, NULL };
+  dt.arg = &ft;
+  if ((ds=dctrl_decode(dc, vid, frame, rv->b, w, h, fmt, crop, flags, (dt.budget > 0 || dt.reverse_budget > 0) ? &dt : NULL))) {
     dlog(DLOG_WARNING, "CACHE: decode failed (%d).\n",ds);
     /* ds == -1 -> decode error; black frame will be rendered
      * ds == 503 -> no decoder avail.
@@ -246,6 +456,7 @@ static videocacheline *fc_readcl(xjcd *cc, void *dc, int64_t frame, short w, sho
     /* we don't cache decode-errors */
     rv->flags &= ~CLF_VALID;
     rv->flags &= ~CLF_DECODING;
+    unpincl(&cc->pins, rv);
     if (ds > 0) {
       /* no decoder available */
       rv = NULL;
@@ -274,9 +485,13 @@ static videocacheline *fc_readcl(xjcd *cc, void *dc, int64_t frame, short w, sho
 void vcache_clear (void *p, int id) {
   xjcd *cc = (xjcd*) p;
   pthread_rwlock_wrlock(&cc->lock);
-  clearcache(&cc->vcache, &cc->lock, 0, id);
+  /* a single ID is cleared when it becomes invalid, pinned lines
+   * of it are stale as well. */
+  clearcache(&cc->vcache, &cc->lock, &cc->pins, 0, id, id < 0);
+  if (id >= 0) pinset_unbind(&cc->pins, id);
   cc->cache_hits = 0;
   cc->cache_miss = 0;
+  cc->cache_through = 0;
   pthread_rwlock_unlock(&cc->lock);
 }
 
@@ -287,23 +502,36 @@ void vcache_create(void **p) {
 }
 
 void vcache_resize(void **p, int size) {
-  if (size < (*((xjcd**)p))->cfg_cachesize)
-    fc_flush_cache((*((xjcd**)p)));
-  if (size > 0)
-    (*((xjcd**)p))->cfg_cachesize = size;
+  xjcd *cc = *(xjcd**) p;
+  if (size < 1) return;
+  pthread_rwlock_wrlock(&cc->lock);
+  cc->cfg_cachesize = size;
+  trimcache(&cc->vcache, size, &cc->pins);
+  pthread_rwlock_unlock(&cc->lock);
+}
+
+void vcache_decode_through(void *p, int frames) {
+  xjcd *cc = (xjcd*) p;
+  cc->decode_through = frames > 0 ? frames : 0;
+}
+
+void vcache_reverse_budget(void *p, size_t bytes) {
+  xjcd *cc = (xjcd*) p;
+  cc->reverse_budget = bytes;
 }
 
 void vcache_destroy(void **p) {
   xjcd *cc = *(xjcd**) p;
   fc_flush_cache(cc);
+  pinset_free(&cc->pins);
   pthread_rwlock_destroy(&cc->lock);
   free(cc->vcache);
   free(cc);
   *p = NULL;
 }
 
-uint8_t *vcache_get_buffer(void *p, void *dc, unsigned short id, int64_t frame, short w, short h, int fmt, void **cptr, int *err) {
-  videocacheline *cl = fc_readcl((xjcd*)p, dc, frame, w, h, fmt, id, err);
+uint8_t *vcache_get_buffer(void *p, void *dc, unsigned short id, int64_t frame, short w, short h, int fmt, const VCrop *crop, int flags, void **cptr, int *err) {
+  videocacheline *cl = fc_readcl((xjcd*)p, dc, frame, w, h, fmt, crop, flags, id, err);
   if (!cl) {
     if (cptr) *cptr = NULL;
     return NULL;
@@ -321,7 +549,9 @@ void vcache_release_buffer(void *p, void *cptr) {
     assert(cl->refcnt >= 0);
     cl->flags &= ~CLF_INUSE;
 
-    if (cl->flags & CLF_RELEASE) {
+    if ((cl->flags & (CLF_RELEASE|CLF_PINNED)) == (CLF_RELEASE|CLF_PINNED)) {
+      cl->flags &= ~CLF_RELEASE;
+    } else if (cl->flags & CLF_RELEASE) {
       HASH_DEL(cc->vcache, cl);
       assert(cl->refcnt == 0);
       av_free(cl->b);
@@ -341,6 +571,59 @@ void vcache_invalidate_buffer(void *p, void *cptr) {
   pthread_rwlock_unlock(&cc->lock);
 }
 
+int vcache_pin(void *p, const char *fn, unsigned short id, int64_t start, int64_t end, short w, short h, int fmt) {
+  xjcd *cc = (xjcd*) p;
+  videocacheline *cl, *tmp;
+  CachePin pin = {(char*) fn, id, start, end, w, h, fmt};
+  int n = 0;
+  pthread_rwlock_wrlock(&cc->lock);
+  pinset_add(&cc->pins, &pin);
+  /* pin cached frames that match */
+  HASH_ITER(hh, cc->vcache, cl, tmp) {
+    if (!(cl->flags & CLF_VALID) || (cl->flags & CLF_PINNED)) continue;
+    if (!pinset_match(&cc->pins, cl->id, cl->frame, cl->w, cl->h, cl->fmt)) continue;
+    if (!pinset_claim(&cc->pins, ff_picture_bytesize(cl->fmt, cl->w, cl->h))) {
+      dlog(DLOG_WARNING, "CACHE: pin budget exceeded.\n");
+      break;
+    }
+    cl->flags |= CLF_PINNED;
+    ++n;
+  }
+  pthread_rwlock_unlock(&cc->lock);
+  return n;
+}
+
+int vcache_unpin(void *p, const char *fn, int64_t start, int64_t end, short w, short h, int fmt) {
+  xjcd *cc = (xjcd*) p;
+  videocacheline *cl, *tmp;
+  CachePin pin = {(char*) fn, -1, start, end, w, h, fmt};
+  int n;
+  pthread_rwlock_wrlock(&cc->lock);
+  n = pinset_remove(&cc->pins, &pin);
+  /* pinned lines that are no longer covered become regular cache-lines */
+  HASH_ITER(hh, cc->vcache, cl, tmp) {
+    if (!(cl->flags & CLF_PINNED)) continue;
+    if (pinset_match(&cc->pins, cl->id, cl->frame, cl->w, cl->h, cl->fmt)) continue;
+    unpincl(&cc->pins, cl);
+  }
+  pthread_rwlock_unlock(&cc->lock);
+  return n;
+}
+
+void vcache_pin_bind(void *p, const char *fn, unsigned short id) {
+  xjcd *cc = (xjcd*) p;
+  pthread_rwlock_wrlock(&cc->lock);
+  pinset_bind(&cc->pins, fn, id);
+  pthread_rwlock_unlock(&cc->lock);
+}
+
+void vcache_pin_budget(void *p, size_t bytes) {
+  xjcd *cc = (xjcd*) p;
+  pthread_rwlock_wrlock(&cc->lock);
+  cc->pins.budget = bytes;
+  pthread_rwlock_unlock(&cc->lock);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // statistics
 
@@ -369,6 +652,10 @@ static char *flags2txt(int f) {
     rv = (char*) realloc(rv, (off+8) * sizeof(char));
     off += sprintf(rv+off, "to-free ");
   }
+  if (f&CLF_PINNED) {
+    rv = (char*) realloc(rv, (off+8) * sizeof(char));
+    off += sprintf(rv+off, "pinned ");
+  }
   return rv;
 }
 
@@ -381,21 +668,26 @@ void vcache_info_html(void *p, char **m, size_t *o, size_t *s, int tbl) {
   if (tbl&1) {
     rprintf("<h3>Raw Video Frame Cache:</h3>\n");
     rprintf("<p>max available: %i\n", ((xjcd*)p)->cfg_cachesize);
-    rprintf("cache-hits: %d, cache-misses: %d</p>\n", ((xjcd*)p)->cache_hits, ((xjcd*)p)->cache_miss);
+    rprintf("cache-hits: %d, cache-misses: %d, decoded-through: %d</p>\n", ((xjcd*)p)->cache_hits, ((xjcd*)p)->cache_miss, ((xjcd*)p)->cache_through);
     rprintf("<table style=\"text-align:center;width:100%%\">\n");
   } else {
     rprintf("<tr><td colspan=\"8\" class=\"left\"><h3>Raw Video Frame Cache:</h3></td></tr>\n");
     rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d\n", ((xjcd*)p)->cfg_cachesize);
-    rprintf(", cache-hits: %d, cache-misses: %d</td></tr>\n", ((xjcd*)p)->cache_hits, ((xjcd*)p)->cache_miss);
+    rprintf(", cache-hits: %d, cache-misses: %d, decoded-through: %d</td></tr>\n", ((xjcd*)p)->cache_hits, ((xjcd*)p)->cache_miss, ((xjcd*)p)->cache_through);
   }
+  pthread_rwlock_rdlock(&((xjcd*)p)->lock);
+  pinset_info_html(&((xjcd*)p)->pins, m, o, s, tbl);
   rprintf("<tr><th>#</th><th>file-id</th><th>Flags</th><th>Allocated Bytes</th><th>Geometry</th><th>Buffer</th><th>Frame#</th><th>LRU</th></tr>\n");
   /* walk comlete tree */
-  pthread_rwlock_rdlock(&((xjcd*)p)->lock);
   HASH_ITER(hh, ((xjcd*)p)->vcache, cptr, tmp) {
     char *tmp = flags2txt(cptr->flags);
+    char roi[64] = "";
+    if (VCROP_ACTIVE(&cptr->crop)) {
+      snprintf(roi, sizeof(roi), " (%dx%d+%d+%d)", cptr->crop.w, cptr->crop.h, cptr->crop.x, cptr->crop.y);
+    }
     rprintf(
-        "<tr><td>%d.</td><td>%d</td><td>%s</td><td>%d bytes</td><td>%dx%d</td><td>%s</td><td>%"PRIlld"</td><td>%"PRIlld"</td></tr>\n",
-        i, cptr->id, tmp, cptr->alloc_size, cptr->w, cptr->h,
+        "<tr><td>%d.</td><td>%d</td><td>%s</td><td>%d bytes</td><td>%dx%d%s</td><td>%s</td><td>%"PRIlld"</td><td>%"PRIlld"</td></tr>\n",
+        i, cptr->id, tmp, cptr->alloc_size, cptr->w, cptr->h, roi,
         (cptr->b ? ff_fmt_to_text(cptr->fmt) : "null"),
         (long long) cptr->frame, (long long) cptr->lru);
     free(tmp);
@@ -21,16 +21,40 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include "vinfo.h"
 
 void vcache_create(void **p);
 void vcache_destroy(void **p);
 void vcache_resize(void **p, int size);
 void vcache_clear (void *p, int id);
 
-uint8_t *vcache_get_buffer(void *p, void *dc, unsigned short id, int64_t frame, short w, short h, int fmt, void **cptr, int *err);
+uint8_t *vcache_get_buffer(void *p, void *dc, unsigned short id, int64_t frame, short w, short h, int fmt, const VCrop *crop, int flags, void **cptr, int *err);
 void vcache_release_buffer(void *p, void *cptr);
 void vcache_invalidate_buffer(void *p, void *cptr);
 
+/* pinned frames are exempt from eviction and count against a separate budget.
+ * Pins belong to the file \a fn, \a id is its current file-ID.
+ * end: last frame (-1: until the end), w, h: 0 any geometry, fmt: -1 any pix-fmt
+ * unpin: fn NULL matches any file.
+ */
+int vcache_pin(void *p, const char *fn, unsigned short id, int64_t start, int64_t end, short w, short h, int fmt);
+int vcache_unpin(void *p, const char *fn, int64_t start, int64_t end, short w, short h, int fmt);
+/* file \a fn was mapped to a new \a id, apply its pins to that ID */
+void vcache_pin_bind(void *p, const char *fn, unsigned short id);
+void vcache_pin_budget(void *p, size_t bytes);
+
+/* cache up to \a frames intermediate frames that are decoded on the way to
+ * a requested frame (after seeking to a keyframe), 0: disable.
+ * Only free cache-lines are used, nothing is evicted for them.
+ */
+void vcache_decode_through(void *p, int frames);
+
+/* when frames are requested backwards, cache the frames of the GOP that
+ * precede the requested one, up to \a bytes (and half the cache-size).
+ * Frames that were already served are evicted first. 0: disable.
+ */
+void vcache_reverse_budget(void *p, size_t bytes);
+
 void vcache_info_html(void *p, char **m, size_t *o, size_t *s, int tbl);
 
 #endif
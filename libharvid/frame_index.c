@@ -0,0 +1,458 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>     /* uint8_t */
+#include <inttypes.h>
+#include <stdlib.h>     /* calloc et al.*/
+#include <string.h>     /* memset */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "dlog.h"
+#include "frame_index.h"
+#include "image_seq.h"
+
+#include <time.h>
+#include <assert.h>
+#include <pthread.h>
+
+//#define HASH_EMIT_KEYS 3
+#define HASH_FUNCTION HASH_SFH
+#include "uthash.h"
+
+#define FIDX_CACHE_SIZE 64 ///< max number of cached file indices
+
+typedef struct {
+  FileKey key;
+  FrameIndex *fi;
+  UT_hash_handle hh;
+} FrameIndexLine;
+
+static FrameIndexLine *fidx_cache = NULL;
+static pthread_mutex_t fidx_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *fidx_store = NULL; ///< directory of the persistent store, NULL: disabled
+
+static void fi_free(FrameIndex *fi) {
+#ifndef _WIN32
+  if (fi->map) {
+    munmap(fi->map, fi->map_len);
+  } else
+#endif
+  free(fi->e);
+  free(fi);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// persistent store
+
+#define FIDX_MAGIC "HFI1"
+
+/** header of an index file, followed by n_frames FrameIndexEntry
+ * (native byte-order, the size is a multiple of 8 to keep entries aligned) */
+typedef struct {
+  char    magic[4];
+  int32_t entry_size;
+  int32_t tb_num;
+  int32_t tb_den;
+  int32_t fr_num;
+  int32_t fr_den;
+  int32_t source;
+  int32_t reserved;
+  FileKey key;
+  int64_t first_frame;
+  int64_t n_frames;
+  int64_t n_keyframes;
+} FrameIndexFileHeader;
+
+static char *fi_store_path(const FileKey *k) {
+  char *fn;
+  if (!fidx_store) return NULL;
+  fn = malloc(strlen(fidx_store) + 80);
+  sprintf(fn, "%s/%016"PRIx64"-%016"PRIx64"-%"PRIx64"-%"PRIx64".hfi",
+      fidx_store, k->dev, k->ino, (uint64_t)k->size, (uint64_t)k->mtime);
+  return fn;
+}
+
+/* map a previously stored index, the file must match the key exactly */
+static FrameIndex *fi_store_load(const FileKey *k) {
+#ifndef _WIN32
+  FrameIndexFileHeader *hdr;
+  FrameIndex *fi;
+  struct stat sb;
+  void *map;
+  int fd;
+  char *fn = fi_store_path(k);
+
+  if (!fn) return NULL;
+  fd = open(fn, O_RDONLY);
+  free(fn);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &sb) || sb.st_size < (off_t) sizeof(FrameIndexFileHeader)) {
+    close(fd);
+    return NULL;
+  }
+  map = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+
+  hdr = (FrameIndexFileHeader*) map;
+  if (memcmp(hdr->magic, FIDX_MAGIC, 4)
+      || hdr->entry_size != sizeof(FrameIndexEntry)
+      || memcmp(&hdr->key, k, sizeof(FileKey))
+      || hdr->n_frames < 0
+      || sb.st_size != (off_t) (sizeof(FrameIndexFileHeader) + hdr->n_frames * sizeof(FrameIndexEntry))) {
+    dlog(DLOG_WARNING, "FIDX: ignored invalid index file for inode %"PRIu64"\n", k->ino);
+    munmap(map, sb.st_size);
+    return NULL;
+  }
+
+  fi = (FrameIndex*) calloc(1, sizeof(FrameIndex));
+  memcpy(&fi->key, k, sizeof(FileKey));
+  fi->tb_num = hdr->tb_num;
+  fi->tb_den = hdr->tb_den;
+  fi->fr_num = hdr->fr_num;
+  fi->fr_den = hdr->fr_den;
+  fi->source = hdr->source;
+  fi->first_frame = hdr->first_frame;
+  fi->n_frames = hdr->n_frames;
+  fi->n_keyframes = hdr->n_keyframes;
+  fi->e = (FrameIndexEntry*) ((uint8_t*) map + sizeof(FrameIndexFileHeader));
+  fi->map = map;
+  fi->map_len = sb.st_size;
+  return fi;
+#else
+  return NULL;
+#endif
+}
+
+/* write an index to the store, the file is replaced atomically */
+static void fi_store_save(const FrameIndex *fi) {
+#ifndef _WIN32
+  FrameIndexFileHeader hdr;
+  char *fn, *tmp;
+  size_t len;
+  int fd, ok;
+
+  if (!(fn = fi_store_path(&fi->key))) return;
+  tmp = malloc(strlen(fidx_store) + 16);
+  sprintf(tmp, "%s/.hfi-XXXXXX", fidx_store);
+  if ((fd = mkstemp(tmp)) < 0) {
+    dlog(DLOG_WARNING, "FIDX: cannot write to index store '%s'\n", fidx_store);
+    free(tmp);
+    free(fn);
+    return;
+  }
+
+  memset(&hdr, 0, sizeof(FrameIndexFileHeader));
+  memcpy(hdr.magic, FIDX_MAGIC, 4);
+  hdr.entry_size = sizeof(FrameIndexEntry);
+  hdr.tb_num = fi->tb_num;
+  hdr.tb_den = fi->tb_den;
+  hdr.fr_num = fi->fr_num;
+  hdr.fr_den = fi->fr_den;
+  hdr.source = fi->source;
+  memcpy(&hdr.key, &fi->key, sizeof(FileKey));
+  hdr.first_frame = fi->first_frame;
+  hdr.n_frames = fi->n_frames;
+  hdr.n_keyframes = fi->n_keyframes;
+
+  len = fi->n_frames * sizeof(FrameIndexEntry);
+  ok = write(fd, &hdr, sizeof(FrameIndexFileHeader)) == sizeof(FrameIndexFileHeader)
+    && write(fd, fi->e, len) == (ssize_t) len;
+  fchmod(fd, 0644);
+  if (close(fd)) ok = 0;
+
+  if (!ok || rename(tmp, fn)) {
+    dlog(DLOG_WARNING, "FIDX: failed to store index '%s'\n", fn);
+    unlink(tmp);
+  } else {
+    debugmsg(DEBUG_DCTL, "FIDX: stored index '%s'\n", fn);
+  }
+  free(tmp);
+  free(fn);
+#endif
+}
+
+/* evict least-recently used, unreferenced indices
+ * NB. fidx_lock must be held */
+static void fi_evict(int max_count) {
+  while (HASH_COUNT(fidx_cache) > max_count) {
+    FrameIndexLine *cl, *tmp, *clru = NULL;
+    time_t lru = time(NULL) + 1;
+    HASH_ITER(hh, fidx_cache, cl, tmp) {
+      if (cl->fi->refcnt == 0 && cl->fi->lru < lru) {
+        lru = cl->fi->lru;
+        clru = cl;
+      }
+    }
+    if (!clru) {
+      break; // all in use
+    }
+    HASH_DEL(fidx_cache, clru);
+    fi_free(clru->fi);
+    free(clru);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// public API
+
+int findex_filekey(const char *fn, FileKey *k) {
+  struct stat sb;
+  memset(k, 0, sizeof(FileKey));
+  if (!fn || imgseq_stat(fn, &sb)) {
+    return -1;
+  }
+  k->dev = sb.st_dev;
+  k->ino = sb.st_ino;
+  k->size = sb.st_size;
+  k->mtime = sb.st_mtime;
+#ifdef _WIN32
+  /* no inode numbers on windows, use a hash of the path instead */
+  {
+    const unsigned char *p = (const unsigned char*) fn;
+    uint64_t h = 5381;
+    while (*p) h = (h << 5) + h + *p++;
+    k->ino = h;
+  }
+#endif
+  return 0;
+}
+
+FrameIndex *findex_lookup(const char *fn) {
+  FrameIndexLine *cl = NULL;
+  FrameIndex *fi = NULL;
+  FileKey k;
+  if (findex_filekey(fn, &k)) {
+    return NULL;
+  }
+  pthread_mutex_lock(&fidx_lock);
+  HASH_FIND(hh, fidx_cache, &k, sizeof(FileKey), cl);
+  if (cl) {
+    fi = cl->fi;
+    fi->refcnt++;
+    fi->lru = time(NULL);
+  }
+  pthread_mutex_unlock(&fidx_lock);
+  if (!fi && (fi = fi_store_load(&k))) {
+    fi = findex_publish(fi);
+  }
+  return fi;
+}
+
+FrameIndex *findex_create(int64_t n_alloc) {
+  FrameIndex *fi = (FrameIndex*) calloc(1, sizeof(FrameIndex));
+  if (n_alloc < 256) n_alloc = 256;
+  fi->e = (FrameIndexEntry*) malloc(n_alloc * sizeof(FrameIndexEntry));
+  fi->n_alloc = fi->e ? n_alloc : 0;
+  fi->tb_num = fi->tb_den = 1;
+  fi->fr_num = fi->fr_den = 1;
+  return fi;
+}
+
+void findex_append(FrameIndex *fi, int64_t pts, int64_t pos, int flags, int pict_type) {
+  if (fi->n_frames >= fi->n_alloc) {
+    int64_t n_alloc = fi->n_alloc > 0 ? fi->n_alloc * 2 : 256;
+    FrameIndexEntry *e = (FrameIndexEntry*) realloc(fi->e, n_alloc * sizeof(FrameIndexEntry));
+    if (!e) {
+      dlog(DLOG_ERR, "FIDX: out of memory, frame index is incomplete.\n");
+      return;
+    }
+    fi->e = e;
+    fi->n_alloc = n_alloc;
+  }
+  fi->e[fi->n_frames].pts = pts;
+  fi->e[fi->n_frames].pos = pos;
+  fi->e[fi->n_frames].flags = flags;
+  fi->e[fi->n_frames].pict_type = pict_type;
+  fi->n_frames++;
+}
+
+static int fi_cmp_pts(const void *a, const void *b) {
+  const int64_t pa = ((const FrameIndexEntry*)a)->pts;
+  const int64_t pb = ((const FrameIndexEntry*)b)->pts;
+  if (pa < pb) return -1;
+  if (pa > pb) return 1;
+  return 0;
+}
+
+void findex_finalize(FrameIndex *fi) {
+  int64_t i;
+  qsort(fi->e, fi->n_frames, sizeof(FrameIndexEntry), fi_cmp_pts);
+  fi->n_keyframes = 0;
+  for (i = 0; i < fi->n_frames; ++i) {
+    if (fi->e[i].flags & FIDX_KEY) fi->n_keyframes++;
+  }
+  fi->first_frame = 0;
+  if (fi->n_frames > 0) {
+    const double tb = (double) fi->tb_num / (double) fi->tb_den;
+    const double fr = (double) fi->fr_num / (double) fi->fr_den;
+    fi->first_frame = (int64_t) rint(fi->e[0].pts * tb * fr);
+  }
+}
+
+FrameIndex *findex_publish(FrameIndex *fi) {
+  FrameIndexLine *cl = NULL;
+  int store = 0;
+  pthread_mutex_lock(&fidx_lock);
+  HASH_FIND(hh, fidx_cache, &fi->key, sizeof(FileKey), cl);
+  if (cl) {
+    /* added meanwhile by another decoder */
+    fi_free(fi);
+    fi = cl->fi;
+  } else {
+    /* only scans are expensive enough to be worth keeping */
+    store = fidx_store && !fi->map && fi->source == FIDX_SRC_SCAN;
+    fi_evict(FIDX_CACHE_SIZE - 1);
+    cl = (FrameIndexLine*) calloc(1, sizeof(FrameIndexLine));
+    memcpy(&cl->key, &fi->key, sizeof(FileKey));
+    cl->fi = fi;
+    HASH_ADD(hh, fidx_cache, key, sizeof(FileKey), cl);
+  }
+  fi->refcnt++;
+  fi->lru = time(NULL);
+  pthread_mutex_unlock(&fidx_lock);
+  if (store) {
+    /* the index is referenced and immutable, no lock is needed */
+    fi_store_save(fi);
+  }
+  return fi;
+}
+
+FrameIndex *findex_ref(FrameIndex *fi) {
+  pthread_mutex_lock(&fidx_lock);
+  assert(fi->refcnt > 0);
+  fi->refcnt++;
+  pthread_mutex_unlock(&fidx_lock);
+  return fi;
+}
+
+void findex_release(FrameIndex *fi) {
+  if (!fi) return;
+  pthread_mutex_lock(&fidx_lock);
+  assert(fi->refcnt > 0);
+  fi->refcnt--;
+  pthread_mutex_unlock(&fidx_lock);
+}
+
+void findex_flush(void) {
+  pthread_mutex_lock(&fidx_lock);
+  fi_evict(0);
+  pthread_mutex_unlock(&fidx_lock);
+}
+
+void findex_set_store(const char *dir) {
+  pthread_mutex_lock(&fidx_lock);
+  free(fidx_store);
+  fidx_store = dir ? strdup(dir) : NULL;
+  pthread_mutex_unlock(&fidx_lock);
+}
+
+int64_t findex_find_pts(const FrameIndex *fi, int64_t pts) {
+  int64_t lo = 0, hi = fi->n_frames - 1;
+  if (fi->n_frames < 1 || pts < fi->e[0].pts) return -1;
+  while (lo < hi) {
+    const int64_t mid = lo + (hi - lo + 1) / 2;
+    if (fi->e[mid].pts <= pts) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
+
+int64_t findex_keyframe_before(const FrameIndex *fi, int64_t n) {
+  if (n >= fi->n_frames) n = fi->n_frames - 1;
+  for (; n >= 0; --n) {
+    if (fi->e[n].flags & FIDX_KEY) return n;
+  }
+  return -1;
+}
+
+int64_t findex_frame_number(const FrameIndex *fi, int64_t n) {
+  return fi->first_frame + n;
+}
+
+int64_t findex_frame_entry(const FrameIndex *fi, int64_t frame) {
+  int64_t n = frame - fi->first_frame;
+  if (frame < 0 || fi->n_frames < 1) return -1;
+  if (n < 0) n = 0; // before the first frame
+  if (n >= fi->n_frames) return -1;
+  return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// statistics
+
+const char *findex_source_name(const FrameIndex *fi) {
+  switch (fi->source) {
+    case FIDX_SRC_CONTAINER: return "container";
+    case FIDX_SRC_SEQUENCE: return "sequence";
+    default: return "scan";
+  }
+}
+
+void findex_info_html(char **m, size_t *o, size_t *s, int tbl) {
+  FrameIndexLine *cl, *tmp;
+  int i = 1;
+  uint64_t total_bytes = 0;
+  uint64_t mapped_bytes = 0;
+
+  if (tbl&1) {
+    rprintf("<h3>Frame Index Cache:</h3>\n");
+    rprintf("<p>max available: %d</p>\n", FIDX_CACHE_SIZE);
+    rprintf("<table style=\"text-align:center;width:100%%\">\n");
+  } else {
+    rprintf("<tr><td colspan=\"8\" class=\"left\"><h3>Frame Index Cache:</h3></td></tr>\n");
+    rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d</td></tr>\n", FIDX_CACHE_SIZE);
+  }
+  rprintf("<tr><th>#</th><th>inode</th><th>Source</th><th>Allocated Bytes</th><th>Frames</th><th>Keyframes</th><th>Refs</th><th>LRU</th></tr>\n");
+  pthread_mutex_lock(&fidx_lock);
+  HASH_ITER(hh, fidx_cache, cl, tmp) {
+    const FrameIndex *fi = cl->fi;
+    rprintf("<tr><td>%d.</td><td>%"PRIlld"</td><td>%s</td><td>%"PRIlld" bytes</td><td>%"PRIlld"</td><td>%"PRIlld"</td><td>%d</td><td>%"PRIlld"</td></tr>\n",
+        i, (long long) fi->key.ino,
+        fi->map ? "stored" : findex_source_name(fi),
+        (long long) (fi->map ? fi->map_len : fi->n_alloc * sizeof(FrameIndexEntry)),
+        (long long) fi->n_frames, (long long) fi->n_keyframes,
+        fi->refcnt, (long long) fi->lru);
+    if (fi->map) {
+      mapped_bytes += fi->map_len;
+    } else {
+      total_bytes += fi->n_alloc * sizeof(FrameIndexEntry);
+    }
+    i++;
+  }
+  pthread_mutex_unlock(&fidx_lock);
+
+  if ((tbl&1) == 0) {
+    rprintf("<tr><td colspan=\"8\" class=\"dline\"></td></tr>\n");
+  }
+  rprintf("<tr><td colspan=\"8\" class=\"left\">index size: %.1f KiB in memory, %.1f KiB mapped, store: %s</td></tr>\n",
+      total_bytes / 1024.0, mapped_bytes / 1024.0, fidx_store ? fidx_store : "-");
+  if (tbl&2) {
+    rprintf("</table>\n");
+  }
+}
+
+// vim:sw=2 sts=2 ts=8 et:
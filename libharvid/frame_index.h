@@ -0,0 +1,145 @@
+/**
+   @file frame_index.h
+   @brief per-file frame/keyframe index
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _FRAME_INDEX_H
+#define _FRAME_INDEX_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/* FrameIndexEntry flags */
+#define FIDX_KEY 1 ///< entry is a keyframe
+
+/* FrameIndex source */
+enum {FIDX_SRC_CONTAINER = 1, FIDX_SRC_SCAN = 2, FIDX_SRC_SEQUENCE = 3};
+
+/** identifies a file on disk (index is invalid if any of these change) */
+typedef struct {
+  uint64_t dev;
+  uint64_t ino;
+  int64_t  size;
+  int64_t  mtime;
+} FileKey;
+
+/** a single video-frame in presentation order */
+typedef struct {
+  int64_t pts;       ///< presentation timestamp in stream time-base units
+  int64_t pos;       ///< byte-position of the packet in the file, -1 if unknown
+  int32_t flags;     ///< FIDX_KEY
+  int32_t pict_type; ///< AVPictureType or 0 if unknown
+} FrameIndexEntry;
+
+/** video-frame index of a file, sorted by pts */
+typedef struct {
+  FileKey key;
+  int tb_num;          ///< stream time-base numerator
+  int tb_den;          ///< stream time-base denominator
+  int fr_num;          ///< frame-rate numerator
+  int fr_den;          ///< frame-rate denominator
+  int source;          ///< FIDX_SRC_CONTAINER or FIDX_SRC_SCAN
+  int64_t first_frame; ///< harvid frame-number of the first entry
+  int64_t n_frames;    ///< number of valid entries
+  int64_t n_keyframes; ///< number of entries with FIDX_KEY set
+  int64_t n_alloc;     ///< allocated entries (internal)
+  FrameIndexEntry *e;  ///< entries, e[i] corresponds to frame first_frame + i
+  int refcnt;          ///< internal, see findex_release()
+  time_t lru;          ///< internal, least recently used time
+  void *map;           ///< internal, mmap()ed index file, NULL if \a e is allocated
+  size_t map_len;      ///< internal, size of the mapping
+} FrameIndex;
+
+/** stat() the given file (or image sequence) and fill in its key
+ * @return 0 on success, -1 if the file can not be stat()ed
+ */
+int findex_filekey(const char *fn, FileKey *k);
+
+/** look up a cached index for the given file.
+ * The returned index is referenced and needs to be released with findex_release().
+ * @return index or NULL if none is cached (or the file was modified)
+ */
+FrameIndex *findex_lookup(const char *fn);
+
+/** allocate a new, empty index (not yet cached) */
+FrameIndex *findex_create(int64_t n_alloc);
+
+/** append an entry to an index that is being built */
+void findex_append(FrameIndex *fi, int64_t pts, int64_t pos, int flags, int pict_type);
+
+/** sort entries by pts and count keyframes.
+ * time-base and frame-rate must be set. Call before findex_publish() */
+void findex_finalize(FrameIndex *fi);
+
+/** add an index to the cache.
+ * If an index for the same file was added meanwhile \a fi is freed and the
+ * existing one returned instead.
+ * @return referenced index to be released with findex_release()
+ */
+FrameIndex *findex_publish(FrameIndex *fi);
+
+/** add a reference to an index that is already referenced */
+FrameIndex *findex_ref(FrameIndex *fi);
+
+/** release a reference to an index obtained from findex_lookup() or findex_publish() */
+void findex_release(FrameIndex *fi);
+
+/** free all cached indices that are not in use */
+void findex_flush(void);
+
+/** set the directory of the persistent index store.
+ * Indices built by scanning a file are written there (one file per
+ * dev/inode/size/mtime) and later memory-mapped instead of re-scanning.
+ * @param dir directory, NULL disables the store
+ */
+void findex_set_store(const char *dir);
+
+/** find the entry with the largest pts that is <= the given pts
+ * @return entry number, or -1 if \a pts is before the first frame
+ */
+int64_t findex_find_pts(const FrameIndex *fi, int64_t pts);
+
+/** find the closest keyframe at or before the given entry
+ * @return entry number, or -1 if there is none
+ */
+int64_t findex_keyframe_before(const FrameIndex *fi, int64_t n);
+
+/** map entry \a n to a harvid frame-number.
+ * Frames are numbered consecutively from the first entry on, which is
+ * exact for variable frame-rate files.
+ */
+int64_t findex_frame_number(const FrameIndex *fi, int64_t n);
+
+/** map a harvid frame-number to an entry (inverse of findex_frame_number()).
+ * Frame-numbers before the first entry map to the first entry.
+ * @return entry number, or -1 if the frame is beyond the end
+ */
+int64_t findex_frame_entry(const FrameIndex *fi, int64_t frame);
+
+/** name of the index source (container, scan or sequence) */
+const char *findex_source_name(const FrameIndex *fi);
+
+/** HTML format index-cache status information */
+void findex_info_html(char **m, size_t *o, size_t *s, int tbl);
+
+#endif
@@ -35,7 +35,11 @@ extern "C" {
 /* libharvid public API */
 #include "decoder_ctrl.h"
 #include "frame_cache.h"
+#include "frame_index.h"
 #include "image_cache.h"
+#include "image_seq.h"
+#include "media_io.h"
+#include "sws_pool.h"
 
 /* public ffdecoder.h API */
 void ff_initialize (void);
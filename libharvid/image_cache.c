@@ -25,6 +25,8 @@
 
 #include "dlog.h"
 #include "image_cache.h"
+#include "cache_pin.h"
+#include "ffdecoder.h"
 
 #include <time.h>
 #include <assert.h>
@@ -37,6 +39,7 @@
 /* FLAGS */
 #define CLF_VALID 1    //< cacheline is valid (has decoded frame) -- not needed, is it?!
 #define CLF_INUSE 2    //< currently being served
+#define CLF_PINNED 4   //< exempt from eviction, accounted in the PinSet
 
 typedef struct {
   int id;         // file ID from VidMap
@@ -44,6 +47,8 @@ typedef struct {
   short h;
   int fmt;        // image format
   int fmt_opt;     // image format options (e.g jpeg quality)
+  int quality;    // VDEC_QUALITY() of the decoder flags
+  VCrop crop;     // source region
   int64_t frame;
   int flags;
   int refcnt;     // CLF_INUSE reference count
@@ -63,21 +68,82 @@ typedef struct {
   pthread_rwlock_t lock;
   int cache_hits;
   int cache_miss;
+  PinSet pins;
 } ICC;
 
+/* unpin a cacheline, NB. the cache needs to be write-locked */
+static void ic_unpin(ICC *icc, ImageCacheLine *cl) {
+  if (!(cl->flags & CLF_PINNED)) return;
+  cl->flags &= ~CLF_PINNED;
+  pinset_release(&icc->pins, cl->s);
+}
+
+/* least recently used image that can be evicted, NB. the cache needs to be locked */
+static ImageCacheLine *ic_lru(ICC *icc) {
+  ImageCacheLine *cl, *tmp, *ilru = NULL;
+  time_t lru = time(NULL) + 1;
+  HASH_ITER(hh, icc->icache, cl, tmp) {
+    if (cl->lru < lru && !(cl->flags & (CLF_INUSE|CLF_PINNED))) {
+      lru = cl->lru;
+      ilru = cl;
+    }
+  }
+  return ilru;
+}
+
+static int cmp_lru(const void *a, const void *b) {
+  const ImageCacheLine *ca = *(ImageCacheLine* const*) a;
+  const ImageCacheLine *cb = *(ImageCacheLine* const*) b;
+  if (ca->lru == cb->lru) return 0;
+  return ca->lru < cb->lru ? -1 : 1;
+}
+
+/* evict least recently used images until at most cfg_cachesize (unpinned)
+ * images remain, NB. the cache needs to be write-locked */
+static void ic_trim_cache (ICC *icc) {
+  ImageCacheLine *cl, *tmp, **lru;
+  int i, n = 0;
+  int excess = (int) HASH_COUNT(icc->icache) - icc->pins.lines - icc->cfg_cachesize;
+  if (excess <= 0) return;
 
-static void ic_flush_cache (ICC *icc) {
+  lru = malloc(HASH_COUNT(icc->icache) * sizeof(ImageCacheLine*));
+  HASH_ITER(hh, icc->icache, cl, tmp) {
+    if (!(cl->flags & (CLF_INUSE|CLF_PINNED))) {
+      lru[n++] = cl;
+    }
+  }
+  qsort(lru, n, sizeof(ImageCacheLine*), cmp_lru);
+  for (i = 0; i < n && i < excess; ++i) {
+    HASH_DEL(icc->icache, lru[i]);
+    free(lru[i]->b);
+    free(lru[i]);
+  }
+  free(lru);
+}
+
+static void ic_flush_cache (ICC *icc, int id, int keep_pinned) {
   ImageCacheLine *cl, *tmp;
   pthread_rwlock_wrlock(&icc->lock);
 
   HASH_ITER(hh, icc->icache, cl, tmp) {
+    if (id >= 0 && cl->id != id) {
+      continue;
+    }
+    if (keep_pinned && (cl->flags & CLF_PINNED)) {
+      continue;
+    }
     HASH_DEL(icc->icache, cl);
+    ic_unpin(icc, cl);
     free(cl->b);
     free(cl);
   }
 
-  icc->cache_hits = 0;
-  icc->cache_miss = 0;
+  if (id >= 0) {
+    pinset_unbind(&icc->pins, id);
+  } else {
+    icc->cache_hits = 0;
+    icc->cache_miss = 0;
+  }
   pthread_rwlock_unlock(&icc->lock);
 }
 
@@ -90,11 +156,14 @@ void icache_create(void **p) {
   icc->cfg_cachesize = 32;
   icc->icache = NULL;
   icc->cache_hits = icc->cache_miss = 0;
+  icc->pins.budget = PIN_DEFAULT_BUDGET;
   pthread_rwlock_init(&icc->lock, NULL);
 }
 
 void icache_destroy(void **p) {
   ICC *icc = (*((ICC**)p));
+  ic_flush_cache(icc, -1, 0);
+  pinset_free(&icc->pins);
   pthread_rwlock_destroy(&icc->lock);
   free(icc->icache);
   free(*((ICC**)p));
@@ -102,21 +171,36 @@ void icache_destroy(void **p) {
 }
 
 void icache_resize(void *p, int size) {
-  if (size < ((ICC*)p)->cfg_cachesize)
-    ic_flush_cache((ICC*) p);
-  if (size > 0)
-    ((ICC*)p)->cfg_cachesize = size;
+  ICC *icc = (ICC*) p;
+  if (size < 1) return;
+  pthread_rwlock_wrlock(&icc->lock);
+  icc->cfg_cachesize = size;
+  ic_trim_cache(icc);
+  pthread_rwlock_unlock(&icc->lock);
 }
 
 void icache_clear (void *p) {
-  ic_flush_cache((ICC*) p);
+  ic_flush_cache((ICC*) p, -1, 1);
+}
+
+void icache_clear_id (void *p, int id) {
+  ic_flush_cache((ICC*) p, id, 0);
 }
 
 
-uint8_t *icache_get_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, short w, short h, size_t *size, void **cptr) {
+uint8_t *icache_get_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, int quality, short w, short h, const VCrop *crop, size_t *size, void **cptr) {
   ICC *icc = (ICC*) p;
   ImageCacheLine *cl = NULL;
-  const ImageCacheLine cmp = {id, w, h, fmt, fmt_opt, frame, 0, 0, 0, NULL, 0};
+  ImageCacheLine cmp;
+  memset(&cmp, 0, sizeof(ImageCacheLine)); // also clear padding, the key is hashed as-is
+  cmp.id = id;
+  cmp.w = w;
+  cmp.h = h;
+  cmp.fmt = fmt;
+  cmp.fmt_opt = fmt_opt;
+  cmp.quality = quality;
+  if (VCROP_ACTIVE(crop)) memcpy(&cmp.crop, crop, sizeof(VCrop));
+  cmp.frame = frame;
 
   pthread_rwlock_rdlock(&icc->lock);
   HASH_FIND(hh, icc->icache, &cmp, CLKEYLEN, cl);
@@ -144,28 +228,25 @@ uint8_t *icache_get_buffer(void *p, unsigned short id, int64_t frame, int fmt, i
   return NULL;
 }
 
-int icache_add_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, short w, short h, uint8_t *buf, size_t size) {
+int icache_add_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, int quality, short w, short h, const VCrop *crop, uint8_t *buf, size_t size) {
   ICC *icc = (ICC*) p;
   ImageCacheLine *cl = NULL, *tmp;
 
-  pthread_rwlock_rdlock(&icc->lock); // wrlock ?!
-  if (HASH_COUNT(icc->icache) >= icc->cfg_cachesize) {
-    ImageCacheLine *tmp, *ilru = NULL;
-    time_t lru = time(NULL) + 1;
-
-    HASH_ITER(hh, icc->icache, cl, tmp) {
-      if (cl->lru < lru && !(cl->flags & CLF_INUSE)) {
-        lru = cl->lru;
-        ilru = cl;
-      }
-    }
-
-    if (ilru) {
-      HASH_DEL(icc->icache, ilru);
-      free(ilru->b);
-      cl = ilru;
-      memset(cl, 0, sizeof(ImageCacheLine));
+  pthread_rwlock_wrlock(&icc->lock);
+  /* pinned lines do not count against the cache-size.
+   * If the cache was shrunk while images were in use, evict those now. */
+  while ((int) HASH_COUNT(icc->icache) - icc->pins.lines >= icc->cfg_cachesize) {
+    ImageCacheLine *ilru = ic_lru(icc);
+    if (!ilru) {
+      break;
     }
+    HASH_DEL(icc->icache, ilru);
+    free(ilru->b);
+    free(cl);
+    cl = ilru;
+  }
+  if (cl) {
+    memset(cl, 0, sizeof(ImageCacheLine));
   }
   pthread_rwlock_unlock(&icc->lock);
 
@@ -177,6 +258,8 @@ int icache_add_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fm
   cl->h = h;
   cl->fmt = fmt;
   cl->fmt_opt = fmt_opt;
+  cl->quality = quality;
+  if (VCROP_ACTIVE(crop)) memcpy(&cl->crop, crop, sizeof(VCrop));
   cl->frame = frame;
   cl->lru = 0;
   cl->b = buf;
@@ -192,6 +275,9 @@ int icache_add_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fm
     free(cl);
     return -1; // buffer is freed by parent
   }
+  if (pinset_match(&icc->pins, id, frame, w, h, fmt) && pinset_claim(&icc->pins, size)) {
+    cl->flags |= CLF_PINNED;
+  }
   HASH_ADD(hh, icc->icache, id, CLKEYLEN, cl);
   pthread_rwlock_unlock(&icc->lock);
   return 0;
@@ -209,6 +295,58 @@ void icache_release_buffer(void *p, void *cptr) {
   pthread_rwlock_unlock(&icc->lock);
 }
 
+int icache_pin(void *p, const char *fn, unsigned short id, int64_t start, int64_t end, short w, short h, int fmt) {
+  ICC *icc = (ICC*) p;
+  ImageCacheLine *cl, *tmp;
+  CachePin pin = {(char*) fn, id, start, end, w, h, fmt};
+  int n = 0;
+  pthread_rwlock_wrlock(&icc->lock);
+  pinset_add(&icc->pins, &pin);
+  /* pin cached images that match */
+  HASH_ITER(hh, icc->icache, cl, tmp) {
+    if (cl->flags & CLF_PINNED) continue;
+    if (!pinset_match(&icc->pins, cl->id, cl->frame, cl->w, cl->h, cl->fmt)) continue;
+    if (!pinset_claim(&icc->pins, cl->s)) {
+      dlog(DLOG_WARNING, "ICACHE: pin budget exceeded.\n");
+      break;
+    }
+    cl->flags |= CLF_PINNED;
+    ++n;
+  }
+  pthread_rwlock_unlock(&icc->lock);
+  return n;
+}
+
+int icache_unpin(void *p, const char *fn, int64_t start, int64_t end, short w, short h, int fmt) {
+  ICC *icc = (ICC*) p;
+  ImageCacheLine *cl, *tmp;
+  CachePin pin = {(char*) fn, -1, start, end, w, h, fmt};
+  int n;
+  pthread_rwlock_wrlock(&icc->lock);
+  n = pinset_remove(&icc->pins, &pin);
+  HASH_ITER(hh, icc->icache, cl, tmp) {
+    if (!(cl->flags & CLF_PINNED)) continue;
+    if (pinset_match(&icc->pins, cl->id, cl->frame, cl->w, cl->h, cl->fmt)) continue;
+    ic_unpin(icc, cl);
+  }
+  pthread_rwlock_unlock(&icc->lock);
+  return n;
+}
+
+void icache_pin_bind(void *p, const char *fn, unsigned short id) {
+  ICC *icc = (ICC*) p;
+  pthread_rwlock_wrlock(&icc->lock);
+  pinset_bind(&icc->pins, fn, id);
+  pthread_rwlock_unlock(&icc->lock);
+}
+
+void icache_pin_budget(void *p, size_t bytes) {
+  ICC *icc = (ICC*) p;
+  pthread_rwlock_wrlock(&icc->lock);
+  icc->pins.budget = bytes;
+  pthread_rwlock_unlock(&icc->lock);
+}
+
 static char *flags2txt(int f) {
   char *rv = NULL;
   size_t off = 0;
@@ -226,6 +364,10 @@ static char *flags2txt(int f) {
     rv = (char*) realloc(rv, (off+8) * sizeof(char));
     off += sprintf(rv+off, "in-use ");
   }
+  if (f&CLF_PINNED) {
+    rv = (char*) realloc(rv, (off+8) * sizeof(char));
+    off += sprintf(rv+off, "pinned ");
+  }
   return rv;
 }
 
@@ -237,6 +379,12 @@ static const char * fmt_to_text(int fmt) {
       return "PNG";
     case 3:
       return "PPM";
+    case 4:
+      return "LZ4";
+    case 5:
+      return "QOI";
+    case 6:
+      return "WebP";
     default:
       return "?";
   }
@@ -258,21 +406,36 @@ void icache_info_html(void *p, char **m, size_t *o, size_t *s, int tbl) {
     rprintf("<tr><td colspan=\"8\" class=\"left line\">max available: %d\n", ((ICC*)p)->cfg_cachesize);
     rprintf(", cache-hits: %d, cache-misses: %d</td></tr>\n", ((ICC*)p)->cache_hits, ((ICC*)p)->cache_miss);
   }
+  pthread_rwlock_rdlock(&((ICC*)p)->lock);
+  pinset_info_html(&((ICC*)p)->pins, m, o, s, tbl);
   rprintf("<tr><th>#</th><th>file-id</th><th>Flags</th><th>Allocated Bytes</th><th>Geometry</th><th>Buffer</th><th>Frame#</th><th>Last Hit</th></tr>\n");
   /* walk comlete tree */
-  pthread_rwlock_rdlock(&((ICC*)p)->lock);
   HASH_ITER(hh, ((ICC*)p)->icache, cptr, tmp) {
     char *tmp = flags2txt(cptr->flags);
 #ifdef _WIN32
-    rprintf("<tr><td>%d.</td><td>%d</td><td>%s</td><td>%lu bytes</td><td>%dx%d</td>",
+    rprintf("<tr><td>%d.</td><td>%d</td><td>%s</td><td>%lu bytes</td><td>%dx%d",
         i, cptr->id, tmp, (long unsigned) cptr->s, cptr->w, cptr->h);
 #else
-    rprintf("<tr><td>%d.</td><td>%d</td><td>%s</td><td>%zu bytes</td><td>%dx%d</td>",
+    rprintf("<tr><td>%d.</td><td>%d</td><td>%s</td><td>%zu bytes</td><td>%dx%d",
         i, cptr->id, tmp, cptr->s, cptr->w, cptr->h);
 #endif
+    if (VCROP_ACTIVE(&cptr->crop)) {
+      rprintf(" (%dx%d+%d+%d)", cptr->crop.w, cptr->crop.h, cptr->crop.x, cptr->crop.y);
+    }
+    rprintf("</td>");
 
     if (cptr->fmt == 1) {
       rprintf("<td>%s Q:%d</td>", fmt_to_text(cptr->fmt), cptr->fmt_opt);
+    } else if (cptr->fmt == 4) {
+      rprintf("<td>%s %s</td>", fmt_to_text(cptr->fmt), ff_fmt_to_text(cptr->fmt_opt));
+    } else if (cptr->fmt == 6) {
+      if (cptr->fmt_opt & 0x1000) {
+        rprintf("<td>%s lossless M:%d</td>", fmt_to_text(cptr->fmt), (cptr->fmt_opt >> 8) & 0xf);
+      } else {
+        rprintf("<td>%s Q:%d M:%d</td>", fmt_to_text(cptr->fmt), cptr->fmt_opt & 0xff, (cptr->fmt_opt >> 8) & 0xf);
+      }
+    } else if (cptr->fmt == 5) {
+      rprintf("<td>%s %s</td>", fmt_to_text(cptr->fmt), cptr->fmt_opt == 4 ? "RGBA" : "RGB");
     } else {
       rprintf("<td>%s</td>", fmt_to_text(cptr->fmt));
     }
@@ -21,16 +21,25 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include "vinfo.h"
 
 void icache_create(void **p);
 void icache_destroy(void **p);
 void icache_resize(void *p, int size);
 void icache_clear (void *p);
+/* remove all images of file-ID \a id, including pinned ones */
+void icache_clear_id (void *p, int id);
 
-uint8_t *icache_get_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, short w, short h, size_t *size, void **cptr);
-int icache_add_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, short w, short h, uint8_t *buf, size_t size);
+uint8_t *icache_get_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, int quality, short w, short h, const VCrop *crop, size_t *size, void **cptr);
+int icache_add_buffer(void *p, unsigned short id, int64_t frame, int fmt, int fmt_opt, int quality, short w, short h, const VCrop *crop, uint8_t *buf, size_t size);
 void icache_release_buffer(void *p, void *cptr);
 
+/* see vcache_pin(), fmt: image format (-1: any), format options are ignored */
+int icache_pin(void *p, const char *fn, unsigned short id, int64_t start, int64_t end, short w, short h, int fmt);
+int icache_unpin(void *p, const char *fn, int64_t start, int64_t end, short w, short h, int fmt);
+void icache_pin_bind(void *p, const char *fn, unsigned short id);
+void icache_pin_budget(void *p, size_t bytes);
+
 void icache_info_html(void *p, char **m, size_t *o, size_t *s, int tbl);
 
 #endif
@@ -0,0 +1,385 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>     /* uint8_t */
+#include <inttypes.h>
+#include <stdlib.h>     /* calloc et al.*/
+#include <string.h>     /* memset */
+#include <strings.h>    /* strcasecmp */
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "dlog.h"
+#include "image_seq.h"
+
+//#define HASH_EMIT_KEYS 3
+#define HASH_FUNCTION HASH_SFH
+#include "uthash.h"
+
+#ifndef MAX_PATH
+# ifdef PATH_MAX
+#  define MAX_PATH PATH_MAX
+# else
+#  define MAX_PATH (1024)
+# endif
+#endif
+
+#define IS_MAX_DIGITS 18 ///< longest frame-number that fits int64_t
+
+/** files of a sequence found in its directory */
+typedef struct {
+  char    *fn;        ///< sequence pattern
+  time_t   dir_mtime; ///< modification time of the directory when it was scanned
+  int64_t  lo;        ///< lowest file-number
+  int64_t  hi;        ///< highest file-number
+  int64_t  count;
+  int64_t  size;      ///< total size of all files
+  time_t   mtime;     ///< most recent modification of any file
+  uint64_t lru;
+  UT_hash_handle hh;
+} IsScan;
+
+static IsScan *is_scans = NULL;
+static pthread_mutex_t is_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t is_seq = 0;
+
+static int is_fps_num = 25;
+static int is_fps_den = 1;
+static int64_t is_start = -1;
+
+static const char *is_basename(const char *fn) {
+  const char *base = strrchr(fn, '/');
+#ifdef _WIN32
+  const char *bs = strrchr(fn, '\\');
+  if (bs && (!base || bs > base)) base = bs;
+#endif
+  return base ? base + 1 : fn;
+}
+
+/* locate the '#' run of a pattern
+ * @param plen length of the prefix (up to the first '#')
+ * @param digits number of '#' */
+static int is_split(const char *fn, size_t *plen, int *digits) {
+  const char *base = is_basename(fn);
+  const char *ext = strrchr(base, '.');
+  const char *p;
+  if (!ext || !imgseq_is_image(ext)) {
+    return -1;
+  }
+  for (p = ext; p > base && p[-1] == '#'; --p) ;
+  if (p == ext || ext - p > IS_MAX_DIGITS) {
+    return -1;
+  }
+  *plen = p - fn;
+  *digits = ext - p;
+  return 0;
+}
+
+/* match a directory entry: name-prefix, frame-number, extension
+ * @return 0 and the frame-number if the file belongs to the sequence */
+static int is_match(const char *name, const char *nprefix, size_t nplen, const char *suffix, int digits, int64_t *num) {
+  const char *d = name + nplen;
+  int k = 0;
+  if (strncmp(name, nprefix, nplen)) {
+    return -1;
+  }
+  while (d[k] >= '0' && d[k] <= '9') ++k;
+  if (k < digits || k > IS_MAX_DIGITS || strcmp(d + k, suffix)) {
+    return -1;
+  }
+  /* a longer number is not zero padded, e.g. 10000 for '####' */
+  if (k > digits && d[0] == '0') {
+    return -1;
+  }
+  *num = strtoll(d, NULL, 10);
+  return 0;
+}
+
+/* drop least recently used scans
+ * NB. is_lock must be held */
+static void is_evict(unsigned int max_count) {
+  while (HASH_COUNT(is_scans) > max_count) {
+    IsScan *sc, *tmp, *lru = NULL;
+    HASH_ITER(hh, is_scans, sc, tmp) {
+      if (!lru || sc->lru < lru->lru) lru = sc;
+    }
+    HASH_DEL(is_scans, lru);
+    free(lru->fn);
+    free(lru);
+  }
+}
+
+static int is_readdir(const char *dn, const char *nprefix, size_t nplen, const char *suffix, int digits, IsScan *sc) {
+  DIR *D;
+  struct dirent *dd;
+
+  if (!(D = opendir(dn))) {
+    return -1;
+  }
+  while ((dd = readdir(D))) {
+    struct stat fs;
+    char rn[MAX_PATH];
+    int64_t num;
+    if (is_match(dd->d_name, nprefix, nplen, suffix, digits, &num)) continue;
+    snprintf(rn, MAX_PATH, "%s/%s", dn, dd->d_name);
+    if (stat(rn, &fs) || !S_ISREG(fs.st_mode)) continue;
+    if (sc->count == 0 || num < sc->lo) sc->lo = num;
+    if (sc->count == 0 || num > sc->hi) sc->hi = num;
+    if (fs.st_mtime > sc->mtime) sc->mtime = fs.st_mtime;
+    sc->size += fs.st_size;
+    sc->count++;
+  }
+  closedir(D);
+  return 0;
+}
+
+/* find the files of a sequence, re-use the previous scan of an unmodified directory */
+static int is_scan(const char *fn, IsScan *rv) {
+  IsScan *sc = NULL;
+  struct stat ds;
+  char dn[MAX_PATH];
+  const char *nprefix = is_basename(fn);
+  size_t plen;
+  int digits;
+
+  if (is_split(fn, &plen, &digits)) {
+    return -1;
+  }
+  if (nprefix == fn) {
+    strcpy(dn, ".");
+  } else {
+    snprintf(dn, MAX_PATH, "%.*s", (int)(nprefix - fn - 1), fn);
+  }
+  if (stat(dn, &ds) || !S_ISDIR(ds.st_mode)) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&is_lock);
+  HASH_FIND_STR(is_scans, fn, sc);
+  if (sc && sc->dir_mtime == ds.st_mtime) {
+    sc->lru = ++is_seq;
+    memcpy(rv, sc, sizeof(IsScan));
+    pthread_mutex_unlock(&is_lock);
+    return rv->count > 0 ? 0 : -1;
+  }
+  pthread_mutex_unlock(&is_lock);
+
+  /* large sequences take a while, scan unlocked */
+  memset(rv, 0, sizeof(IsScan));
+  if (is_readdir(dn, nprefix, fn + plen - nprefix, fn + plen + digits, digits, rv)) {
+    return -1;
+  }
+  rv->dir_mtime = ds.st_mtime;
+  debugmsg(DEBUG_DCTL, "ISQ: '%s' %"PRId64" files %"PRId64"..%"PRId64"\n", fn, rv->count, rv->lo, rv->hi);
+
+  pthread_mutex_lock(&is_lock);
+  HASH_FIND_STR(is_scans, fn, sc);
+  if (!sc) {
+    sc = calloc(1, sizeof(IsScan));
+    sc->fn = strdup(fn);
+    HASH_ADD_KEYPTR(hh, is_scans, sc->fn, strlen(sc->fn), sc);
+  }
+  sc->dir_mtime = rv->dir_mtime;
+  sc->lo = rv->lo;
+  sc->hi = rv->hi;
+  sc->count = rv->count;
+  sc->size = rv->size;
+  sc->mtime = rv->mtime;
+  sc->lru = ++is_seq;
+  is_evict(IMGSEQ_CACHE_SIZE);
+  pthread_mutex_unlock(&is_lock);
+  return rv->count > 0 ? 0 : -1;
+}
+
+/* file-name of the given file-number */
+static void is_path(const char *fn, size_t plen, int digits, int64_t num, char *buf, size_t len) {
+  snprintf(buf, len, "%.*s%0*lld%s", (int) plen, fn, digits, (long long) num, fn + plen + digits);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// public API
+
+void imgseq_configure(int fps_num, int fps_den, int64_t start) {
+  is_fps_num = fps_num;
+  is_fps_den = fps_den;
+  is_start = start;
+}
+
+int imgseq_parse_rate(const char *s, int *num, int *den) {
+  long long n, d;
+  char *e;
+  if (!s || !*s) {
+    return -1;
+  }
+  if (strchr(s, '/')) {
+    n = strtoll(s, &e, 10);
+    if (*e != '/') return -1;
+    d = strtoll(e + 1, &e, 10);
+    if (*e) return -1;
+  } else {
+    const double fps = strtod(s, &e);
+    if (*e || !(fps > 0)) return -1;
+    if (fabs(fps - rint(fps)) > .005 && fabs(fps * 1.001 - rint(fps * 1.001)) < .005) {
+      /* 23.976, 29.97, 59.94 */
+      n = rint(fps * 1.001) * 1000;
+      d = 1001;
+    } else {
+      n = rint(fps * 1000);
+      d = 1000;
+    }
+  }
+  if (n < 1 || d < 1 || n < d || n > 1000 * d || n > INT32_MAX || d > INT32_MAX) {
+    return -1;
+  }
+  {
+    long long a = n, b = d;
+    while (b) { const long long t = a % b; a = b; b = t; }
+    n /= a;
+    d /= a;
+  }
+  *num = n;
+  *den = d;
+  return 0;
+}
+
+int imgseq_is_image(const char *name) {
+  const char *ext = strrchr(name, '.');
+  return ext && (
+         !strcasecmp(ext, ".dpx")
+      || !strcasecmp(ext, ".exr")
+      || !strcasecmp(ext, ".tif")
+      || !strcasecmp(ext, ".tiff")
+      || !strcasecmp(ext, ".png")
+      || !strcasecmp(ext, ".jpg")
+      || !strcasecmp(ext, ".jpeg")
+      || !strcasecmp(ext, ".bmp")
+      || !strcasecmp(ext, ".tga")
+      );
+}
+
+int imgseq_is_pattern(const char *fn) {
+  size_t plen;
+  int digits;
+  return fn && !is_split(fn, &plen, &digits);
+}
+
+char *imgseq_pattern(const char *name) {
+  const char *ext = strrchr(name, '.');
+  const char *p;
+  char *rv;
+  int k;
+  if (!ext || ext == name || !imgseq_is_image(ext)) {
+    return NULL;
+  }
+  for (p = ext; p > name && p[-1] >= '0' && p[-1] <= '9'; --p) ;
+  k = ext - p;
+  if (k == 0 || k > IS_MAX_DIGITS) {
+    return NULL;
+  }
+  rv = malloc(strlen(name) + 1);
+  sprintf(rv, "%.*s%.*s%s", (int)(p - name), name, k, "##################", ext);
+  return rv;
+}
+
+ImgSeq *imgseq_open(const char *fn) {
+  ImgSeq *s;
+  IsScan sc;
+  size_t plen;
+  int digits;
+
+  if (is_split(fn, &plen, &digits) || is_scan(fn, &sc)) {
+    return NULL;
+  }
+  if (sc.hi < (is_start >= 0 ? is_start : sc.lo)) {
+    dlog(DLOG_WARNING, "ISQ: no files at or after the start number in '%s'\n", fn);
+    return NULL;
+  }
+  s = calloc(1, sizeof(ImgSeq));
+  s->prefix = malloc(plen + 1);
+  memcpy(s->prefix, fn, plen);
+  s->prefix[plen] = '\0';
+  s->suffix = strdup(fn + plen + digits);
+  s->digits = digits;
+  s->first = is_start >= 0 ? is_start : sc.lo;
+  s->last = sc.hi;
+  s->count = sc.count;
+  s->fps_num = is_fps_num;
+  s->fps_den = is_fps_den;
+  return s;
+}
+
+void imgseq_close(ImgSeq *s) {
+  if (!s) {
+    return;
+  }
+  free(s->prefix);
+  free(s->suffix);
+  free(s);
+}
+
+char *imgseq_frame_path(const ImgSeq *s, int64_t frame, char *buf, size_t len) {
+  if (frame < 0 || s->first + frame > s->last) {
+    return NULL;
+  }
+  snprintf(buf, len, "%s%0*lld%s", s->prefix, s->digits, (long long) (s->first + frame), s->suffix);
+  return buf;
+}
+
+int imgseq_stat(const char *fn, struct stat *sb) {
+  char rn[MAX_PATH];
+  IsScan sc;
+  size_t plen;
+  int digits;
+
+  if (is_split(fn, &plen, &digits)) {
+    return stat(fn, sb);
+  }
+  if (is_scan(fn, &sc)) {
+    return -1;
+  }
+  is_path(fn, plen, digits, sc.lo, rn, MAX_PATH);
+  if (stat(rn, sb)) {
+    return -1;
+  }
+  sb->st_size = sc.size;
+  sb->st_mtime = sc.mtime;
+  return 0;
+}
+
+int imgseq_access(const char *fn, int mode) {
+  char rn[MAX_PATH];
+  IsScan sc;
+  size_t plen;
+  int digits;
+
+  if (is_split(fn, &plen, &digits)) {
+    return access(fn, mode);
+  }
+  if (is_scan(fn, &sc)) {
+    return -1;
+  }
+  is_path(fn, plen, digits, sc.lo, rn, MAX_PATH);
+  return access(rn, mode);
+}
+
+// vim:sw=2 sts=2 ts=8 et:
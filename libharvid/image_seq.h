@@ -0,0 +1,109 @@
+/**
+   @file image_seq.h
+   @brief numbered image sequences as video source
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _IMAGE_SEQ_H
+#define _IMAGE_SEQ_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define IMGSEQ_CACHE_SIZE 64 ///< max. number of directory scans to keep
+
+/**
+ * A sequence is addressed by a file-name pattern: a run of '#' in place
+ * of the frame-number, directly before the file-extension, e.g.
+ * "shot_010/plate.####.dpx" for plate.0001.dpx, plate.0002.dpx, ...
+ * The number of '#' is the zero-padded width of the frame-number.
+ */
+typedef struct {
+  char   *prefix;  ///< path up to the frame-number
+  char   *suffix;  ///< file-extension including the dot
+  int     digits;  ///< minimum width of the frame-number
+  int64_t first;   ///< file-number of video-frame zero
+  int64_t last;    ///< highest file-number present
+  int64_t count;   ///< number of files present
+  int     fps_num; ///< frame-rate numerator
+  int     fps_den; ///< frame-rate denominator
+} ImgSeq;
+
+/**
+ * configure image sequences, affects sequences opened afterwards.
+ * @param fps_num frame-rate numerator
+ * @param fps_den frame-rate denominator
+ * @param start file-number of the first video-frame,
+ *        -1: the lowest number found in the directory
+ */
+void imgseq_configure(int fps_num, int fps_den, int64_t start);
+
+/**
+ * parse a frame-rate given as integer, decimal or fraction,
+ * e.g. "24", "23.976" or "24000/1001".
+ * @return 0 on success, -1 if the rate is invalid
+ */
+int imgseq_parse_rate(const char *s, int *num, int *den);
+
+/** test if the file-name has the extension of a supported image format */
+int imgseq_is_image(const char *name);
+
+/** test if the file-name is a sequence pattern */
+int imgseq_is_pattern(const char *fn);
+
+/**
+ * sequence pattern matching a numbered image file,
+ * e.g. "plate.####.dpx" for "plate.0042.dpx".
+ * @return allocated pattern or NULL if the name is not a numbered image
+ */
+char *imgseq_pattern(const char *name);
+
+/**
+ * open a sequence, the directory is only scanned again if it was modified
+ * @param fn file-name pattern
+ * @return handle or NULL if the pattern does not match any file
+ */
+ImgSeq *imgseq_open(const char *fn);
+
+/** free a sequence handle, NULL is ignored */
+void imgseq_close(ImgSeq *s);
+
+/**
+ * file-name of a video-frame
+ * @param frame zero based video-frame number
+ * @return \a buf or NULL if the frame is outside the sequence
+ */
+char *imgseq_frame_path(const ImgSeq *s, int64_t frame, char *buf, size_t len);
+
+/**
+ * stat() that also accepts sequence patterns. The result of a sequence
+ * is that of its first file, with the total size and the most recent
+ * modification time of all files.
+ */
+int imgseq_stat(const char *fn, struct stat *sb);
+
+/** access() that also accepts sequence patterns, checks the first file */
+int imgseq_access(const char *fn, int mode);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>     /* uint8_t */
+#include <inttypes.h>
+#include <stdlib.h>     /* calloc et al.*/
+#include <string.h>     /* memset */
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include <assert.h>
+#include <pthread.h>
+
+#include "dlog.h"
+#include "ffcompat.h"
+#include "media_io.h"
+
+#include <libavformat/avio.h>
+
+//#define HASH_EMIT_KEYS 3
+#define HASH_FUNCTION HASH_SFH
+#include "uthash.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/** I/O statistics of a file, shared by all its handles */
+typedef struct {
+  char *fn;
+  int refcnt;        ///< open handles
+  int mapped;        ///< most recent open used mmap
+  uint64_t opens;
+  uint64_t reads;    ///< read calls by the demuxer
+  uint64_t bytes;    ///< bytes read
+  uint64_t wait_us;  ///< time spent reading (incl. page-faults when mapped)
+  uint64_t prefetch; ///< bytes hinted to be read ahead
+  uint64_t lru;
+  UT_hash_handle hh;
+} MioStats;
+
+struct MediaIO {
+  int fd;
+  uint8_t *map;  ///< mmap()ed file, NULL: read via fd
+  int64_t size;
+  int64_t pos;
+  AVIOContext *avio;
+  MioStats *st;
+};
+
+static size_t mio_bufsize = MEDIAIO_BUFSIZE;
+static int mio_mmap = 0;
+static MioStats *mio_stats = NULL;
+static pthread_mutex_t mio_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t mio_seq = 0;
+
+/* drop statistics of least recently used, closed files
+ * NB. mio_lock must be held */
+static void mio_evict(unsigned int max_count) {
+  while (HASH_COUNT(mio_stats) > max_count) {
+    MioStats *ms, *tmp, *mlru = NULL;
+    HASH_ITER(hh, mio_stats, ms, tmp) {
+      if (ms->refcnt > 0) continue;
+      if (!mlru || ms->lru < mlru->lru) mlru = ms;
+    }
+    if (!mlru) break;
+    HASH_DEL(mio_stats, mlru);
+    free(mlru->fn);
+    free(mlru);
+  }
+}
+
+static MioStats *mio_stats_ref(const char *fn, int mapped) {
+  MioStats *ms = NULL;
+  pthread_mutex_lock(&mio_lock);
+  HASH_FIND_STR(mio_stats, fn, ms);
+  if (!ms) {
+    ms = calloc(1, sizeof(MioStats));
+    ms->fn = strdup(fn);
+    HASH_ADD_KEYPTR(hh, mio_stats, ms->fn, strlen(ms->fn), ms);
+  }
+  ms->refcnt++;
+  ms->opens++;
+  ms->mapped = mapped;
+  ms->lru = ++mio_seq;
+  mio_evict(MEDIAIO_STATS_SIZE);
+  pthread_mutex_unlock(&mio_lock);
+  return ms;
+}
+
+static inline uint64_t mio_usec(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int mio_read(void *opaque, uint8_t *buf, int size) {
+  MediaIO *mio = (MediaIO*) opaque;
+  const uint64_t t0 = mio_usec();
+  int64_t n;
+
+  if (mio->pos >= mio->size) {
+    return AVERROR_EOF;
+  }
+  if (mio->map) {
+    n = mio->size - mio->pos;
+    if (n > size) n = size;
+    memcpy(buf, mio->map + mio->pos, n);
+  } else {
+#ifndef _WIN32
+    do {
+      n = pread(mio->fd, buf, size, mio->pos);
+    } while (n < 0 && errno == EINTR);
+#else
+    if (lseek(mio->fd, mio->pos, SEEK_SET) != mio->pos) {
+      return AVERROR(EIO);
+    }
+    n = read(mio->fd, buf, size);
+#endif
+    if (n < 0) {
+      return AVERROR(errno);
+    }
+    if (n == 0) {
+      return AVERROR_EOF;
+    }
+  }
+  mio->pos += n;
+
+  pthread_mutex_lock(&mio_lock);
+  mio->st->reads++;
+  mio->st->bytes += n;
+  mio->st->wait_us += mio_usec() - t0;
+  pthread_mutex_unlock(&mio_lock);
+  return (int) n;
+}
+
+static int64_t mio_seek(void *opaque, int64_t offset, int whence) {
+  MediaIO *mio = (MediaIO*) opaque;
+  int64_t pos;
+  switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+      return mio->size;
+    case SEEK_SET:
+      pos = offset;
+      break;
+    case SEEK_CUR:
+      pos = mio->pos + offset;
+      break;
+    case SEEK_END:
+      pos = mio->size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+  if (pos < 0) {
+    return AVERROR(EINVAL);
+  }
+  mio->pos = pos;
+  return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// public API
+
+void mediaio_configure(size_t bufsize, int use_mmap) {
+  mio_bufsize = bufsize;
+  mio_mmap = use_mmap;
+}
+
+MediaIO *mediaio_open(const char *fn) {
+  MediaIO *mio;
+  uint8_t *buf;
+  struct stat sb;
+  int fd;
+
+  if (mio_bufsize == 0 || !fn) {
+    return NULL;
+  }
+  if ((fd = open(fn, O_RDONLY | O_BINARY)) < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &sb) || !S_ISREG(sb.st_mode)) {
+    close(fd);
+    return NULL;
+  }
+
+  mio = calloc(1, sizeof(MediaIO));
+  mio->fd = fd;
+  mio->size = sb.st_size;
+
+#ifndef _WIN32
+  if (mio_mmap && mio->size > 0) {
+    void *map = mmap(NULL, mio->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+      mio->map = (uint8_t*) map;
+    } else {
+      dlog(DLOG_WARNING, "MIO: cannot map '%s', reading it instead\n", fn);
+    }
+  }
+#endif
+
+  if (!(buf = av_malloc(mio_bufsize))
+      || !(mio->avio = avio_alloc_context(buf, mio_bufsize, 0, mio, mio_read, NULL, mio_seek))) {
+    av_free(buf);
+#ifndef _WIN32
+    if (mio->map) munmap(mio->map, mio->size);
+#endif
+    close(fd);
+    free(mio);
+    return NULL;
+  }
+
+  mio->st = mio_stats_ref(fn, mio->map != NULL);
+  return mio;
+}
+
+struct AVIOContext *mediaio_avio(MediaIO *mio) {
+  return mio->avio;
+}
+
+void mediaio_prefetch(MediaIO *mio, int64_t pos, int64_t len) {
+  if (!mio || pos >= mio->size || len <= 0) {
+    return;
+  }
+  if (pos < 0) {
+    len += pos;
+    pos = 0;
+  }
+  if (pos + len > mio->size) {
+    len = mio->size - pos;
+  }
+#ifndef _WIN32
+  if (mio->map) {
+    /* madvise() needs a page aligned address */
+    const int64_t ps = sysconf(_SC_PAGESIZE);
+    const int64_t off = pos - (pos % ps);
+    madvise(mio->map + off, len + pos - off, MADV_WILLNEED);
+  }
+#ifdef POSIX_FADV_WILLNEED
+  else {
+    posix_fadvise(mio->fd, pos, len, POSIX_FADV_WILLNEED);
+  }
+#endif
+#endif
+
+  pthread_mutex_lock(&mio_lock);
+  mio->st->prefetch += len;
+  pthread_mutex_unlock(&mio_lock);
+}
+
+void mediaio_close(MediaIO *mio) {
+  if (!mio) {
+    return;
+  }
+  if (mio->avio) {
+    av_freep(&mio->avio->buffer);
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(57, 80, 100)
+    avio_context_free(&mio->avio);
+#else
+    av_freep(&mio->avio);
+#endif
+  }
+#ifndef _WIN32
+  if (mio->map) {
+    munmap(mio->map, mio->size);
+  }
+#endif
+  close(mio->fd);
+
+  pthread_mutex_lock(&mio_lock);
+  assert(mio->st->refcnt > 0);
+  mio->st->refcnt--;
+  mio_evict(MEDIAIO_STATS_SIZE);
+  pthread_mutex_unlock(&mio_lock);
+  free(mio);
+}
+
+void mediaio_info_html(char **m, size_t *o, size_t *s) {
+  MioStats *ms, *tmp;
+  int i = 1;
+  rprintf("<h3>Media I/O:</h3>\n");
+  if (mio_bufsize == 0) {
+    rprintf("<p>libavformat file protocol</p>\n");
+    return;
+  }
+  rprintf("<p>buffer: %"PRIlld" KiB, mmap: %s</p>\n", (long long) mio_bufsize / 1024, mio_mmap ? "yes" : "no");
+  pthread_mutex_lock(&mio_lock);
+  if (HASH_COUNT(mio_stats) > 0) {
+    rprintf("<table style=\"text-align:center;width:100%%\">\n");
+    rprintf("<tr><th>#</th><th>Filename</th><th>Open</th><th>Reads</th><th>Bytes Read</th><th>Wait</th><th>Prefetch</th><th>Mode</th></tr>\n");
+    HASH_ITER(hh, mio_stats, ms, tmp) {
+      rprintf("<tr><td>%d.</td><td class=\"left\">%s</td><td>%d / %"PRIlld"</td><td>%"PRIlld"</td><td>%.1f MiB</td><td>%.1f ms</td><td>%.1f MiB</td><td>%s</td></tr>\n",
+          i, ms->fn, ms->refcnt, (long long) ms->opens, (long long) ms->reads,
+          ms->bytes / 1048576.0, ms->wait_us / 1000.0, ms->prefetch / 1048576.0,
+          ms->mapped ? "mmap" : "read");
+      i++;
+    }
+    rprintf("</table>\n");
+  }
+  pthread_mutex_unlock(&mio_lock);
+}
+
+// vim:sw=2 sts=2 ts=8 et:
@@ -0,0 +1,66 @@
+/**
+   @file media_io.h
+   @brief buffered file I/O for the demuxer
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MEDIA_IO_H
+#define _MEDIA_IO_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MEDIAIO_BUFSIZE (256 * 1024) ///< default read buffer size
+#define MEDIAIO_STATS_SIZE 64        ///< max. number of files with I/O statistics
+
+struct AVIOContext;
+typedef struct MediaIO MediaIO;
+
+/**
+ * configure media file I/O, affects files opened afterwards.
+ * @param bufsize read buffer size in bytes, 0: use libavformat's file protocol
+ * @param use_mmap map local files into memory instead of reading them
+ */
+void mediaio_configure(size_t bufsize, int use_mmap);
+
+/**
+ * open a media file for the demuxer
+ * @param fn file name
+ * @return handle or NULL if custom I/O is disabled or the file cannot be opened
+ */
+MediaIO *mediaio_open(const char *fn);
+
+/** I/O context to assign to AVFormatContext.pb before avformat_open_input() */
+struct AVIOContext *mediaio_avio(MediaIO *mio);
+
+/**
+ * hint that the given byte range will be read soon.
+ * The kernel reads it ahead asynchronously (posix_fadvise, madvise).
+ */
+void mediaio_prefetch(MediaIO *mio, int64_t pos, int64_t len);
+
+/** close the file and free the I/O context, NULL is ignored */
+void mediaio_close(MediaIO *mio);
+
+/** HTML format per-file I/O statistics */
+void mediaio_info_html(char **m, size_t *o, size_t *s);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>     /* uint8_t */
+#include <inttypes.h>
+#include <stdlib.h>     /* calloc et al.*/
+#include <string.h>     /* memset */
+
+#include "dlog.h"
+#include "ffcompat.h"
+#include "sws_pool.h"
+
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+#include <assert.h>
+#include <pthread.h>
+
+//#define HASH_EMIT_KEYS 3
+#define HASH_FUNCTION HASH_SFH
+#include "uthash.h"
+
+typedef struct {
+  SwsKey key;
+  struct SwsContext *ctx;
+  int inuse;
+  int pooled;     ///< part of the hash, otherwise freed on release
+  uint64_t lru;   ///< sequence number of the last use
+  uint64_t uses;
+  UT_hash_handle hh;
+} SwsPoolLine;
+
+static SwsPoolLine *sws_pool = NULL;
+static pthread_mutex_t sws_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t sws_seq = 0;
+static uint64_t sws_hits = 0;
+static uint64_t sws_miss = 0;
+static uint64_t sws_evicted = 0;
+
+static void sp_free(SwsPoolLine *sl) {
+  sws_freeContext(sl->ctx);
+  free(sl);
+}
+
+/* retire least recently used idle contexts beyond SWSPOOL_SIZE
+ * NB. sws_lock must be held */
+static void sp_trim(void) {
+  while (HASH_COUNT(sws_pool) > SWSPOOL_SIZE) {
+    SwsPoolLine *sl, *tmp, *lru = NULL;
+    HASH_ITER(hh, sws_pool, sl, tmp) {
+      if (sl->inuse) continue;
+      if (!lru || sl->lru < lru->lru) lru = sl;
+    }
+    if (!lru) break;
+    HASH_DEL(sws_pool, lru);
+    sp_free(lru);
+    ++sws_evicted;
+  }
+}
+
+static struct SwsContext *sp_create(const SwsKey *k) {
+  struct SwsContext *ctx = sws_getContext(k->src_w, k->src_h, k->src_fmt,
+      k->dst_w, k->dst_h, k->dst_fmt, k->flags, NULL, NULL, NULL);
+  if (ctx && k->expand) {
+    const int *coefs = sws_getCoefficients(SWS_CS_DEFAULT);
+    sws_setColorspaceDetails(ctx, coefs, 0, coefs, 1, 0, 1 << 16, 1 << 16);
+  }
+  return ctx;
+}
+
+struct SwsContext *swspool_get(const SwsKey *k, void **handle) {
+  SwsPoolLine *sl = NULL, *tmp;
+
+  pthread_mutex_lock(&sws_lock);
+  HASH_FIND(hh, sws_pool, k, sizeof(SwsKey), sl);
+  if (sl && !sl->inuse) {
+    sl->inuse = 1;
+    sl->lru = ++sws_seq;
+    sl->uses++;
+    ++sws_hits;
+    pthread_mutex_unlock(&sws_lock);
+    *handle = sl;
+    return sl->ctx;
+  }
+  ++sws_miss;
+  pthread_mutex_unlock(&sws_lock);
+
+  /* building the filter tables is expensive, do it unlocked */
+  sl = calloc(1, sizeof(SwsPoolLine));
+  memcpy(&sl->key, k, sizeof(SwsKey));
+  if (!(sl->ctx = sp_create(k))) {
+    dlog(DLOG_ERR, "SWS: cannot create scaler context %dx%d -> %dx%d\n", k->src_w, k->src_h, k->dst_w, k->dst_h);
+    free(sl);
+    *handle = NULL;
+    return NULL;
+  }
+  sl->inuse = 1;
+  sl->uses = 1;
+
+  pthread_mutex_lock(&sws_lock);
+  sl->lru = ++sws_seq;
+  HASH_FIND(hh, sws_pool, k, sizeof(SwsKey), tmp);
+  if (!tmp) {
+    HASH_ADD(hh, sws_pool, key, sizeof(SwsKey), sl);
+    sl->pooled = 1;
+    sp_trim();
+  }
+  pthread_mutex_unlock(&sws_lock);
+  *handle = sl;
+  return sl->ctx;
+}
+
+void swspool_release(void *handle) {
+  SwsPoolLine *sl = (SwsPoolLine*) handle, *tmp;
+  if (!sl) return;
+  pthread_mutex_lock(&sws_lock);
+  sl->inuse = 0;
+  if (!sl->pooled) {
+    /* concurrent duplicate, keep it if the pooled one was retired meanwhile */
+    HASH_FIND(hh, sws_pool, &sl->key, sizeof(SwsKey), tmp);
+    if (tmp) {
+      sp_free(sl);
+    } else {
+      HASH_ADD(hh, sws_pool, key, sizeof(SwsKey), sl);
+      sl->pooled = 1;
+    }
+  }
+  sp_trim();
+  pthread_mutex_unlock(&sws_lock);
+}
+
+void swspool_clear(void) {
+  SwsPoolLine *sl, *tmp;
+  pthread_mutex_lock(&sws_lock);
+  HASH_ITER(hh, sws_pool, sl, tmp) {
+    if (sl->inuse) continue;
+    HASH_DEL(sws_pool, sl);
+    sp_free(sl);
+  }
+  pthread_mutex_unlock(&sws_lock);
+}
+
+void swspool_info_html(char **m, size_t *o, size_t *s) {
+  SwsPoolLine *sl, *tmp;
+  int i = 1;
+  pthread_mutex_lock(&sws_lock);
+  rprintf("<h3>Scaler Contexts:</h3>\n");
+  rprintf("<p>contexts: %d / %d, hits: %"PRIu64", misses: %"PRIu64", retired: %"PRIu64"</p>\n",
+      HASH_COUNT(sws_pool), SWSPOOL_SIZE, sws_hits, sws_miss, sws_evicted);
+  if (HASH_COUNT(sws_pool) > 0) {
+    rprintf("<table style=\"text-align:center;width:100%%\">\n");
+    rprintf("<tr><th>#</th><th>Source</th><th>Output</th><th>Flags</th><th>Uses</th><th>In Use</th></tr>\n");
+    HASH_ITER(hh, sws_pool, sl, tmp) {
+      const char *sf = av_get_pix_fmt_name(sl->key.src_fmt);
+      const char *df = av_get_pix_fmt_name(sl->key.dst_fmt);
+      rprintf("<tr><td>%d.</td><td>%dx%d %s</td><td>%dx%d %s</td><td>0x%x%s</td><td>%"PRIu64"</td><td>%s</td></tr>\n",
+          i, sl->key.src_w, sl->key.src_h, sf ? sf : "?",
+          sl->key.dst_w, sl->key.dst_h, df ? df : "?",
+          sl->key.flags, sl->key.expand ? " (range)" : "",
+          sl->uses, sl->inuse ? "yes" : "no");
+      i++;
+    }
+    rprintf("</table>\n");
+  }
+  pthread_mutex_unlock(&sws_lock);
+}
+
+// vim:sw=2 sts=2 ts=8 et:
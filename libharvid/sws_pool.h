@@ -0,0 +1,65 @@
+/**
+   @file sws_pool.h
+   @brief shared pool of scaler contexts
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _SWS_POOL_H
+#define _SWS_POOL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define SWSPOOL_SIZE 32 ///< max. number of idle scaler contexts
+
+struct SwsContext;
+
+/** conversion signature, identifies a scaler context */
+typedef struct {
+  int src_fmt;
+  int src_w;
+  int src_h;
+  int dst_fmt;
+  int dst_w;
+  int dst_h;
+  int flags;  ///< SWS_* algorithm
+  int expand; ///< expand video-range luma to full range
+} SwsKey;
+
+/**
+ * get a scaler context for exclusive use, a matching idle context is
+ * re-used, otherwise a new one is created.
+ * @param k conversion signature, unused fields must be zeroed
+ * @param handle set to the pool entry, pass it to \ref swspool_release
+ * @return context or NULL on error
+ */
+struct SwsContext *swspool_get(const SwsKey *k, void **handle);
+
+/** return a context obtained with \ref swspool_get to the pool */
+void swspool_release(void *handle);
+
+/** free all idle contexts, contexts in use are retained */
+void swspool_clear(void);
+
+/** HTML format pool statistics */
+void swspool_info_html(char **m, size_t *o, size_t *s);
+
+#endif
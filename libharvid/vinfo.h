@@ -40,8 +40,55 @@ typedef struct {
   int64_t frames;  ///< duration of file in frames
   size_t buffersize;      ///< size in bytes used for an image of out_width x out_height at render_rmt (VInfo)
   double file_frame_offset;
+  int packet_fmt;         ///< VPKT_* frames are stand-alone images that can be served without decoding (read-only)
+  int indexed;            ///< frame count and frame-numbers are exact, not estimated from the frame-rate (read-only)
 } VInfo;
 
+/** compressed frame formats, see \ref dctrl_get_packet */
+enum { VPKT_NONE = 0, VPKT_JPEG, VPKT_PNG };
+
+/** source region of interest, in pixels of the decoded picture */
+typedef struct {
+  int x; ///< left edge
+  int y; ///< top edge
+  int w; ///< width, 0: no cropping
+  int h; ///< height, 0: no cropping
+} VCrop;
+
+#define VCROP_ACTIVE(C) ((C) && (C)->w > 0 && (C)->h > 0)
+
+/* decoder flags, see \ref dctrl_decode */
+#define VDEC_DRAFT 1 ///< small thumbnail, the codec may decode at reduced resolution
+#define VDEC_SCALER(S) ((S) << 8) ///< scaler to use (VSCALE_*)
+#define VDEC_GET_SCALER(F) (((F) >> 8) & 0xf)
+#define VDEC_CLIENT(C) (((C) & 0x7fff) << 16) ///< requesting client, used to detect backwards stepping
+#define VDEC_GET_CLIENT(F) (((F) >> 16) & 0x7fff)
+#define VDEC_QUALITY(F) ((F) & (VDEC_DRAFT | VDEC_SCALER(0xf))) ///< flags that change the image, part of the cache keys
+
+/** scaling algorithm, part of the cache keys */
+enum {
+  VSCALE_AUTO = 0, ///< depends on the downscale ratio
+  VSCALE_FAST,
+  VSCALE_BILINEAR,
+  VSCALE_BICUBIC,
+  VSCALE_AREA,
+  VSCALE_LANCZOS
+};
+
+/** receives frames that are decoded on the way to a requested frame
+ * (after a seek to the preceding keyframe), see \ref dctrl_decode */
+typedef struct {
+  /** buffer for the given frame at the geometry and format of the request,
+   * NULL if the frame is not wanted */
+  uint8_t *(*get)(void *arg, int64_t frame);
+  /** the buffer returned by get() was filled */
+  void (*done)(void *arg, int64_t frame, uint8_t *buf);
+  void *arg;
+  int budget; ///< max. number of frames to pass on, decremented
+  int reverse_budget; ///< budget if frames are requested backwards
+  int reverse; ///< set by the decoder-control if frames are requested backwards
+} VDecodeThrough;
+
 /** initialise a VInfo struct
  * @param i VInfo struct to initialize
  */
@@ -20,16 +20,16 @@
 /* ics_request_args->render_fmt */
 enum {
   /* image output format */
-	FMT_RAW=0, FMT_JPG, FMT_PNG, FMT_PPM,
+	FMT_RAW=0, FMT_JPG, FMT_PNG, FMT_PPM, FMT_LZ4, FMT_QOI, FMT_WEBP,
   /* info output format */
-  OUT_HTML, OUT_JSON, OUT_PLAIN, OUT_CSV
+  OUT_HTML, OUT_JSON, OUT_PLAIN, OUT_CSV, OUT_BIN
 };
 
-/* http index option(s) */
-enum {OPT_FLAT=1};
+/* http index/keyframe option(s) */
+enum {OPT_FLAT=1, OPT_ALLFRAMES=2, OPT_THUMBS=4, OPT_INLINE=8};
 
 /* cfg_adminmask - binary flags */
-enum {ADM_FLUSHCACHE=1, ADM_PURGECACHE=2, ADM_SHUTDOWN=4};
+enum {ADM_FLUSHCACHE=1, ADM_PURGECACHE=2, ADM_SHUTDOWN=4, ADM_PIN=8, ADM_CONFIG=16, ADM_JOBS=32};
 
 enum {USR_INDEX=1, USR_FLATINDEX=2, USR_KEEPRAW=4, USR_WEBSEEK=8};
 
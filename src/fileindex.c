@@ -27,7 +27,9 @@
 #include <assert.h>
 
 #include <dlog.h>
+#include <image_seq.h>
 #include "httprotocol.h"
+#include "ics_handler.h"
 #include "htmlconst.h"
 #include "enums.h"
 
@@ -42,6 +44,11 @@
 extern int cfg_usermask;
 
 char *url_escape(const char *string, int inlength); // from httprotocol.c
+void hdl_render_posters (PosterJob *pj, int n, int w, int h, int want_data); // from harvid.c
+
+#define MAX_POSTERS (512)  ///< max. number of thumbnails pre-rendered per request
+#define THUMB_WIDTH (160)  ///< default thumbnail width
+#define MIN_SEQ_FILES (2)  ///< numbered images listed as a sequence
 
 char *str_escape(const char *string, int inlength, const char esc) {
   char *ns;
@@ -194,16 +201,13 @@ static void print_json (int what, const char *burl, const char *path, const char
 }
 
 
-static void parse_direntry (const char *root, const char *burl, const char *path, const char *name, 
-    time_t mtime, int opt,
-    char **m, size_t *o, size_t *s, int *num,
-    void (*print_fn)(const int what, const char*, const char*, const char*, time_t, char**, size_t*, size_t*, int *) ) {
+static int is_video_file (const char *name) {
   const int l3 = strlen(name) - 3;
   const int l4 = l3 - 1;
   const int l5 = l4 - 1;
   const int l6 = l5 - 1;
   const int l9 = l6 - 3;
-  if ((l4 > 0 && ( !strcasecmp(&name[l4], ".avi")
+  return ((l4 > 0 && ( !strcasecmp(&name[l4], ".avi")
                 || !strcasecmp(&name[l4], ".mov")
                 || !strcasecmp(&name[l4], ".ogg")
                 || !strcasecmp(&name[l4], ".ogv")
@@ -228,10 +232,48 @@ static void parse_direntry (const char *root, const char *burl, const char *path
       (l3 > 0 && ( !strcasecmp(&name[l3], ".dv")
                 || !strcasecmp(&name[l3], ".ts")
         ))
-     ) {
-    char *url = strdup(burl);
-    char *vurl = strstr(url, "/index"); // TODO - do once per dir.
-    if (vurl) *++vurl = 0;
+     );
+}
+
+typedef struct {
+  char *name;   ///< sequence pattern
+  time_t mtime; ///< most recent modification of any file
+  int count;
+} SeqEntry;
+
+/* group numbered images of a directory by their sequence pattern */
+static void seq_collect (SeqEntry **se, int *n, const char *name, time_t mtime) {
+  int i;
+  char *pat = imgseq_pattern(name);
+  if (!pat) return;
+  for (i = 0; i < *n; ++i) {
+    if (strcmp((*se)[i].name, pat)) continue;
+    if (mtime > (*se)[i].mtime) (*se)[i].mtime = mtime;
+    (*se)[i].count++;
+    free(pat);
+    return;
+  }
+  *se = realloc(*se, (*n + 1) * sizeof(SeqEntry));
+  (*se)[*n].name = pat;
+  (*se)[*n].mtime = mtime;
+  (*se)[*n].count = 1;
+  (*n)++;
+}
+
+/* base URL of the server, strip "index/..." from the given index URL */
+static char *server_url (const char *burl) {
+  char *url = strdup(burl);
+  char *vurl = strstr(url, "/index");
+  if (vurl) *++vurl = 0;
+  return url;
+}
+
+static void parse_direntry (const char *root, const char *burl, const char *path, const char *name, 
+    time_t mtime, int opt,
+    char **m, size_t *o, size_t *s, int *num,
+    void (*print_fn)(const int what, const char*, const char*, const char*, time_t, char**, size_t*, size_t*, int *) ) {
+  if (is_video_file(name) || imgseq_is_pattern(name)) {
+    char *url = server_url(burl); // TODO - do once per dir.
     print_fn(1, url, path, name, mtime, m, o, s, num);
     free(url);
   }
@@ -243,6 +285,8 @@ static int parse_dir (const int fd, const char *root, const char *burl, const ch
   DIR  *D;
   struct dirent *dd;
   char dn[MAX_PATH];
+  SeqEntry *se = NULL;
+  int i, ns = 0;
   int rv = 0;
   snprintf(dn, MAX_PATH, "%s%s%s", root, SL_SEP(root), path);
 
@@ -294,15 +338,210 @@ static int parse_dir (const int fd, const char *root, const char *burl, const ch
           S_ISLNK(fs.st_mode) ||
 #endif
           S_ISREG(fs.st_mode)) {
-        parse_direntry(root, burl, path, dd->d_name, fs.st_mtime, opt, m, o, s, num, print_fn);
+        if (imgseq_is_image(dd->d_name)) {
+          seq_collect(&se, &ns, dd->d_name, fs.st_mtime);
+        } else {
+          parse_direntry(root, burl, path, dd->d_name, fs.st_mtime, opt, m, o, s, num, print_fn);
+        }
       }
     }
   }
   closedir(D);
+
+  for (i = 0; i < ns; ++i) {
+    if (rv == 0 && se[i].count >= MIN_SEQ_FILES) {
+      parse_direntry(root, burl, path, se[i].name, se[i].mtime, opt, m, o, s, num, print_fn);
+    }
+    free(se[i].name);
+  }
+  free(se);
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// thumbnail index
+
+static char *base64_encode (const uint8_t *d, size_t len) {
+  static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  char *rv = malloc(4 * ((len + 2) / 3) + 1);
+  char *p = rv;
+  size_t i;
+  for (i = 0; i + 2 < len; i += 3) {
+    *p++ = b64[d[i] >> 2];
+    *p++ = b64[((d[i] & 0x03) << 4) | (d[i+1] >> 4)];
+    *p++ = b64[((d[i+1] & 0x0f) << 2) | (d[i+2] >> 6)];
+    *p++ = b64[d[i+2] & 0x3f];
+  }
+  if (i < len) {
+    *p++ = b64[d[i] >> 2];
+    if (i + 1 < len) {
+      *p++ = b64[((d[i] & 0x03) << 4) | (d[i+1] >> 4)];
+      *p++ = b64[(d[i+1] & 0x0f) << 2];
+    } else {
+      *p++ = b64[(d[i] & 0x03) << 4];
+      *p++ = '=';
+    }
+    *p++ = '=';
+  }
+  *p = '\0';
   return rv;
 }
 
-void hdl_index_dir (int fd, const char *root, char *base_url, char *path, int fmt, int opt) {
+typedef struct {
+  char *name;
+  time_t mtime;
+} ThumbEntry;
+
+static int cmp_thumb (const void *a, const void *b) {
+  return strcmp(((const ThumbEntry*)a)->name, ((const ThumbEntry*)b)->name);
+}
+
+static void print_thumb (int fmt, const char *url, const char *path, const ThumbEntry *te,
+    int tw, int th, const PosterJob *pj, int opt,
+    char **m, size_t *o, size_t *s, int *num) {
+  char *u1, *u2, *c1, *b64 = NULL;
+  const char *name = te->name;
+  u1 = url_escape(path, 0);
+  u2 = url_escape(name, 0);
+
+  if ((opt & OPT_INLINE) && pj && pj->status == 0 && pj->data) {
+    b64 = base64_encode(pj->data, pj->len);
+  }
+
+  switch (fmt) {
+    case OUT_PLAIN:
+      rprintf("f %s?file=%s%s%s %s?frame=0&w=%d&h=%d&format=jpeg&file=%s%s%s\n",
+          url, u1, SL_SEP(path), u2, url, tw, th, u1, SL_SEP(path), u2);
+      break;
+    case OUT_CSV:
+      c1 = str_escape(name, 0, '"');
+      rprintf("F,\"%s\",\"%s%s%s\",\"%s\",%"PRIlld",\"%s?frame=0&w=%d&h=%d&format=jpeg&file=%s%s%s\"",
+          url, u1, SL_SEP(path), u2, c1, (long long) te->mtime, url, tw, th, u1, SL_SEP(path), u2);
+      if (b64) {
+        rprintf(",\"data:image/jpeg;base64,%s\"", b64);
+      }
+      rprintf("\n");
+      free(c1);
+      break;
+    case OUT_JSON:
+      c1 = str_escape(name, 0, '\\');
+      rprintf("%s{\"type\":\"file\", \"baseurl\":\"%s\", \"file\":\"%s%s%s\", \"name\":\"%s\", \"mtime\":%"PRIlld,
+          (*num > 0) ? ", ":"", url, u1, SL_SEP(path), u2, c1, (long long) te->mtime);
+      rprintf(", \"poster\":\"%s?frame=0&w=%d&h=%d&format=jpeg&file=%s%s%s\"", url, tw, th, u1, SL_SEP(path), u2);
+      if (b64) {
+        rprintf(", \"poster_data\":\"data:image/jpeg;base64,%s\"", b64);
+      }
+      rprintf("}");
+      free(c1);
+      break;
+    default:
+      rprintf("<li style=\"width:%dpx;\"><a href=\"%s%s?frame=0&amp;file=%s%s%s\">",
+          tw > 0 ? tw : THUMB_WIDTH, url, (cfg_usermask & USR_WEBSEEK) ? "seek" : "", u1, SL_SEP(path), u2);
+      if (b64) {
+        rprintf("<img src=\"data:image/jpeg;base64,%s\" alt=\"\"/>", b64);
+      } else {
+        rprintf("<img src=\"%s?frame=0&amp;w=%d&amp;h=%d&amp;format=jpeg&amp;file=%s%s%s\" alt=\"\"/>",
+            url, tw, th, u1, SL_SEP(path), u2);
+      }
+      rprintf("</a><br/>%s [<a href=\"%sinfo?file=%s%s%s&amp;format=html\">info</a>]</li>\n",
+          name, url, u1, SL_SEP(path), u2);
+      break;
+  }
+  free(b64);
+  free(u1);
+  free(u2);
+  (*num)++;
+}
+
+/* list a single directory with poster thumbnails for all video files.
+ * Thumbnails are rendered in parallel into the image-cache before the
+ * listing is sent, so that subsequent image requests are cache hits.
+ */
+static int index_thumbs (const char *root, const char *burl, const char *path, int fmt, int opt, int tw, int th,
+    char **m, size_t *o, size_t *s, int *num,
+    void (*print_fn)(const int what, const char*, const char*, const char*, time_t, char**, size_t*, size_t*, int *) ) {
+  DIR  *D;
+  struct dirent *dd;
+  char dn[MAX_PATH];
+  ThumbEntry *te = NULL;
+  SeqEntry *se = NULL;
+  PosterJob *pj;
+  int i, n = 0, ns = 0, np;
+  char *url;
+
+  snprintf(dn, MAX_PATH, "%s%s%s", root, SL_SEP(root), path);
+  debugmsg(DEBUG_ICS, "IndexDir: thumbnails '%s'\n", dn);
+  if (!(D = opendir (dn)))  {
+    dlog(LOG_WARNING, "IndexDir: could not open dir '%s'\n", dn);
+    return -1;
+  }
+
+  while ((dd = readdir (D))) {
+    struct stat fs;
+    char rn[MAX_PATH];
+    if (dd->d_name[0] == '.') continue;
+    snprintf(rn, MAX_PATH, "%s/%s", dn, dd->d_name);
+    if (stat(rn, &fs)) continue;
+    if (S_ISDIR(fs.st_mode)) {
+      print_fn(0, burl, path, dd->d_name, fs.st_mtime, m, o, s, num);
+    } else if (S_ISREG(fs.st_mode) && is_video_file(dd->d_name)) {
+      te = realloc(te, (n + 1) * sizeof(ThumbEntry));
+      te[n].name = strdup(dd->d_name);
+      te[n].mtime = fs.st_mtime;
+      ++n;
+    } else if (S_ISREG(fs.st_mode) && imgseq_is_image(dd->d_name)) {
+      seq_collect(&se, &ns, dd->d_name, fs.st_mtime);
+    }
+  }
+  closedir(D);
+
+  /* an image sequence is listed like a video file */
+  for (i = 0; i < ns; ++i) {
+    if (se[i].count < MIN_SEQ_FILES) {
+      free(se[i].name);
+      continue;
+    }
+    te = realloc(te, (n + 1) * sizeof(ThumbEntry));
+    te[n].name = se[i].name;
+    te[n].mtime = se[i].mtime;
+    ++n;
+  }
+  free(se);
+
+  if (n > 0) {
+    qsort(te, n, sizeof(ThumbEntry), cmp_thumb);
+  }
+
+  np = n > MAX_POSTERS ? MAX_POSTERS : n;
+  pj = calloc(np > 0 ? np : 1, sizeof(PosterJob));
+  for (i = 0; i < np; ++i) {
+    /* same as the file-name of a frame request (docroot + query) */
+    pj[i].file_name = malloc(strlen(root) + strlen(path) + strlen(te[i].name) + 2);
+    sprintf(pj[i].file_name, "%s%s%s%s", root, path, SL_SEP(path), te[i].name);
+#ifdef HAVE_WINDOWS
+    char *tmp;
+    while (tmp = strchr(pj[i].file_name, '/')) *tmp = '\\';
+#endif
+  }
+
+  hdl_render_posters(pj, np, tw, th, opt & OPT_INLINE);
+
+  url = server_url(burl);
+  for (i = 0; i < n; ++i) {
+    print_thumb(fmt, url, path, &te[i], tw, th, i < np ? &pj[i] : NULL, opt, m, o, s, num);
+    free(te[i].name);
+  }
+  for (i = 0; i < np; ++i) {
+    free(pj[i].file_name);
+    free(pj[i].data);
+  }
+  free(url);
+  free(pj);
+  free(te);
+  return 0;
+}
+
+void hdl_index_dir (int fd, const char *root, char *base_url, char *path, int fmt, int opt, int tw, int th) {
   size_t off = 0;
   size_t ss = 1024;
   char *sm = malloc(ss * sizeof(char));
@@ -311,6 +550,8 @@ void hdl_index_dir (int fd, const char *root, char *base_url, char *path, int fm
   int num = 0;
   sm[0] = '\0';
 
+  if (tw <= 0 && th <= 0) tw = THUMB_WIDTH;
+
   switch (fmt) {
     case OUT_PLAIN:
       break;
@@ -351,20 +592,39 @@ void hdl_index_dir (int fd, const char *root, char *base_url, char *path, int fm
     }
   }
 
+  if (opt & OPT_THUMBS) {
+    void (*print_fn)(const int, const char*, const char*, const char*, time_t, char**, size_t*, size_t*, int *);
+    switch (fmt) {
+      case OUT_PLAIN: print_fn = print_plain; break;
+      case OUT_JSON:  print_fn = print_json; break;
+      case OUT_CSV:   print_fn = print_csv; break;
+      default:        print_fn = print_html; break;
+    }
+    index_thumbs(root, base_url, path, fmt, opt, tw, th, &sm, &off, &ss, &num, print_fn);
+  }
+
   switch (fmt) {
     case OUT_PLAIN:
-      parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_plain);
+      if (!(opt & OPT_THUMBS)) {
+        parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_plain);
+      }
       raprintf(sm, off, ss, "# total: %d\n", num);
       break;
     case OUT_JSON:
-      parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_json);
+      if (!(opt & OPT_THUMBS)) {
+        parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_json);
+      }
       raprintf(sm, off, ss, "]}");
       break;
     case OUT_CSV:
-      parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_csv);
+      if (!(opt & OPT_THUMBS)) {
+        parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_csv);
+      }
       break;
     default:
-      parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_html);
+      if (!(opt & OPT_THUMBS)) {
+        parse_dir(fd, root, base_url, path, opt, &sm, &off, &ss, &num, print_html);
+      }
       raprintf(sm, off, ss, "</ul><div style=\"clear:both;\"></div>\n<p>Total Entries: %d</p>\n", num);
       raprintf(sm, off, ss, "<hr/><div style=\"text-align:center; color:#888;\">"SERVERVERSION"</div>");
       raprintf(sm, off, ss, "</body>\n</html>");
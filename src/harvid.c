@@ -32,9 +32,13 @@
 
 #include <harvid.h>
 #include "image_format.h"
+#include "parallel.h"
+#include "raw_delta.h"
+#include "jobs.h"
 #include "enums.h"
 
 #include "ffcompat.h"
+#include <libavutil/pixdesc.h>
 
 #ifndef HAVE_WINDOWS
 #include <arpa/inet.h> // inet_addr
@@ -64,6 +68,19 @@ char *cfg_chroot = NULL;
 char *cfg_username = NULL;
 char *cfg_groupname = NULL;
 int   initial_cache_size = 128;
+int   cfg_icache_size = 0;  // 0: 4 * initial_cache_size
+int   cfg_filemap_size = 0; // 0: initial_cache_size
+int   cfg_pinbudget = 256; // MiB
+int   cfg_cpubudget = 0; // codec threads of all decoders, 0: auto
+int   cfg_decodethrough = 0; // intermediate frames cached per seek, 0: off
+int   cfg_reversebudget = 64; // MiB cached per GOP when stepping backwards, 0: off
+int   cfg_iobuffer = 256; // KiB read buffer per open file, 0: libavformat's file I/O
+int   cfg_mmap = 0;
+int   cfg_seqfps_num = 25; // frame-rate of image sequences
+int   cfg_seqfps_den = 1;
+long long cfg_seqstart = -1; // first file-number of image sequences, -1: lowest present
+char *cfg_indexdir = NULL;
+char *cfg_configfile = NULL;
 int   max_decoder_threads = 8;
 unsigned short  cfg_port = DEFAULT_PORT;
 unsigned int    cfg_host = 0; /* = htonl(INADDR_ANY) */
@@ -83,14 +100,41 @@ static void usage (int status) {
 "                             space separated list of allowed admin commands.\n"
 "                             An exclamation-mark before a command disables it.\n"
 "                             default: 'flush_cache';\n"
-"                             available: flush_cache, purge_cache, shutdown\n"
+"                             available: flush_cache, purge_cache, pin, config,\n"
+"                             jobs, shutdown\n"
+"  -B <MiB>, --pin-budget <MiB>\n"
+"                             memory of pinned frames (and likewise pinned\n"
+"                             encoded images) that is exempt from cache\n"
+"                             eviction (default: 256)\n"
+"  -b <KiB>, --io-buffer <KiB>\n"
+"                             read buffer of each open video-file, GOPs are\n"
+"                             read ahead when seeking with a frame index\n"
+"                             (default: 256, 0: use libavformat's file I/O)\n"
 "  -c <path>, --chroot <path>\n"
 "                             change system root - jails server to this path\n"
 "  -C <frames>                set initial frame-cache size (default: 128)\n"
 "  -D, --daemonize            fork into background and detach from TTY\n"
+"  -f <path>, --config <path>\n"
+"                             read cache and decoder limits from this file,\n"
+"                             the file is re-read when SIGHUP is received\n"
 "  -g <name>, --groupname <name>\n"
 "                             assume this user-group\n"
 "  -h, --help                 display this help and exit\n"
+"  -I <path>, --index-dir <path>\n"
+"                             keep frame indices of scanned files in this\n"
+"                             directory (outside the docroot), so that they\n"
+"                             need not be re-built after a restart\n"
+"  -j <num>, --cpu-budget <num>\n"
+"                             total number of codec threads, shared equally\n"
+"                             by busy decoders (default: 0, number of CPUs)\n"
+"  -r <MiB>, --reverse-budget <MiB>\n"
+"                             when frames are requested backwards, decode\n"
+"                             the preceding frames of the GOP once and cache\n"
+"                             up to this amount of them (default: 64, 0: off)\n"
+"  -R <frames>, --decode-through <frames>\n"
+"                             cache up to this many frames that are decoded\n"
+"                             between a keyframe and a requested frame, if\n"
+"                             the frame-cache has room (default: 0, off)\n"
 "  -F <feat>, --features <feat>\n"
 "                             space separated list of optional features.\n"
 "                             An exclamation-mark before a features disables it.\n"
@@ -98,11 +142,18 @@ static void usage (int status) {
 "                             available: index, seek, flatindex, keepraw\n"
 "  -l <path>, --logfile <path>\n"
 "                             specify file for log messages\n"
+"  -m, --mmap                 map video-files into memory instead of reading\n"
+"                             them (local files, requires --io-buffer > 0)\n"
 "  -M, --memlock              attempt to lock memory (prevent cache paging)\n"
+"  -N <num>, --seq-start <num>\n"
+"                             file-number of the first frame of image\n"
+"                             sequences (default: -1, lowest number present)\n"
 "  -p <num>, --port <num>     TCP port to listen on (default %i)\n"
 "  -P <listenaddr>            IP address to listen on (default 0.0.0.0)\n"
 "  -q, --quiet, --silent      inhibit usual output (may be used thrice)\n"
 "  -s, --syslog               send messages to syslog\n"
+"  -S <fps>, --seq-fps <fps>  frame-rate of image sequences, e.g. 24,\n"
+"                             23.976 or 24000/1001 (default: 25)\n"
 "  -t <thread-limit>          set maximum decoder-threads (default: 8)\n"
 "  -T <sec>, --timeout <secs>\n"
 "                             set a timeout after which the server will\n"
@@ -130,6 +181,35 @@ static void usage (int status) {
 "encoded image are kept in cache. The default is to invaldate the RGB frame\n"
 "after encoding the image.\n"
 "\n"
+"The config file consists of 'key = value' lines, '#' starts a comment.\n"
+"Available keys: cache-size (frames), image-cache-size (images),\n"
+"decoders, file-cache-size (files), pin-budget (MiB), cpu-budget\n"
+"(codec threads), decode-through (frames) and reverse-budget (MiB).\n"
+"They override the corresponding command-line options.\n"
+"The same keys are accepted as query parameters by /admin/config\n"
+"(enabled with -A config). Without a config file SIGHUP terminates\n"
+"the server.\n"
+"Shrinking a cache evicts least recently used entries only.\n"
+"\n"
+"A decoder uses cpu-budget / busy decoders codec threads. Decoders\n"
+"start with slice-threading for low seek latency and switch to\n"
+"frame-threading when frames are requested sequentially.\n"
+"\n"
+"Numbered images (dpx, exr, tif, png, jpg, bmp, tga) in a directory are\n"
+"listed as one video: the file-name with '#' in place of the frame-number,\n"
+"e.g. 'plate.####.dpx'. Every frame is read from its own file and decoded\n"
+"independently.\n"
+"\n"
+"The 'pin' admin command enables /admin/pin and /admin/unpin which keep\n"
+"the frames of a file (or a frame-range, geometry, format) in cache\n"
+"regardless of the cache-size, up to the --pin-budget.\n"
+"\n"
+"The 'jobs' admin command enables /admin/jobs: a POST with file=PATH\n"
+"parameters, an interval= (frames, or seconds with a 's' suffix) and\n"
+"sizes=WxH,... queues a background job that renders thumbnails into the\n"
+"image-cache using spare decoders only. /admin/jobs/ID reports progress\n"
+"and /admin/jobs/ID/cancel stops it.\n"
+"\n"
 "Examples:\n"
 "harvid -A '!flush_cache purge_cache shutdown' -C 256 /tmp/\n"
 "\n"
@@ -145,20 +225,30 @@ static void usage (int status) {
 static struct option const long_options[] =
 {
   {"admin", required_argument, 0, 'A'},
+  {"pin-budget", required_argument, 0, 'B'},
+  {"io-buffer", required_argument, 0, 'b'},
   {"chroot", required_argument, 0, 'c'},
   {"cache-size", required_argument, 0, 'C'},
+  {"config", required_argument, 0, 'f'},
   {"debug", required_argument, 0, 'd'},
   {"daemonize", no_argument, 0, 'D'},
   {"groupname", required_argument, 0, 'g'},
   {"help", no_argument, 0, 'h'},
+  {"index-dir", required_argument, 0, 'I'},
+  {"cpu-budget", required_argument, 0, 'j'},
+  {"reverse-budget", required_argument, 0, 'r'},
+  {"decode-through", required_argument, 0, 'R'},
   {"features", required_argument, 0, 'F'},
   {"logfile", required_argument, 0, 'l'},
+  {"mmap", no_argument, 0, 'm'},
   {"memlock", no_argument, 0, 'M'},
+  {"seq-start", required_argument, 0, 'N'},
   {"port", required_argument, 0, 'p'},
   {"listenip", required_argument, 0, 'P'},
   {"quiet", no_argument, 0, 'q'},
   {"silent", no_argument, 0, 'q'},
   {"syslog", no_argument, 0, 's'},
+  {"seq-fps", required_argument, 0, 'S'},
   {"timeout", required_argument, 0, 'T'},
   {"username", required_argument, 0, 'u'},
   {"verbose", no_argument, 0, 'v'},
@@ -173,19 +263,29 @@ static int decode_switches (int argc, char **argv) {
   int c;
   while ((c = getopt_long (argc, argv,
          "A:"	/* admin */
+         "B:"	/* pin budget */
+         "b:"	/* io buffer */
          "c:"	/* chroot-dir */
          "C:" 	/* initial cache size */
          "d:"	/* debug */
          "D"	/* daemonize */
+         "f:"	/* config file */
          "g:"	/* setGroup */
          "h"	/* help */
+         "I:"	/* index-dir */
+         "j:"	/* cpu budget */
          "F:"	/* interaction */
          "l:"	/* logfile */
+         "m"	/* mmap */
          "M"	/* memlock */
+         "N:"	/* image sequence start */
          "p:"	/* port */
          "P:"	/* IP */
+         "r:"	/* reverse budget */
+         "R:"	/* decode-through */
          "q"	/* quiet or silent */
          "s"	/* syslog */
+         "S:"	/* image sequence fps */
          "t:"	/* threads */
          "T:"	/* timeout */
          "u:"	/* setUser */
@@ -213,13 +313,27 @@ static int decode_switches (int argc, char **argv) {
         if (strstr(optarg, "shutdown")) cfg_adminmask|=ADM_SHUTDOWN;
         if (strstr(optarg, "purge_cache")) cfg_adminmask|=ADM_PURGECACHE;
         if (strstr(optarg, "flush_cache")) cfg_adminmask|=ADM_FLUSHCACHE;
+        if (strstr(optarg, "pin")) cfg_adminmask|=ADM_PIN;
+        if (strstr(optarg, "config")) cfg_adminmask|=ADM_CONFIG;
+        if (strstr(optarg, "jobs")) cfg_adminmask|=ADM_JOBS;
         if (strstr(optarg, "!shutdown")) cfg_adminmask&=~ADM_SHUTDOWN;
         if (strstr(optarg, "!purge_cache")) cfg_adminmask&=~ADM_PURGECACHE;
         if (strstr(optarg, "!flush_cache")) cfg_adminmask&=~ADM_FLUSHCACHE;
+        if (strstr(optarg, "!pin")) cfg_adminmask&=~ADM_PIN;
+        if (strstr(optarg, "!config")) cfg_adminmask&=~ADM_CONFIG;
+        if (strstr(optarg, "!jobs")) cfg_adminmask&=~ADM_JOBS;
+        break;
+      case 'B':		/* --pin-budget */
+        cfg_pinbudget = atoi(optarg);
+        if (cfg_pinbudget < 0 || cfg_pinbudget > 65536)
+          cfg_pinbudget = 256;
         break;
       case 'c':		/* --chroot */
         cfg_chroot = optarg;
         break;
+      case 'f':		/* --config */
+        cfg_configfile = optarg;
+        break;
       case 'C':
         initial_cache_size = atoi(optarg);
         if (initial_cache_size < 2 || initial_cache_size > 65535)
@@ -287,6 +401,43 @@ static int decode_switches (int argc, char **argv) {
       case 'V':
         printversion();
         exit(0);
+      case 'I':		/* --index-dir */
+        cfg_indexdir = optarg;
+        break;
+      case 'b':		/* --io-buffer */
+        cfg_iobuffer = atoi(optarg);
+        if (cfg_iobuffer < 0 || cfg_iobuffer > 65536)
+          cfg_iobuffer = 256;
+        break;
+      case 'm':		/* --mmap */
+        cfg_mmap = 1;
+        break;
+      case 'N':		/* --seq-start */
+        cfg_seqstart = atoll(optarg);
+        if (cfg_seqstart < -1)
+          cfg_seqstart = -1;
+        break;
+      case 'S':		/* --seq-fps */
+        if (imgseq_parse_rate(optarg, &cfg_seqfps_num, &cfg_seqfps_den)) {
+          cfg_seqfps_num = 25;
+          cfg_seqfps_den = 1;
+        }
+        break;
+      case 'j':		/* --cpu-budget */
+        cfg_cpubudget = atoi(optarg);
+        if (cfg_cpubudget < 0 || cfg_cpubudget > 1024)
+          cfg_cpubudget = 0;
+        break;
+      case 'r':		/* --reverse-budget */
+        cfg_reversebudget = atoi(optarg);
+        if (cfg_reversebudget < 0 || cfg_reversebudget > 65536)
+          cfg_reversebudget = 64;
+        break;
+      case 'R':		/* --decode-through */
+        cfg_decodethrough = atoi(optarg);
+        if (cfg_decodethrough < 0 || cfg_decodethrough > 1024)
+          cfg_decodethrough = 0;
+        break;
       case 'h':
         usage (0);
       default:
@@ -303,6 +454,138 @@ void *dc = NULL; // decoder control
 void *vc = NULL; // video frame cache
 void *ic = NULL; // encoded image cache
 
+/* limits that can be changed at runtime, -1: unchanged */
+typedef struct {
+  int cache_size;  // frame-cache, number of frames
+  int icache_size; // image-cache, number of images
+  int decoders;
+  int files;       // file-map size
+  int pin_budget;  // MiB
+  int cpu_budget;  // codec threads, 0: auto
+  int decode_through; // frames, 0: off
+  int reverse_budget; // MiB, 0: off
+} RuntimeConf;
+
+static void rc_init(RuntimeConf *rc) {
+  rc->cache_size = rc->icache_size = rc->decoders = rc->files = rc->pin_budget = rc->cpu_budget = rc->decode_through = rc->reverse_budget = -1;
+}
+
+static int rc_value(const char *key, const char *val, int min, int max) {
+  char *end;
+  long v = strtol(val, &end, 10);
+  if (end == val || *end != '\0' || v < min || v > max) {
+    dlog(DLOG_WARNING, "CFG: invalid value for '%s': '%s' (%d..%d)\n", key, val, min, max);
+    return -1;
+  }
+  return v;
+}
+
+/* parse a single setting
+ * @return 0 on success, -1 if the key is unknown or the value out of range */
+static int rc_setting(RuntimeConf *rc, const char *key, const char *val) {
+  int *dst;
+  int v;
+  if      (!strcmp(key, "cache-size"))       { dst = &rc->cache_size;  v = rc_value(key, val, 2, 65535); }
+  else if (!strcmp(key, "image-cache-size")) { dst = &rc->icache_size; v = rc_value(key, val, 2, 262140); }
+  else if (!strcmp(key, "decoders"))         { dst = &rc->decoders;    v = rc_value(key, val, 2, 128); }
+  else if (!strcmp(key, "file-cache-size"))  { dst = &rc->files;       v = rc_value(key, val, 2, 65535); }
+  else if (!strcmp(key, "pin-budget"))       { dst = &rc->pin_budget;  v = rc_value(key, val, 0, 65536); }
+  else if (!strcmp(key, "cpu-budget"))       { dst = &rc->cpu_budget;  v = rc_value(key, val, 0, 1024); }
+  else if (!strcmp(key, "decode-through"))   { dst = &rc->decode_through; v = rc_value(key, val, 0, 1024); }
+  else if (!strcmp(key, "reverse-budget"))   { dst = &rc->reverse_budget; v = rc_value(key, val, 0, 65536); }
+  else {
+    dlog(DLOG_WARNING, "CFG: unknown setting '%s'\n", key);
+    return -1;
+  }
+  if (v < 0) return -1;
+  *dst = v;
+  return 0;
+}
+
+static char *rc_trim(char *s) {
+  char *e;
+  while (*s == ' ' || *s == '\t') ++s;
+  e = s + strlen(s);
+  while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r' || e[-1] == '\n')) *--e = '\0';
+  return s;
+}
+
+/* read 'key = value' lines
+ * @return 0 on success, -1 if the file cannot be read */
+static int rc_read_file(const char *fn, RuntimeConf *rc) {
+  char line[256];
+  int lineno = 0;
+  FILE *f = fopen(fn, "r");
+  if (!f) {
+    dlog(DLOG_ERR, "CFG: cannot read config file '%s'\n", fn);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f)) {
+    char *sep, *hash;
+    ++lineno;
+    if ((hash = strchr(line, '#'))) *hash = '\0';
+    if (strlen(rc_trim(line)) == 0) continue;
+    if (!(sep = strchr(line, '='))) {
+      dlog(DLOG_WARNING, "CFG: %s:%d: expected 'key = value'\n", fn, lineno);
+      continue;
+    }
+    *sep = '\0';
+    rc_setting(rc, rc_trim(line), rc_trim(sep + 1));
+  }
+  fclose(f);
+  return 0;
+}
+
+/* apply settings, caches and decoders are resized if they exist already */
+static void rc_apply(const RuntimeConf *rc) {
+  if (rc->cache_size > 0)  initial_cache_size = rc->cache_size;
+  if (rc->icache_size > 0) cfg_icache_size = rc->icache_size;
+  if (rc->decoders > 0)    max_decoder_threads = rc->decoders;
+  if (rc->files > 0)       cfg_filemap_size = rc->files;
+  if (rc->pin_budget >= 0) cfg_pinbudget = rc->pin_budget;
+  if (rc->cpu_budget >= 0) cfg_cpubudget = rc->cpu_budget;
+  if (rc->decode_through >= 0) cfg_decodethrough = rc->decode_through;
+  if (rc->reverse_budget >= 0) cfg_reversebudget = rc->reverse_budget;
+
+  if (vc && rc->cache_size > 0) {
+    vcache_resize(&vc, rc->cache_size);
+  }
+  if (ic && rc->icache_size > 0) {
+    icache_resize(ic, rc->icache_size);
+  }
+  if (dc && (rc->decoders > 0 || rc->files > 0)) {
+    dctrl_resize(dc, rc->decoders > 0 ? rc->decoders : 0, rc->files > 0 ? rc->files : 0);
+  }
+  if (vc && ic && rc->pin_budget >= 0) {
+    vcache_pin_budget(vc, (size_t) cfg_pinbudget * 1048576);
+    icache_pin_budget(ic, (size_t) cfg_pinbudget * 1048576);
+  }
+  if (dc && rc->cpu_budget >= 0) {
+    dctrl_set_cpu_budget(dc, cfg_cpubudget);
+  }
+  if (vc && rc->decode_through >= 0) {
+    vcache_decode_through(vc, cfg_decodethrough);
+  }
+  if (vc && rc->reverse_budget >= 0) {
+    vcache_reverse_budget(vc, (size_t) cfg_reversebudget * 1048576);
+  }
+}
+
+/* called by the socket-server on SIGHUP */
+int protocol_reload (void *d) {
+  RuntimeConf rc;
+  if (!cfg_configfile) {
+    return -1; // terminate
+  }
+  rc_init(&rc);
+  if (rc_read_file(cfg_configfile, &rc)) {
+    return 0; // keep running with the current configuration
+  }
+  rc_apply(&rc);
+  dlog(DLOG_INFO, "CFG: reloaded '%s'\n", cfg_configfile);
+  return 0;
+}
+
 int main (int argc, char **argv) {
   program_name = argv[0];
   struct stat sb;
@@ -324,7 +607,15 @@ int main (int argc, char **argv) {
   else if (docroot && i==argc) ; // use default
   else usage(1);
 
-  // TODO read additional rc file (from options)
+  if (cfg_configfile) {
+    RuntimeConf rc;
+    rc_init(&rc);
+    if (rc_read_file(cfg_configfile, &rc)) {
+      exitstatus = -1;
+      goto errexit;
+    }
+    rc_apply(&rc);
+  }
 
   if (cfg_daemonize && !cfg_logfile && !cfg_syslog) {
     dlog(DLOG_WARNING, "daemonizing without log file or syslog.\n");
@@ -344,6 +635,26 @@ int main (int argc, char **argv) {
   cfg_uid = resolve_uid(cfg_username);
   cfg_gid = resolve_gid(cfg_groupname);
 
+#ifndef HAVE_WINDOWS
+  if (cfg_configfile) {
+    /* SIGHUP re-reads the file after daemonize() changed the working
+     * directory and after chroot(): use the absolute path, relative
+     * to the chroot directory if one is used. */
+    char *abs = realpath(cfg_configfile, NULL);
+    char *root = cfg_chroot ? realpath(cfg_chroot, NULL) : NULL;
+    if (abs && root && strcmp(root, "/")) {
+      const size_t rl = strlen(root);
+      if (!strncmp(abs, root, rl) && abs[rl] == '/') {
+        memmove(abs, abs + rl, strlen(abs + rl) + 1);
+      } else {
+        dlog(DLOG_WARNING, "config file '%s' is outside the chroot, it cannot be reloaded\n", abs);
+      }
+    }
+    if (abs) cfg_configfile = abs;
+    free(root);
+  }
+#endif
+
   if (cfg_chroot) {
     if (do_chroot(cfg_chroot)) {exitstatus = -1; goto errexit;}
   }
@@ -359,17 +670,49 @@ int main (int argc, char **argv) {
     goto errexit;
   }
 
+  if (cfg_indexdir) {
+    if (stat(cfg_indexdir, &sb) || !S_ISDIR(sb.st_mode)) {
+      dlog(DLOG_CRIT, "index-dir '%s' is not a directory\n", cfg_indexdir);
+      exitstatus = -1;
+      goto errexit;
+    }
+    if (access(cfg_indexdir, W_OK)) {
+      dlog(DLOG_WARNING, "index-dir '%s' is not writable, indices are only read\n", cfg_indexdir);
+    }
+    if (strlen(docroot) > 0 && strncmp(cfg_indexdir, docroot, strlen(docroot)) == 0) {
+      dlog(DLOG_WARNING, "index-dir '%s' is inside the document-root\n", cfg_indexdir);
+    }
+#ifndef HAVE_WINDOWS
+    {
+      /* daemonize() changes the working directory */
+      char *abs = realpath(cfg_indexdir, NULL);
+      findex_set_store(abs ? abs : cfg_indexdir);
+      free(abs);
+    }
+#else
+    findex_set_store(cfg_indexdir);
+#endif
+  }
+
   if (cfg_daemonize) {
     if (daemonize()) {exitstatus = -1; goto errexit;}
   }
 
   ff_initialize();
+  mediaio_configure((size_t) cfg_iobuffer * 1024, cfg_mmap);
+  imgseq_configure(cfg_seqfps_num, cfg_seqfps_den, cfg_seqstart);
 
   vcache_create(&vc);
   vcache_resize(&vc, initial_cache_size);
   icache_create(&ic);
-  icache_resize(ic, initial_cache_size*4);
-  dctrl_create(&dc, max_decoder_threads, initial_cache_size);
+  icache_resize(ic, cfg_icache_size > 0 ? cfg_icache_size : initial_cache_size*4);
+  vcache_pin_budget(vc, (size_t) cfg_pinbudget * 1048576);
+  icache_pin_budget(ic, (size_t) cfg_pinbudget * 1048576);
+  vcache_decode_through(vc, cfg_decodethrough);
+  vcache_reverse_budget(vc, (size_t) cfg_reversebudget * 1048576);
+  dctrl_create(&dc, max_decoder_threads, cfg_filemap_size > 0 ? cfg_filemap_size : initial_cache_size);
+  dctrl_set_image_cache(dc, ic);
+  dctrl_set_cpu_budget(dc, cfg_cpubudget);
 
   if (cfg_memlock) {
 #ifndef HAVE_WINDOWS
@@ -394,6 +737,7 @@ int main (int argc, char **argv) {
 
   /* cleanup */
 
+  jobs_shutdown();
   ff_cleanup();
   dctrl_destroy(&dc);
   vcache_destroy(&vc);
@@ -411,7 +755,7 @@ errexit:
 #include "ics_handler.h"
 #include "htmlconst.h"
 
-#define HPSIZE 4096 // max size of homepage in bytes.
+#define HPSIZE 8192 // max size of homepage in bytes.
 char *hdl_homepage_html (CONN *c) {
   char *msg = malloc(HPSIZE * sizeof(char));
   int off = 0;
@@ -423,7 +767,7 @@ char *hdl_homepage_html (CONN *c) {
   off+=snprintf(msg+off, HPSIZE-off, "<div style=\"float:left;margin:0 2em;\"><h2>Built-in handlers</h2>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<ul>");
   if (cfg_usermask & USR_INDEX) {
-    off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"index/\">File Index</a></li>\n");
+    off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"index/\">File Index</a> (<a href=\"index/?thumbs=1\">thumbnails</a>)</li>\n");
   }
   off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"status/\">Server Status</a></li>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"rc/\">Server Config</a></li>\n");
@@ -436,6 +780,12 @@ char *hdl_homepage_html (CONN *c) {
     off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"admin/flush_cache\">Flush Cache</a></li>\n");
   if (cfg_adminmask&ADM_PURGECACHE)
     off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"admin/purge_cache\">Purge Cache</a></li>\n");
+  if (cfg_adminmask&ADM_PIN)
+    off+=snprintf(msg+off, HPSIZE-off, "<li>Pin Cache: admin/pin, admin/unpin</li>\n");
+  if (cfg_adminmask&ADM_CONFIG)
+    off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"admin/config\">Runtime Config</a></li>\n");
+  if (cfg_adminmask&ADM_JOBS)
+    off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"admin/jobs\">Background Jobs</a></li>\n");
   if (cfg_adminmask&ADM_SHUTDOWN)
     off+=snprintf(msg+off, HPSIZE-off, "<li><a href=\"admin/shutdown\">Server Shutdown</a></li>\n");
   if (cfg_adminmask)
@@ -443,16 +793,31 @@ char *hdl_homepage_html (CONN *c) {
   off+=snprintf(msg+off, HPSIZE-off, "<div style=\"clear:both;\"></div><hr/>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<p style=\"text-align:justify;\">The default request handler decodes images and requires a <code>?frame=NUM&amp;file=PATH</code> URL query or post parameters. Video frames are counted starting at zero. Default options are <code>w=0&amp;h=0&amp;format=png</code> which serves the image pre-scaled to its effective size as png.</p>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<p>The <code>/info</code> request handler requires a <code>?file=PATH</code> query parameter and optionally takes a <code>format</code> (default is html). All other handlers (/status, /rc, /version, /admin/) take no arguments.</p>\n");
-  off+=snprintf(msg+off, HPSIZE-off, "<p>Available query parameters: <code>frame</code>, <code>w</code>, <code>h</code>, <code>file</code>, <code>format</code>.</p>\n");
-  off+=snprintf(msg+off, HPSIZE-off, "<p>Frame (frame-number), w (width) and h (height) are unsigned integers.</p>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<p><code>/bulkinfo</code> takes a list of <code>file=PATH</code> parameters (GET or POST), probes them concurrently and returns a json (default) or csv array.</p>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<p>The <code>/keyframes</code> handler returns the keyframe map of a <code>?file=PATH</code> (html, json, csv, plain or bin format). Add <code>all=1</code> to list every frame with its PTS and picture type.</p>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<p>Available query parameters: <code>frame</code>, <code>w</code>, <code>h</code>, <code>x</code>, <code>y</code>, <code>cw</code>, <code>ch</code>, <code>file</code>, <code>format</code>, <code>quality</code>, <code>scale</code>.</p>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<p>Frame (frame-number), w (width) and h (height) are unsigned integers. x, y, cw and ch select a region of the source picture (crop), only that region is scaled and encoded. <code>quality=draft</code> lets codecs that support it decode small thumbnails at reduced resolution. <code>scale=fast|bilinear|bicubic|area|lanczos</code> selects the scaler, the default depends on the downscale ratio.</p>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<p style=\"text-align:justify;\">Raw formats accept <code>delta=SESSION</code>: only 16x16 tiles that changed since the previous frame of the session are sent (<code>application/x-harvid-delta</code>, see raw_delta.h). A complete keyframe is sent on seek and at least every <code>keyint=N</code> (default %d) frames.</p>\n", RDELTA_KEYINT);
   off+=snprintf(msg+off, HPSIZE-off, "<p>Supported image output pixel formats:</p>\n");
-  off+=snprintf(msg+off, HPSIZE-off, "<ul>\n<li><em>Encoded</em>: jpg, jpeg, png, ppm</li>\n");
-  off+=snprintf(msg+off, HPSIZE-off, "<li><em>Raw RGB</em>: rgb, bgr, rgba, argb, bgra</li>\n");
-  off+=snprintf(msg+off, HPSIZE-off, "<li><em>Raw YUV</em>: yuv, yuv420, yuv440, yuv422, uyv422</li>\n</ul>\n");
+#ifdef HAVE_WEBP
+  off+=snprintf(msg+off, HPSIZE-off, "<ul>\n<li><em>Encoded</em>: jpg, jpeg, png, ppm, qoi, qoia, webp, webpll</li>\n");
+#else
+  off+=snprintf(msg+off, HPSIZE-off, "<ul>\n<li><em>Encoded</em>: jpg, jpeg, png, ppm, qoi, qoia</li>\n");
+#endif
+  off+=snprintf(msg+off, HPSIZE-off, "<li><em>Raw RGB</em>: rgb, bgr, rgba, argb, bgra, rgb565</li>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<li><em>Raw YUV</em>: yuv, yuv420, yuv440, yuv422, uyv422, yuv422p, nv12</li>\n");
+  off+=snprintf(msg+off, HPSIZE-off, "<li><em>Raw Luma</em>: gray, gray8</li>\n");
+#ifdef HAVE_LZ4
+  off+=snprintf(msg+off, HPSIZE-off, "<li><em>Compressed Raw</em>: any raw format with a <code>.lz4</code> suffix, e.g. rgb.lz4</li>\n");
+#endif
+  off+=snprintf(msg+off, HPSIZE-off, "</ul>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<p>Available info output formats:</p>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<ul>\n<li><em>Human Readable</em>: html, xhtml</li>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<li><em>Machine Readable</em>: json, csv, plain</li>\n</ul>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<p style=\"text-align:justify;\">The jpg (and jpeg) <em>format</em> parameter can be postfixed number to specify the jpeg quality. e.g. <code>&format=jpeg90</code>. The default is 75. Note that 'jpg' is just an alias for 'jpeg', and 'html' is an alias for 'xhtml'.</p>\n");
+#ifdef HAVE_WEBP
+  off+=snprintf(msg+off, HPSIZE-off, "<p style=\"text-align:justify;\">Likewise <code>webp</code> takes an optional quality (default 75), <code>webpll</code> is lossless. <code>method=0..6</code> trades encoding speed for size (default 4). Without a <em>format</em>, WebP is served to clients that accept image/webp.</p>\n");
+#endif
   off+=snprintf(msg+off, HPSIZE-off, "<p style=\"text-align:justify;\">If either only <em>width</em> or <em>height</em> is specified with a value greater than 15, the other is calculated according to the movie's effective aspect-ratio. However the minimum size is 16x16, requesting geometries smaller than 16x16 will return the image in its original size.</p>\n");
   off+=snprintf(msg+off, HPSIZE-off, "<p style=\"text-align:center\"><a href=\"http://x42.github.com/harvid/\">harvid @ GitHub</a></p>\n");
   off+=snprintf(msg+off, HPSIZE-off, "</div>\n");
@@ -492,7 +857,13 @@ char *hdl_server_status_html (CONN *c) {
 #endif
   dctrl_info_html(dc, &sm, &off, &ss, 2);
   vcache_info_html(vc, &sm, &off, &ss, 0);
-  icache_info_html(ic, &sm, &off, &ss, 2);
+  icache_info_html(ic, &sm, &off, &ss, 0);
+  findex_info_html(&sm, &off, &ss, 2);
+  swspool_info_html(&sm, &off, &ss);
+  mediaio_info_html(&sm, &off, &ss);
+  rdelta_info_html(&sm, &off, &ss);
+  format_info_html(&sm, &off, &ss);
+  jobs_info_html(&sm, &off, &ss);
   raprintf(sm, off, ss, HTMLFOOTER, c->d->local_addr, c->d->local_port);
   raprintf(sm, off, ss, "</body>\n</html>");
   return (sm);
@@ -600,8 +971,243 @@ char *hdl_file_info (CONN *c, ics_request_args *a) {
   }
 }
 
+typedef struct {
+  char **files;
+  VInfo *info;
+  int *status;
+} BulkInfo;
+
+static void bulk_info_probe (void *arg, int i) {
+  BulkInfo *b = (BulkInfo*) arg;
+  struct stat sb;
+  jvi_init(&b->info[i]);
+  if (!b->files[i] || imgseq_stat(b->files[i], &sb)) {
+    b->status[i] = 404;
+  } else if (imgseq_access(b->files[i], R_OK)) {
+    b->status[i] = 403;
+  } else {
+    b->status[i] = dctrl_probe_file(dc, b->files[i], &b->info[i]) ? 500 : 200;
+  }
+}
+
+/**
+ * probe a list of files concurrently and return a JSON or CSV array
+ * of their file-info. Files that are not found or cannot be opened
+ * are reported with a non-200 status.
+ */
+char *hdl_file_info_bulk (CONN *c, ics_request_args *a, int n, char **files, char **qurls) {
+  BulkInfo b;
+  size_t ss = 1024;
+  size_t off = 0;
+  char *sm = malloc(ss * sizeof(char));
+  int i;
+
+  b.files = files;
+  b.info = calloc(n, sizeof(VInfo));
+  b.status = calloc(n, sizeof(int));
+
+  parallel_for(n, max_decoder_threads, bulk_info_probe, &b);
+
+  if (a->render_fmt == OUT_JSON) {
+    raprintf(sm, off, ss, "[");
+  } else {
+    sm[0] = '\0';
+  }
+  for (i = 0; i < n; ++i) {
+    const VInfo *ji = &b.info[i];
+    const int ok = b.status[i] == 200;
+    char *tmp;
+    if (a->render_fmt == OUT_JSON) {
+      tmp = str_escape(qurls[i], 0, '\\');
+      raprintf(sm, off, ss, "%s{\"file\":\"%s\",\"status\":%d", i > 0 ? "," : "", tmp, b.status[i]);
+      if (ok) {
+        raprintf(sm, off, ss, ",\"width\":%i,\"height\":%i,\"aspect\":%.3f,\"framerate\":%.3f,\"duration\":%"PRId64,
+            ji->movie_width, ji->movie_height, ji->movie_aspect,
+            timecode_rate_to_double(&ji->framerate), ji->frames);
+      }
+      raprintf(sm, off, ss, "}");
+    } else {
+      tmp = str_escape(qurls[i], 0, '"');
+      raprintf(sm, off, ss, "\"%s\",%d,%i,%i,%f,%.3f,%"PRId64"\n", tmp, b.status[i],
+          ok ? ji->movie_width : 0, ok ? ji->movie_height : 0, ok ? ji->movie_aspect : 0,
+          ok ? timecode_rate_to_double(&ji->framerate) : 0, ok ? ji->frames : 0);
+    }
+    free(tmp);
+    jvi_free(&b.info[i]);
+  }
+  if (a->render_fmt == OUT_JSON) {
+    raprintf(sm, off, ss, "]");
+  }
+
+  free(b.info);
+  free(b.status);
+  return (sm);
+}
+
 /////////////
 
+static const char *pict_type_to_text(int t) {
+  switch (t) {
+    case AV_PICTURE_TYPE_I: return "I";
+    case AV_PICTURE_TYPE_P: return "P";
+    case AV_PICTURE_TYPE_B: return "B";
+    case AV_PICTURE_TYPE_S: return "S";
+    case AV_PICTURE_TYPE_SI: return "SI";
+    case AV_PICTURE_TYPE_SP: return "SP";
+    case AV_PICTURE_TYPE_BI: return "BI";
+    default: return "?";
+  }
+}
+
+/* binary keyframe map, native byte-order
+ * header: "HKF1", int32 flags (1: all frames), int32 tb_num, tb_den, fr_num, fr_den, int64 count
+ * followed by count entries of: int64 frame, int64 pts, int64 pos, int32 flags (1: key), int32 pict_type
+ */
+static uint8_t *keyframes_bin (FrameIndex *fi, int all, size_t *len) {
+  int64_t i, n = 0;
+  const int64_t cnt = all ? fi->n_frames : fi->n_keyframes;
+  const size_t hs = 4 + 5 * sizeof(int32_t) + sizeof(int64_t);
+  const size_t es = 3 * sizeof(int64_t) + 2 * sizeof(int32_t);
+  uint8_t *b = malloc(hs + cnt * es);
+  uint8_t *p = b;
+  int32_t h[5] = { all ? 1 : 0, fi->tb_num, fi->tb_den, fi->fr_num, fi->fr_den };
+
+  memcpy(p, "HKF1", 4); p += 4;
+  memcpy(p, h, sizeof(h)); p += sizeof(h);
+  memcpy(p, &cnt, sizeof(int64_t)); p += sizeof(int64_t);
+  for (i = 0; i < fi->n_frames && n < cnt; ++i) {
+    const FrameIndexEntry *e = &fi->e[i];
+    if (!all && !(e->flags & FIDX_KEY)) continue;
+    const int64_t f = findex_frame_number(fi, i);
+    memcpy(p, &f, sizeof(int64_t)); p += sizeof(int64_t);
+    memcpy(p, &e->pts, sizeof(int64_t)); p += sizeof(int64_t);
+    memcpy(p, &e->pos, sizeof(int64_t)); p += sizeof(int64_t);
+    memcpy(p, &e->flags, sizeof(int32_t)); p += sizeof(int32_t);
+    memcpy(p, &e->pict_type, sizeof(int32_t)); p += sizeof(int32_t);
+    ++n;
+  }
+  *len = p - b;
+  return b;
+}
+
+static char *keyframes_text (CONN *c, ics_request_args *a, FrameIndex *fi) {
+  size_t ss = 1024;
+  size_t off = 0;
+  char *sm = malloc(ss * sizeof(char));
+  const int all = a->idx_option & OPT_ALLFRAMES;
+  const char *src = findex_source_name(fi);
+  int64_t i, n = 0;
+
+  switch (a->render_fmt) {
+    case OUT_JSON:
+      raprintf(sm, off, ss, "{\"source\":\"%s\",\"timebase\":[%d,%d],\"framerate\":[%d,%d]",
+          src, fi->tb_num, fi->tb_den, fi->fr_num, fi->fr_den);
+      raprintf(sm, off, ss, ",\"frames\":%"PRId64",\"keyframes\":%"PRId64",\"index\":[", fi->n_frames, fi->n_keyframes);
+      break;
+    case OUT_CSV:
+      raprintf(sm, off, ss, "1,%s,%d,%d,%d,%d,%"PRId64",%"PRId64"\n", // FORMAT VERSION
+          src, fi->tb_num, fi->tb_den, fi->fr_num, fi->fr_den, fi->n_frames, fi->n_keyframes);
+      break;
+    case OUT_PLAIN:
+      break;
+    default:
+      raprintf(sm, off, ss, DOCTYPE HTMLOPEN);
+      raprintf(sm, off, ss, "<title>harvid keyframes</title></head>\n");
+      raprintf(sm, off, ss, HTMLBODY);
+      raprintf(sm, off, ss, CENTERDIV);
+      raprintf(sm, off, ss, "<h2>%s</h2>\n", all ? "Frame Index" : "Keyframes");
+      raprintf(sm, off, ss, "<p>%"PRId64" frames, %"PRId64" keyframes, time-base %d/%d, source: %s</p>\n",
+          fi->n_frames, fi->n_keyframes, fi->tb_num, fi->tb_den, src);
+      raprintf(sm, off, ss, "<table style=\"text-align:center;width:100%%\">\n");
+      raprintf(sm, off, ss, "<tr><th>Frame#</th><th>PTS</th><th>Byte Position</th><th>Key</th><th>Type</th></tr>\n");
+      break;
+  }
+
+  for (i = 0; i < fi->n_frames; ++i) {
+    const FrameIndexEntry *e = &fi->e[i];
+    const int key = e->flags & FIDX_KEY;
+    if (!all && !key) continue;
+    const int64_t f = findex_frame_number(fi, i);
+    switch (a->render_fmt) {
+      case OUT_JSON:
+        if (all) {
+          raprintf(sm, off, ss, "%s{\"frame\":%"PRId64",\"pts\":%"PRId64",\"key\":%s,\"type\":\"%s\"}",
+              n > 0 ? "," : "", f, e->pts, key ? "true" : "false", pict_type_to_text(e->pict_type));
+        } else {
+          raprintf(sm, off, ss, "%s{\"frame\":%"PRId64",\"pts\":%"PRId64"}", n > 0 ? "," : "", f, e->pts);
+        }
+        break;
+      case OUT_CSV:
+        raprintf(sm, off, ss, "%"PRId64",%"PRId64",%"PRId64",%d,%s\n", f, e->pts, e->pos, key ? 1 : 0, pict_type_to_text(e->pict_type));
+        break;
+      case OUT_PLAIN:
+        if (all) {
+          raprintf(sm, off, ss, "%"PRId64" %"PRId64" %c %s\n", f, e->pts, key ? 'K' : '-', pict_type_to_text(e->pict_type));
+        } else {
+          raprintf(sm, off, ss, "%"PRId64"\n", f);
+        }
+        break;
+      default:
+        raprintf(sm, off, ss, "<tr><td>%"PRId64"</td><td>%"PRId64"</td><td>%"PRId64"</td><td>%s</td><td>%s</td></tr>\n",
+            f, e->pts, e->pos, key ? "K" : "", pict_type_to_text(e->pict_type));
+        break;
+    }
+    ++n;
+  }
+
+  switch (a->render_fmt) {
+    case OUT_JSON:
+      raprintf(sm, off, ss, "]}");
+      break;
+    case OUT_CSV:
+    case OUT_PLAIN:
+      break;
+    default:
+      raprintf(sm, off, ss, "</table>\n</div>\n");
+      raprintf(sm, off, ss, HTMLFOOTER, c->d->local_addr, c->d->local_port);
+      raprintf(sm, off, ss, "</body>\n</html>");
+      break;
+  }
+  return sm;
+}
+
+int hdl_file_keyframes (CONN *c, httpheader *h, ics_request_args *a) {
+  FrameIndex *fi = NULL;
+  unsigned short vid;
+  uint8_t *optr;
+  size_t olen;
+  int err = 0;
+
+  vid = dctrl_get_id(vc, dc, a->file_name);
+  if ((err = dctrl_get_index(dc, vid, &fi))) {
+    if (err == 503) {
+      httperror(c->fd, 503, "Service Temporarily Unavailable", "<p>No decoder is available. The server is currently busy or overloaded.</p>");
+    } else {
+      httperror(c->fd, 500, "Service Unavailable", "<p>Cannot index file: File is invalid (no video track, unknown codec,..)</p>");
+    }
+    return 0;
+  }
+
+  if (a->render_fmt == OUT_BIN) {
+    optr = keyframes_bin(fi, a->idx_option & OPT_ALLFRAMES, &olen);
+    h->ctype = "application/octet-stream";
+  } else {
+    optr = (uint8_t*) keyframes_text(c, a, fi);
+    olen = strlen((char*) optr);
+    switch (a->render_fmt) {
+      case OUT_PLAIN: h->ctype = "text/plain"; break;
+      case OUT_JSON:  h->ctype = "application/json"; break;
+      case OUT_CSV:   h->ctype = "text/csv"; break;
+      default:        h->ctype = "text/html; charset=UTF-8"; break;
+    }
+  }
+  findex_release(fi);
+
+  http_tx(c->fd, 200, h, olen, optr);
+  free(optr);
+  return 0;
+}
+
 #define SINFOSIZ 2048
 char *hdl_server_info (CONN *c, ics_request_args *a) {
   char *info = malloc(SINFOSIZ * sizeof(char));
@@ -622,11 +1228,14 @@ char *hdl_server_info (CONN *c, ics_request_args *a) {
       off+=snprintf(info+off, SINFOSIZ-off, ",\"listenaddr\":\"%s\"", c->d->local_addr);
       off+=snprintf(info+off, SINFOSIZ-off, ",\"listenport\":%d", c->d->local_port);
       off+=snprintf(info+off, SINFOSIZ-off, ",\"cachesize\":%d", initial_cache_size);
-      off+=snprintf(info+off, SINFOSIZ-off, ",\"infohandlers\":[\"/info\", \"/rc\", \"/status\", \"/version\"%s\"",
+      off+=snprintf(info+off, SINFOSIZ-off, ",\"infohandlers\":[\"/info\", \"/bulkinfo\", \"/keyframes\", \"/rc\", \"/status\", \"/version\"%s\"",
           cfg_usermask & USR_INDEX ? ",\"index\"":"");
-      off+=snprintf(info+off, SINFOSIZ-off, ",\"admintasks\":[\"/check\"%s%s%s]",
+      off+=snprintf(info+off, SINFOSIZ-off, ",\"admintasks\":[\"/check\"%s%s%s%s%s%s]",
           (cfg_adminmask & ADM_FLUSHCACHE) ? ",\"/flush_cache\"" : "",
           (cfg_adminmask & ADM_PURGECACHE) ? ",\"/purge_cache\"" : "",
+          (cfg_adminmask & ADM_PIN)        ? ",\"/pin\",\"/unpin\"" : "",
+          (cfg_adminmask & ADM_CONFIG)     ? ",\"/config\"" : "",
+          (cfg_adminmask & ADM_JOBS)       ? ",\"/jobs\"" : "",
           (cfg_adminmask & ADM_SHUTDOWN)   ? ",\"/shutdown\"" : ""
           );
       off+=snprintf(info+off, SINFOSIZ-off, "}");
@@ -639,11 +1248,14 @@ char *hdl_server_info (CONN *c, ics_request_args *a) {
       off+=snprintf(info+off, SINFOSIZ-off, ",%s", c->d->local_addr);
       off+=snprintf(info+off, SINFOSIZ-off, ",%d", c->d->local_port);
       off+=snprintf(info+off, SINFOSIZ-off, ",%d", initial_cache_size);
-      off+=snprintf(info+off, SINFOSIZ-off, ",\"/info /rc /status /version%s\"",
+      off+=snprintf(info+off, SINFOSIZ-off, ",\"/info /bulkinfo /keyframes /rc /status /version%s\"",
           cfg_usermask & USR_INDEX ? " index":"");
-      off+=snprintf(info+off, SINFOSIZ-off, ",\"/check%s%s%s\"",
+      off+=snprintf(info+off, SINFOSIZ-off, ",\"/check%s%s%s%s%s%s\"",
           (cfg_adminmask & ADM_FLUSHCACHE) ? " /flush_cache" : "",
           (cfg_adminmask & ADM_PURGECACHE) ? " /purge_cache" : "",
+          (cfg_adminmask & ADM_PIN)        ? " /pin /unpin" : "",
+          (cfg_adminmask & ADM_CONFIG)     ? " /config" : "",
+          (cfg_adminmask & ADM_JOBS)       ? " /jobs" : "",
           (cfg_adminmask & ADM_SHUTDOWN)   ? " /shutdown" : ""
           );
       off+=snprintf(info+off, SINFOSIZ-off, "\n");
@@ -661,15 +1273,19 @@ char *hdl_server_info (CONN *c, ics_request_args *a) {
       off+=snprintf(info+off, SINFOSIZ-off, "<li>ListenPort: %d</li>\n", c->d->local_port);
       off+=snprintf(info+off, SINFOSIZ-off, "<li>CacheSize: %d</li>\n", initial_cache_size);
       off+=snprintf(info+off, SINFOSIZ-off, "<li>File Index: %s</li>\n", cfg_usermask & USR_INDEX ? "Yes" : "No");
-      off+=snprintf(info+off, SINFOSIZ-off, "<li>Admin-task(s): /check%s%s%s</li>\n",
+      off+=snprintf(info+off, SINFOSIZ-off, "<li>Admin-task(s): /check%s%s%s%s%s%s</li>\n",
           (cfg_adminmask & ADM_FLUSHCACHE) ? " /flush_cache" : "",
           (cfg_adminmask & ADM_PURGECACHE) ? " /purge_cache" : "",
+          (cfg_adminmask & ADM_PIN)        ? " /pin /unpin" : "",
+          (cfg_adminmask & ADM_CONFIG)     ? " /config" : "",
+          (cfg_adminmask & ADM_JOBS)       ? " /jobs" : "",
           (cfg_adminmask & ADM_SHUTDOWN)   ? " /shutdown" : ""
           );
 #ifndef NDEBUG // possibly sensitive information
       off+=snprintf(info+off, SINFOSIZ-off, "<li>Memlock: %s</li>\n", cfg_memlock ? "Yes" : "No");
       off+=snprintf(info+off, SINFOSIZ-off, "<li>Daemonized: %s</li>\n", cfg_daemonize ? "Yes" : "No");
       off+=snprintf(info+off, SINFOSIZ-off, "<li>Chroot: %s</li>\n", cfg_chroot ? cfg_chroot : "-");
+      off+=snprintf(info+off, SINFOSIZ-off, "<li>Index Store: %s</li>\n", cfg_indexdir ? cfg_indexdir : "-");
       off+=snprintf(info+off, SINFOSIZ-off, "<li>SetUid/Gid: %s/%s</li>\n",
           cfg_username ? cfg_username : "-", cfg_groupname ? cfg_groupname : "-");
       off+=snprintf(info+off, SINFOSIZ-off, "<li>Log: %s</li>\n",
@@ -738,12 +1354,18 @@ char *hdl_server_version (CONN *c, ics_request_args *a) {
 
 int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
   VInfo ji;
+  VCrop crop;
   unsigned short vid;
   void *cptr = NULL;
   uint8_t *optr = NULL;
   size_t olen = 0;
   uint8_t *bptr = NULL;
+  uint8_t *dptr = NULL;
+  uint8_t *pptr = NULL;
+  char xhd[192];
   int err = 0;
+  /* draft frames may differ, they are cached separately */
+  const int vflags = (a->draft ? VDEC_DRAFT : 0) | VDEC_SCALER(a->scaler) | VDEC_CLIENT(a->client);
 
   vid = dctrl_get_id(vc, dc, a->file_name);
   jvi_init(&ji);
@@ -752,8 +1374,14 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
   if (a->out_width < 0 || a->out_width > 16384) a->out_width = 0;
   if (a->out_height < 0 || a->out_height > 16384) a->out_height = 0;
 
-  /* get canonical output width/height and corresponding buffersize */
-  if ((err=dctrl_get_info_scale(dc, vid, &ji, a->out_width, a->out_height, a->decode_fmt)) || ji.buffersize < 1) {
+  crop.x = a->crop_x;
+  crop.y = a->crop_y;
+  crop.w = a->crop_w;
+  crop.h = a->crop_h;
+
+  /* get canonical output width/height and corresponding buffersize,
+   * the crop region is normalized and becomes part of the cache-keys */
+  if ((err=dctrl_get_info_crop(dc, vid, &ji, a->out_width, a->out_height, a->decode_fmt, &crop)) || ji.buffersize < 1) {
     if (err == 503) {
       dlog(DLOG_WARNING, "VID: no decoder available (server overload).\n", fd);
       httperror(fd, 503, "Service Temporarily Unavailable", "<p>No decoder is available. The server is currently busy or overloaded.</p>");
@@ -766,12 +1394,26 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
 
   /* try encoded cache if a->render_fmt != FMT_RAW */
   if (a->render_fmt != FMT_RAW) {
-     optr = icache_get_buffer(ic, vid, a->frame, a->render_fmt, a->misc_int, ji.out_width, ji.out_height, &olen, &cptr);
+     optr = icache_get_buffer(ic, vid, a->frame, a->render_fmt, a->misc_int, VDEC_QUALITY(vflags), ji.out_width, ji.out_height, &crop, &olen, &cptr);
+  }
+
+  /* intra-only JPEG/PNG source at native geometry: send the frame as-is */
+  if (olen == 0 && !(crop.w > 0 && crop.h > 0)
+      && ji.out_width == ji.movie_width && ji.out_height == ji.movie_height
+      && (   (a->render_fmt == FMT_JPG && a->misc_int == 0 && ji.packet_fmt == VPKT_JPEG)
+          || (a->render_fmt == FMT_PNG && ji.packet_fmt == VPKT_PNG))
+     ) {
+    if (!dctrl_get_packet(dc, vid, a->frame, &pptr, &olen)) {
+      optr = pptr;
+    } else {
+      debugmsg(DEBUG_ICS, "VID: packet passthrough failed, decoding frame %"PRId64".\n", a->frame);
+      olen = 0;
+    }
   }
 
   if (olen == 0) {
     /* get frame from cache - or decode it into the cache */
-    bptr = vcache_get_buffer(vc, dc, vid, a->frame, ji.out_width, ji.out_height, a->decode_fmt, &cptr, &err);
+    bptr = vcache_get_buffer(vc, dc, vid, a->frame, ji.out_width, ji.out_height, a->decode_fmt, &crop, vflags, &cptr, &err);
 
     if (!bptr) {
       dlog(DLOG_ERR, "VID: error decoding video file for fd:%d err:%d\n", fd, err);
@@ -785,8 +1427,15 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
 
     switch (a->render_fmt) {
       case FMT_RAW:
-        olen = ji.buffersize;
-        optr = bptr;
+        if (a->session) {
+          /* send only the tiles that changed since the last frame of this session */
+          olen = rdelta_encode(a->session, vid, a->frame, ji.out_width, ji.out_height,
+              a->decode_fmt, a->delta_keyint, bptr, ji.buffersize, &dptr);
+          optr = dptr;
+        } else {
+          olen = ji.buffersize;
+          optr = bptr;
+        }
         break;
       default:
         olen = format_image(&optr, a->render_fmt, a->misc_int, &ji, bptr);
@@ -798,7 +1447,16 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
     debugmsg(DEBUG_ICS, "VID: sending %li bytes to fd:%d.\n", (long int) olen, fd);
     switch (a->render_fmt) {
       case FMT_RAW:
-        h->ctype = "image/raw";
+        h->ctype = dptr ? "application/x-harvid-delta" : "image/raw";
+        break;
+      case FMT_LZ4:
+        h->ctype = "application/x-lz4";
+        break;
+      case FMT_QOI:
+        h->ctype = "image/qoi";
+        break;
+      case FMT_WEBP:
+        h->ctype = "image/webp";
         break;
       case FMT_JPG:
         h->ctype = "image/jpeg";
@@ -812,11 +1470,21 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
       default:
         h->ctype = "image/unknown";
     }
+    if ((a->render_fmt == FMT_RAW && !dptr) || a->render_fmt == FMT_LZ4) {
+      /* describe the (uncompressed) raw frame */
+      snprintf(xhd, sizeof(xhd), "X-Harvid-Geometry: %dx%d\r\nX-Harvid-Pixfmt: %s\r\nX-Harvid-Raw-Length: %lu",
+          ji.out_width, ji.out_height, av_get_pix_fmt_name(a->decode_fmt), (unsigned long) ji.buffersize);
+      h->extra = xhd;
+    }
     http_tx(fd, 200, h, olen, optr);
 
-    if (bptr && a->render_fmt != FMT_RAW) {
+    if (pptr) {
+      if (icache_add_buffer(ic, vid, a->frame, a->render_fmt, a->misc_int, VDEC_QUALITY(vflags), ji.out_width, ji.out_height, &crop, pptr, olen)) {
+        free(pptr);
+      }
+    } else if (bptr && a->render_fmt != FMT_RAW) {
       /* image was read from raw frame cache end encoded just now */
-      if (icache_add_buffer(ic, vid, a->frame, a->render_fmt, a->misc_int, ji.out_width, ji.out_height, optr, olen)) {
+      if (icache_add_buffer(ic, vid, a->frame, a->render_fmt, a->misc_int, VDEC_QUALITY(vflags), ji.out_width, ji.out_height, &crop, optr, olen)) {
         /* image was not added to image cache -> unreference the buffer */
         free(optr);
       } else if (! (cfg_usermask & USR_KEEPRAW)) {
@@ -829,6 +1497,7 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
     httperror(fd, 500, NULL, NULL);
   }
 
+  free(dptr);
   if (bptr)
     vcache_release_buffer(vc, cptr);
   else
@@ -838,15 +1507,359 @@ int hdl_decode_frame(int fd, httpheader *h, ics_request_args *a) {
   return (0);
 }
 
+/* decode, encode and cache a single poster thumbnail */
+static int render_poster(PosterJob *pj, int w, int h, int want_data) {
+  VInfo ji;
+  unsigned short vid;
+  void *cptr = NULL;
+  uint8_t *optr = NULL;
+  uint8_t *bptr = NULL;
+  size_t olen = 0;
+  int err = 0;
+
+  vid = dctrl_get_id(vc, dc, pj->file_name);
+  jvi_init(&ji);
+
+  if ((err = dctrl_get_info_scale(dc, vid, &ji, w, h, AV_PIX_FMT_RGB24)) || ji.buffersize < 1) {
+    return err == 503 ? 503 : 500;
+  }
+
+  /* already cached? */
+  optr = icache_get_buffer(ic, vid, 0, FMT_JPG, 0, VDEC_QUALITY(0), ji.out_width, ji.out_height, NULL, &olen, &cptr);
+  if (olen > 0) {
+    if (want_data) {
+      pj->data = malloc(olen);
+      memcpy(pj->data, optr, olen);
+      pj->len = olen;
+    }
+    icache_release_buffer(ic, cptr);
+    jvi_free(&ji);
+    return 0;
+  }
+
+  bptr = vcache_get_buffer(vc, dc, vid, 0, ji.out_width, ji.out_height, AV_PIX_FMT_RGB24, NULL, 0, &cptr, &err);
+  if (!bptr) {
+    jvi_free(&ji);
+    return err == 503 ? 503 : 500;
+  }
+
+  olen = format_image(&optr, FMT_JPG, 0, &ji, bptr);
+  if (olen > 0 && optr) {
+    if (want_data) {
+      pj->data = malloc(olen);
+      memcpy(pj->data, optr, olen);
+      pj->len = olen;
+    }
+    if (icache_add_buffer(ic, vid, 0, FMT_JPG, 0, VDEC_QUALITY(0), ji.out_width, ji.out_height, NULL, optr, olen)) {
+      free(optr);
+    } else if (! (cfg_usermask & USR_KEEPRAW)) {
+      vcache_invalidate_buffer(vc, cptr);
+    }
+  } else {
+    err = 500;
+  }
+  vcache_release_buffer(vc, cptr);
+  jvi_free(&ji);
+  return err ? 500 : 0;
+}
+
+typedef struct {
+  PosterJob *pj;
+  int w, h;
+  int want_data;
+} PosterBatch;
+
+static void poster_worker (void *arg, int i) {
+  PosterBatch *pb = (PosterBatch*) arg;
+  pb->pj[i].status = render_poster(&pb->pj[i], pb->w, pb->h, pb->want_data);
+}
+
+/**
+ * render frame 0 of the given files as jpeg thumbnails into the image cache.
+ * At most half the decoders are used, the remaining ones stay
+ * available for concurrent frame requests.
+ * Every poster maps its file (dctrl_get_id()), at most a quarter of the
+ * file-map is used so that files which are being served are not evicted.
+ * Posters beyond that are not rendered (status 503).
+ */
+void hdl_render_posters (PosterJob *pj, int n, int w, int h, int want_data) {
+  PosterBatch pb = {pj, w, h, want_data};
+  const int nt = max_decoder_threads > 2 ? max_decoder_threads / 2 : 1;
+  const int files = cfg_filemap_size > 0 ? cfg_filemap_size : initial_cache_size;
+  const int cap = files / 4 > 0 ? files / 4 : 1;
+  const int np = n < cap ? n : cap;
+  int i;
+  for (i = np; i < n; ++i) {
+    pj[i].status = 503;
+  }
+  parallel_for(np, nt, poster_worker, &pb);
+}
+
+/* number of decoders that background jobs may use right now */
+int hdl_spare_decoders (void) {
+  const int nt = max_decoder_threads > 2 ? max_decoder_threads / 2 : 1;
+  return nt - dctrl_decoders_busy(dc);
+}
+
+int hdl_job_file_info (const char *fn, int64_t *frames, double *fps) {
+  VInfo ji;
+  unsigned short vid = dctrl_get_id(vc, dc, fn);
+  jvi_init(&ji);
+  if (dctrl_probe_info(dc, vid, &ji)) {
+    jvi_free(&ji);
+    return -1;
+  }
+  *frames = ji.frames;
+  *fps = timecode_rate_to_double(&ji.framerate);
+  jvi_free(&ji);
+  return 0;
+}
+
+/* decode, encode and cache a single frame for a background job */
+int hdl_job_render (const char *fn, int64_t frame, int w, int h, const JobSpec *spec) {
+  VInfo ji;
+  unsigned short vid;
+  void *cptr = NULL;
+  uint8_t *optr = NULL;
+  uint8_t *bptr = NULL;
+  size_t olen = 0;
+  int err = 0;
+  const int vflags = (spec->draft ? VDEC_DRAFT : 0) | VDEC_SCALER(spec->scaler);
+
+  vid = dctrl_get_id(vc, dc, fn);
+  jvi_init(&ji);
+
+  if (dctrl_get_info_scale(dc, vid, &ji, w, h, spec->decode_fmt) || ji.buffersize < 1) {
+    jvi_free(&ji);
+    return -1;
+  }
+
+  optr = icache_get_buffer(ic, vid, frame, spec->render_fmt, spec->misc_int, VDEC_QUALITY(vflags), ji.out_width, ji.out_height, NULL, &olen, &cptr);
+  if (olen > 0) {
+    icache_release_buffer(ic, cptr);
+    jvi_free(&ji);
+    return 0;
+  }
+
+  bptr = vcache_get_buffer(vc, dc, vid, frame, ji.out_width, ji.out_height, spec->decode_fmt, NULL, vflags, &cptr, &err);
+  if (!bptr) {
+    jvi_free(&ji);
+    return -1;
+  }
+
+  olen = format_image(&optr, spec->render_fmt, spec->misc_int, &ji, bptr);
+  if (olen > 0 && optr) {
+    if (icache_add_buffer(ic, vid, frame, spec->render_fmt, spec->misc_int, VDEC_QUALITY(vflags), ji.out_width, ji.out_height, NULL, optr, olen)) {
+      free(optr);
+    } else if (! (cfg_usermask & USR_KEEPRAW)) {
+      vcache_invalidate_buffer(vc, cptr);
+    }
+  } else {
+    err = -1;
+  }
+  vcache_release_buffer(vc, cptr);
+  jvi_free(&ji);
+  return err ? -1 : 0;
+}
+
+/**
+ * queue a background job that renders thumbnails of the given files.
+ * Valid file-names are handed over to the job and NULLed in \a files.
+ */
+char *hdl_jobs_submit (CONN *c, ics_request_args *a, int n, char **files) {
+  JobSpec spec;
+  char **jf;
+  char *msg;
+  int i, nf = 0;
+
+  if (!a->fmt_set) {
+    a->render_fmt = FMT_JPG;
+    a->misc_int = 0;
+  }
+  if (a->render_fmt == FMT_RAW || a->render_fmt >= OUT_HTML) {
+    httperror(c->fd, 400, "Bad Request", "<p>Invalid image format.</p>");
+    return NULL;
+  }
+
+  memset(&spec, 0, sizeof(JobSpec));
+  spec.render_fmt = a->render_fmt;
+  spec.misc_int = a->misc_int;
+  spec.decode_fmt = a->decode_fmt;
+  spec.draft = a->draft;
+  spec.scaler = a->scaler;
+  spec.interval = a->job_interval;
+  spec.interval_sec = a->job_interval_sec;
+  if (spec.interval < 1 && spec.interval_sec <= 0) {
+    spec.interval_sec = 1.0;
+  }
+
+  if (a->job_sizes) {
+    char *t, *s = a->job_sizes;
+    while (s && *s && spec.n_sizes < JOBS_MAX_SIZES) {
+      int w = 0, h = 0;
+      if ((t = strchr(s, ','))) *t = '\0';
+      if (sscanf(s, "%dx%d", &w, &h) < 1 || w < 0 || h < 0 || w > 8192 || h > 8192) {
+        httperror(c->fd, 400, "Bad Request", "<p>Invalid sizes, expected a list of WxH.</p>");
+        return NULL;
+      }
+      spec.w[spec.n_sizes] = w;
+      spec.h[spec.n_sizes] = h;
+      spec.n_sizes++;
+      s = t ? t + 1 : NULL;
+    }
+  } else {
+    spec.w[0] = a->out_width > 0 ? a->out_width : 0;
+    spec.h[0] = a->out_height > 0 ? a->out_height : 0;
+    spec.n_sizes = 1;
+  }
+
+  jf = malloc(n * sizeof(char*));
+  for (i = 0; i < n; ++i) {
+    if (!files[i]) continue;
+    jf[nf++] = files[i];
+    files[i] = NULL;
+  }
+  if (nf == 0) {
+    free(jf);
+    httperror(c->fd, 400, "Bad Request", "<p>No valid file.</p>");
+    return NULL;
+  }
+
+  msg = malloc(32 * sizeof(char));
+  snprintf(msg, 32, "{\"id\":%d}", jobs_submit(jf, nf, &spec));
+  return msg;
+}
+
+#define PINMSGSIZ 1024
+/**
+ * pin (or unpin) frames of a file in the frame- and image-cache.
+ * A raw format= pins decoded frames, an encoded format the images,
+ * without a format both are pinned regardless of pixel/image-format.
+ */
+char *hdl_cache_pin (CONN *c, ics_request_args *a, int pin, int range) {
+  unsigned short vid;
+  int64_t start = 0, end = -1;
+  short w = 0, h = 0;
+  int vfmt = -1, ifmt = -1;
+  int nv = 0, ni = 0;
+  char *msg;
+
+  if (a->fmt_set && a->render_fmt >= OUT_HTML) {
+    httperror(c->fd, 400, "Bad Request", "<p>Invalid image format.</p>");
+    return NULL;
+  }
+
+  vid = dctrl_get_id(vc, dc, a->file_name);
+
+  if (range) {
+    start = a->frame < 0 ? 0 : a->frame;
+    end = a->frame_end < start ? start : a->frame_end;
+  }
+
+  /* canonical geometry, as used in the cache-keys */
+  if (a->out_width > 0 || a->out_height > 0) {
+    VInfo ji;
+    int err;
+    jvi_init(&ji);
+    if ((err = dctrl_get_info_scale(dc, vid, &ji, a->out_width, a->out_height, a->decode_fmt))) {
+      jvi_free(&ji);
+      if (err == 503) {
+        httperror(c->fd, 503, "Service Temporarily Unavailable", "<p>No decoder is available. The server is currently busy or overloaded.</p>");
+      } else {
+        httperror(c->fd, 500, "Service Unavailable", "<p>No decoder is available: File is invalid (no video track, unknown codec, invalid geometry,..)</p>");
+      }
+      return NULL;
+    }
+    w = ji.out_width;
+    h = ji.out_height;
+    jvi_free(&ji);
+  }
+
+  if (a->fmt_set) {
+    if (a->render_fmt == FMT_RAW) {
+      vfmt = a->decode_fmt;
+    } else {
+      ifmt = a->render_fmt;
+    }
+  }
+
+  if (pin) {
+    if (!a->fmt_set || a->render_fmt == FMT_RAW) {
+      nv = vcache_pin(vc, a->file_name, vid, start, end, w, h, vfmt);
+    }
+    if (!a->fmt_set || a->render_fmt != FMT_RAW) {
+      ni = icache_pin(ic, a->file_name, vid, start, end, w, h, ifmt);
+    }
+  } else {
+    if (!a->fmt_set || a->render_fmt == FMT_RAW) {
+      nv = vcache_unpin(vc, a->file_name, start, end, w, h, vfmt);
+    }
+    if (!a->fmt_set || a->render_fmt != FMT_RAW) {
+      ni = icache_unpin(ic, a->file_name, start, end, w, h, ifmt);
+    }
+  }
+
+  msg = malloc(PINMSGSIZ * sizeof(char));
+  snprintf(msg, PINMSGSIZ,
+      DOCTYPE HTMLOPEN "<title>harvid admin</title></head>" HTMLBODY
+      "<p>OK. %s command successful: %d frame-cache and %d image-cache %s</p>" ERRFOOTER,
+      pin ? "pin" : "unpin", nv, ni, pin ? "line(s) pinned" : "pin(s) removed");
+  return msg;
+}
+
+#define CFGMSGSIZ 1024
+/**
+ * change cache and decoder limits, query: key=value pairs as in the config file
+ * without parameters the current configuration is returned.
+ */
+char *hdl_server_config (CONN *c, char *query) {
+  RuntimeConf rc;
+  char *t, *s = query;
+  char *msg;
+
+  rc_init(&rc);
+  while (s && strlen(s) > 0) {
+    char *sep;
+    if ((t = strpbrk(s, "&?"))) *t = '\0';
+    if ((sep = strchr(s, '='))) {
+      *sep = '\0';
+      if (rc_setting(&rc, s, sep + 1)) {
+        httperror(c->fd, 400, "Bad Request", "<p>Invalid setting or value.</p>");
+        return NULL;
+      }
+    }
+    s = t ? t + 1 : NULL;
+  }
+  rc_apply(&rc);
+
+  msg = malloc(CFGMSGSIZ * sizeof(char));
+  snprintf(msg, CFGMSGSIZ,
+      DOCTYPE HTMLOPEN "<title>harvid admin</title></head>" HTMLBODY
+      "<p>OK. config command successful</p>\n<ul>"
+      "<li>cache-size: %d</li><li>image-cache-size: %d</li><li>decoders: %d</li>"
+      "<li>file-cache-size: %d</li><li>pin-budget: %d MiB</li><li>cpu-budget: %d</li>"
+      "<li>decode-through: %d</li><li>reverse-budget: %d MiB</li></ul>" ERRFOOTER,
+      initial_cache_size,
+      cfg_icache_size > 0 ? cfg_icache_size : initial_cache_size * 4,
+      max_decoder_threads,
+      cfg_filemap_size > 0 ? cfg_filemap_size : initial_cache_size,
+      cfg_pinbudget, cfg_cpubudget, cfg_decodethrough, cfg_reversebudget);
+  return msg;
+}
+
 void hdl_clear_cache() {
   vcache_clear(vc, -1);
   icache_clear(ic);
 }
 
 void hdl_purge_cache() {
+  vcache_unpin(vc, NULL, 0, -1, 0, 0, -1);
+  icache_unpin(ic, NULL, 0, -1, 0, 0, -1);
   vcache_clear(vc, -1);
   icache_clear(ic);
   dctrl_cache_clear(vc, dc, 2, -1);
+  findex_flush();
+  rdelta_clear();
 }
 
 // vim:sw=2 sts=2 ts=8 et:
@@ -302,18 +302,45 @@ static char *get_next_line(char **str) {
   return t;
 }
 
-/* check accept for image/png[;..] */
+/* check the parameters of a media-range for q=0 (not acceptable) */
+static int accept_refused(const char *param) {
+  while (param) {
+    while (*param == ' ' || *param == '\t' || *param == ';') ++param;
+    if ((*param == 'q' || *param == 'Q') && param[1] == '=') {
+      return atof(param + 2) <= 0;
+    }
+    param = strchr(param, ';');
+  }
+  return 0;
+}
+
+/* check accept for image/png[;..]
+ * list elements may be preceded by whitespace */
 static int compare_accept(char *line) {
   int rv = 0;
   char *tmp;
-  if ((tmp = strchr(line, ';'))) *tmp = '\0'; // ignore opt. parameters
+  while (*line == ' ' || *line == '\t') ++line;
+  if ((tmp = strchr(line, ';'))) {
+    if (accept_refused(tmp + 1)) {
+      debugmsg(DEBUG_HTTP, "HTTP: not acceptable: %s\n", line);
+      return 0;
+    }
+    *tmp = '\0'; // ignore other parameters
+  }
+  char *end = line + strlen(line);
+  while (end > line && (end[-1] == ' ' || end[-1] == '\t')) --end;
+  const char trail = *end;
+  *end = '\0';
   if (!strncmp(line, "image/", 6)) {
-    rv |= 1;
+    rv |= ACCEPT_IMAGE;
+    if (!strcmp(line, "image/qoi")) rv |= ACCEPT_QOI;
+    if (!strcmp(line, "image/webp")) rv |= ACCEPT_WEBP;
     debugmsg(DEBUG_HTTP, "HTTP: accept image: %s\n", line);
   } else if (!strcmp(line, "*/*")) {
-    rv |= 2;
+    rv |= ACCEPT_ANY;
     debugmsg(DEBUG_HTTP, "HTTP: accept all: %s\n", line);
   }
+  *end = trail;
   if (tmp) *tmp = ';';
   return rv;
 }
@@ -487,7 +514,7 @@ int protocol_handler(CONN *c, void *unused) {
   }
 
   /* process request */
-  ics_http_handler(c, host, protocol, path, method_str, query, cookie);
+  ics_http_handler(c, host, protocol, path, method_str, query, cookie, accept ? ac : 0);
 
   return(0);
 }
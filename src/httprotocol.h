@@ -60,6 +60,12 @@
 #endif
 
 
+/* flags of the parsed "Accept:" request header */
+#define ACCEPT_IMAGE 1 ///< image/ *
+#define ACCEPT_ANY   2 ///< * / *
+#define ACCEPT_QOI   4 ///< image/qoi is explicitly listed
+#define ACCEPT_WEBP  8 ///< image/webp is explicitly listed
+
 /**
  * @brief HTTP header
  *
@@ -25,10 +25,14 @@
 
 #include <dlog.h>
 #include <ffcompat.h> // harvid.h
+#include <vinfo.h> // harvid.h
+#include <image_seq.h> // harvid.h
 #include "httprotocol.h"
 #include "ics_handler.h"
+#include "image_format.h"
 #include "htmlconst.h"
 #include "enums.h"
+#include "jobs.h"
 
 extern int cfg_usermask;
 extern int cfg_adminmask;
@@ -81,6 +85,7 @@ struct queryparserstate {
   ics_request_args *a;
   char *fn;
   int doit;
+  int method;  ///< encoder method= (webp), -1: default
 };
 
 void parse_param(struct queryparserstate *qps, char *kvp) {
@@ -95,25 +100,81 @@ void parse_param(struct queryparserstate *qps, char *kvp) {
   if (!strcmp (kvp, "frame")) {
     qps->a->frame = atoi(val);
     qps->doit |= 1;
+  } else if (!strcmp (kvp, "end")) {
+    qps->a->frame_end = atoll(val);
   } else if (!strcmp (kvp, "w")) {
     qps->a->out_width  = atoi(val);
   } else if (!strcmp (kvp, "h")) {
     qps->a->out_height = atoi(val);
+  } else if (!strcmp (kvp, "x")) {
+    qps->a->crop_x = atoi(val);
+  } else if (!strcmp (kvp, "y")) {
+    qps->a->crop_y = atoi(val);
+  } else if (!strcmp (kvp, "cw")) {
+    qps->a->crop_w = atoi(val);
+  } else if (!strcmp (kvp, "ch")) {
+    qps->a->crop_h = atoi(val);
+  } else if (!strcmp (kvp, "delta")) {
+    free(qps->a->session);
+    qps->a->session = url_unescape(val, 0, NULL);
+  } else if (!strcmp (kvp, "method")) {
+    qps->method = atoi(val);
+  } else if (!strcmp (kvp, "interval")) {
+    if (val[strlen(val) - 1] == 's') {
+      qps->a->job_interval_sec = atof(val);
+    } else {
+      qps->a->job_interval = atoll(val);
+    }
+  } else if (!strcmp (kvp, "sizes")) {
+    free(qps->a->job_sizes);
+    qps->a->job_sizes = url_unescape(val, 0, NULL);
+  } else if (!strcmp (kvp, "quality")) {
+    qps->a->draft = !strcmp(val, "draft");
+  } else if (!strcmp (kvp, "scale")) {
+         if (!strcmp(val, "fast"))     qps->a->scaler = VSCALE_FAST;
+    else if (!strcmp(val, "bilinear")) qps->a->scaler = VSCALE_BILINEAR;
+    else if (!strcmp(val, "bicubic"))  qps->a->scaler = VSCALE_BICUBIC;
+    else if (!strcmp(val, "area"))     qps->a->scaler = VSCALE_AREA;
+    else if (!strcmp(val, "lanczos"))  qps->a->scaler = VSCALE_LANCZOS;
+    else                               qps->a->scaler = VSCALE_AUTO;
+  } else if (!strcmp (kvp, "keyint")) {
+    qps->a->delta_keyint = atoi(val);
   } else if (!strcmp (kvp, "file")) {
     qps->fn = url_unescape(val, 0, NULL);
     qps->doit |= 2;
   } else if (!strcmp (kvp, "flatindex")) {
     qps->a->idx_option |= OPT_FLAT;
+  } else if (!strcmp (kvp, "thumbs")) {
+    if (atoi(val)) qps->a->idx_option |= OPT_THUMBS;
+  } else if (!strcmp (kvp, "inline")) {
+    if (atoi(val)) qps->a->idx_option |= OPT_THUMBS | OPT_INLINE;
+  } else if (!strcmp (kvp, "all")) {
+    if (atoi(val)) qps->a->idx_option |= OPT_ALLFRAMES;
   } else if (!strcmp (kvp, "format")) {
+    char *ext = strrchr(val, '.');
+    int lz4 = 0;
+    qps->a->fmt_set = 1;
+    if (ext && !strcmp(ext, ".lz4")) { *ext = '\0'; lz4 = 1; }
          if (!strncmp(val, "jpg",3))  {qps->a->render_fmt = FMT_JPG; qps->a->misc_int = atoi(&val[3]);}
     else if (!strncmp(val, "jpeg",4)) {qps->a->render_fmt = FMT_JPG; qps->a->misc_int = atoi(&val[4]);}
     else if (!strcmp(val, "png"))      qps->a->render_fmt = FMT_PNG;
     else if (!strcmp(val, "ppm"))      qps->a->render_fmt = FMT_PPM;
+#ifdef HAVE_WEBP
+    else if (!strcmp(val, "webpll"))  {qps->a->render_fmt = FMT_WEBP; qps->a->misc_int = WEBP_OPT(100, 0, 1);}
+    else if (!strncmp(val, "webp",4)) {qps->a->render_fmt = FMT_WEBP; qps->a->misc_int = WEBP_OPT(atoi(&val[4]), 0, 0);}
+#endif
+    else if (!strcmp(val, "qoi"))     {qps->a->render_fmt = FMT_QOI; qps->a->decode_fmt = AV_PIX_FMT_RGB24; qps->a->misc_int = 3;}
+    else if (!strcmp(val, "qoia"))    {qps->a->render_fmt = FMT_QOI; qps->a->decode_fmt = AV_PIX_FMT_RGBA; qps->a->misc_int = 4;}
     else if (!strcmp(val, "yuv"))     {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_YUV420P;}
     else if (!strcmp(val, "yuv420"))  {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_YUV420P;}
     else if (!strcmp(val, "yuv440"))  {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_YUV440P;}
     else if (!strcmp(val, "yuv422"))  {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_YUYV422;}
     else if (!strcmp(val, "uyv422"))  {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_UYVY422;}
+    else if (!strcmp(val, "yuv422p")) {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_YUV422P;}
+    else if (!strcmp(val, "nv12"))    {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_NV12;}
+    else if (!strcmp(val, "gray"))    {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_GRAY8;}
+    else if (!strcmp(val, "gray8"))   {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_GRAY8;}
+    else if (!strcmp(val, "rgb565"))  {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_RGB565;}
     else if (!strcmp(val, "rgb"))     {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_RGB24;}
     else if (!strcmp(val, "bgr"))     {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_BGR24;}
     else if (!strcmp(val, "rgba"))    {qps->a->render_fmt = FMT_RAW; qps->a->decode_fmt = AV_PIX_FMT_RGBA;}
@@ -125,6 +186,17 @@ void parse_param(struct queryparserstate *qps, char *kvp) {
     else if (!strcmp(val, "json"))    qps->a->render_fmt = OUT_JSON;
     else if (!strcmp(val, "csv"))     qps->a->render_fmt = OUT_CSV;
     else if (!strcmp(val, "plain"))   qps->a->render_fmt = OUT_PLAIN;
+    else if (!strcmp(val, "bin"))     qps->a->render_fmt = OUT_BIN;
+
+    if (lz4 && qps->a->render_fmt == FMT_RAW) {
+#ifdef HAVE_LZ4
+      /* compressed raw frame, the pixel-format is part of the image-cache key */
+      qps->a->render_fmt = FMT_LZ4;
+      qps->a->misc_int = qps->a->decode_fmt;
+#else
+      dlog(DLOG_WARNING, "QUERY: lz4 is not supported, sending uncompressed frame.\n");
+#endif
+    }
   }
 }
 
@@ -138,16 +210,58 @@ static void parse_http_query_params(struct queryparserstate *qps, char *query) {
   if (s) parse_param(qps, s);
 }
 
+/* identify the requesting client (address and delta session, connections
+ * are not kept alive), the decoder tracks backwards stepping per client */
+static int client_key(CONN *c, const char *session) {
+  unsigned int k = 5381;
+  const char *p;
+  for (p = c->client_address; p && *p; ++p) k = k * 33 + (unsigned char)*p;
+  for (p = session; p && *p; ++p) k = k * 33 + (unsigned char)*p;
+  return (k ^ (k >> 15)) & 0x7fff;
+}
+
+/* complete quality and method of webp requests */
+static void webp_options(ics_request_args *a, int method) {
+#ifdef HAVE_WEBP
+  if (a->render_fmt == FMT_WEBP) {
+    int q = WEBP_QUALITY(a->misc_int);
+    int m = method;
+    if (q < 5 || q > 100) q = WEBP_DEFAULT_QUALITY;
+    if (m < 0 || m > 6) m = WEBP_DEFAULT_METHOD;
+    a->misc_int = WEBP_OPT(q, m, WEBP_LOSSLESS(a->misc_int));
+  }
+#endif
+}
+
 static int parse_http_query(CONN *c, char *query, httpheader *h, ics_request_args *a) {
-  struct queryparserstate qps = {a, NULL, 0};
+  struct queryparserstate qps = {a, NULL, 0, -1};
 
   a->decode_fmt = AV_PIX_FMT_RGB24;
   a->render_fmt = FMT_PNG;
   a->frame = 0;
+  a->frame_end = -1;
   a->misc_int = 0;
   a->out_width = a->out_height = -1; // auto-set
 
   parse_http_query_params(&qps, query);
+  a->client = client_key(c, a->session);
+
+  /* content negotiation, unless the format was given explicitly */
+  if (!a->fmt_set && a->accept) {
+    if (h) h->extra = "Vary: Accept";
+    if (a->accept & ACCEPT_QOI) {
+      a->render_fmt = FMT_QOI;
+      a->misc_int = 3;
+    }
+#ifdef HAVE_WEBP
+    else if (a->accept & ACCEPT_WEBP) {
+      a->render_fmt = FMT_WEBP;
+      a->misc_int = WEBP_OPT(0, 0, 0);
+    }
+#endif
+  }
+
+  webp_options(a, qps.method);
 
   /* check for illegal paths */
   if (!qps.fn || check_path(qps.fn)) {
@@ -167,16 +281,16 @@ static int parse_http_query(CONN *c, char *query, httpheader *h, ics_request_arg
       a->file_qurl = qps.fn;
     }
 
-    /* test if file exists or send 404 */
+    /* test if file (or image sequence) exists or send 404 */
     struct stat sb;
-    if (stat(a->file_name, &sb)) {
+    if (imgseq_stat(a->file_name, &sb)) {
       dlog(DLOG_WARNING, "CON: file not found: '%s'\n", a->file_name);
       httperror(c->fd, 404, "Not Found", "file not found.");
       return(-1);
     }
 
     /* check file permissions */
-    if (access(a->file_name, R_OK)) {
+    if (imgseq_access(a->file_name, R_OK)) {
       dlog(DLOG_WARNING, "CON: permission denied for file: '%s'\n", a->file_name);
       httperror(c->fd, 403, NULL, NULL);
       return(-1);
@@ -189,6 +303,67 @@ static int parse_http_query(CONN *c, char *query, httpheader *h, ics_request_arg
   return qps.doit;
 }
 
+#define MAX_BULK_FILES 1024
+
+/**
+ * collect all file= parameters of a bulk request.
+ * Invalid paths are kept in the list with a NULL file_name.
+ * @return number of files
+ */
+static int parse_http_query_files(CONN *c, char *query, ics_request_args *a, char ***files, char ***qurls) {
+  struct queryparserstate qps = {a, NULL, 0, -1};
+  char *t, *s = query;
+  int n = 0;
+
+  a->decode_fmt = AV_PIX_FMT_RGB24;
+  a->render_fmt = OUT_JSON;
+  *files = NULL;
+  *qurls = NULL;
+
+  while (s) {
+    char *kvp = s;
+    if ((t = strpbrk(s, "&?"))) {
+      *t = '\0';
+      s = t + 1;
+    } else {
+      s = NULL;
+    }
+    if (strncmp(kvp, "file=", 5) || strlen(kvp) < 6) {
+      parse_param(&qps, kvp);
+      continue;
+    }
+    if (n >= MAX_BULK_FILES) {
+      continue;
+    }
+    char *fn = url_unescape(&kvp[5], 0, NULL);
+    char **tmp;
+    if (!(tmp = realloc(*files, (n + 1) * sizeof(char*)))) {
+      free(fn);
+      continue;
+    }
+    *files = tmp;
+    if (!(tmp = realloc(*qurls, (n + 1) * sizeof(char*)))) {
+      free(fn);
+      continue;
+    }
+    *qurls = tmp;
+    (*qurls)[n] = fn;
+    (*files)[n] = NULL;
+    if (fn && !check_path(fn)) {
+      (*files)[n] = malloc(1+strlen(c->d->docroot)+strlen(fn)*sizeof(char));
+      sprintf((*files)[n], "%s%s", c->d->docroot, fn);
+#ifdef HAVE_WINDOWS
+      char *tmp;
+      while (tmp = strchr((*files)[n], '/')) *tmp = '\\';
+#endif
+    }
+    n++;
+  }
+  webp_options(a, qps.method);
+  free(qps.fn);
+  return n;
+}
+
 /////////////////////////////////////////////////////////////////////
 // Callbacks -- request handlers
 
@@ -197,14 +372,19 @@ int   hdl_decode_frame (int fd, httpheader *h, ics_request_args *a);
 char *hdl_homepage_html (CONN *c);
 char *hdl_server_status_html (CONN *c);
 char *hdl_file_info (CONN *c, ics_request_args *a);
+char *hdl_file_info_bulk (CONN *c, ics_request_args *a, int n, char **files, char **qurls);
 char *hdl_file_seek (CONN *c, ics_request_args *a);
+int   hdl_file_keyframes (CONN *c, httpheader *h, ics_request_args *a);
 char *hdl_server_info (CONN *c, ics_request_args *a);
 char *hdl_server_version (CONN *c, ics_request_args *a);
+char *hdl_cache_pin (CONN *c, ics_request_args *a, int pin, int range);
+char *hdl_server_config (CONN *c, char *query);
+char *hdl_jobs_submit (CONN *c, ics_request_args *a, int n, char **files);
 void  hdl_clear_cache();
 void  hdl_purge_cache();
 
 // fileindex.c
-void hdl_index_dir (int fd, const char *root, char *base_url, const char *path, int fmt, int opt);
+void hdl_index_dir (int fd, const char *root, char *base_url, const char *path, int fmt, int opt, int tw, int th);
 
 // logo.o
 
@@ -255,7 +435,8 @@ void ics_http_handler(
   CONN *c,
   char *host, char *protocol,
   char *path, char *method_str,
-  char *query, char *cookie
+  char *query, char *cookie,
+  int accept
   ) {
 
   if (CTP("/status")) {
@@ -305,6 +486,7 @@ void ics_http_handler(
     }
     if (a.file_name) free(a.file_name);
     if (a.file_qurl) free(a.file_qurl);
+    if (a.session) free(a.session);
     c->run = 0;
   } else if (CTP("/info")) { /* /info -> /file/info !! */
     ics_request_args a;
@@ -323,6 +505,44 @@ void ics_http_handler(
     }
     if (a.file_name) free(a.file_name);
     if (a.file_qurl) free(a.file_qurl);
+    if (a.session) free(a.session);
+    c->run = 0;
+  } else if (CTP("/bulkinfo")) {
+    ics_request_args a;
+    char **files, **qurls;
+    int i, n;
+    memset(&a, 0, sizeof(ics_request_args));
+    n = parse_http_query_files(c, query, &a, &files, &qurls);
+    if (n > 0) {
+      char *info = hdl_file_info_bulk(c, &a, n, files, qurls);
+      SEND200CT(info, a.render_fmt == OUT_CSV ? "text/csv" : "application/json");
+      free(info);
+    } else {
+      httperror(c->fd, 400, "Bad Request", "<p>Insufficient query parameters.</p>");
+    }
+    for (i = 0; i < n; ++i) {
+      free(files[i]);
+      free(qurls[i]);
+    }
+    free(files);
+    free(qurls);
+    c->run = 0;
+  } else if (CTP("/keyframes")) {
+    ics_request_args a;
+    httpheader h;
+    memset(&a, 0, sizeof(ics_request_args));
+    memset(&h, 0, sizeof(httpheader));
+    int rv = parse_http_query(c, query, &h, &a);
+    if (rv < 0) {
+      ;
+    } else if (rv&2) {
+      hdl_file_keyframes(c, &h, &a);
+    } else {
+      httperror(c->fd, 400, "Bad Request", "<p>Insufficient query parameters.</p>");
+    }
+    if (a.file_name) free(a.file_name);
+    if (a.file_qurl) free(a.file_qurl);
+    if (a.session) free(a.session);
     c->run = 0;
   } else if (CTP("/rc")) {
     ics_request_args a;
@@ -376,7 +596,7 @@ void ics_http_handler(
       snprintf(base_url, 1024, "http://%s%s", host, path);
       if (! (cfg_usermask & USR_FLATINDEX)) a.idx_option &= ~OPT_FLAT;
       SEND200CT("", CONTENT_TYPE_SWITCH(a.render_fmt));
-      hdl_index_dir(c->fd, c->d->docroot, base_url, dp, a.render_fmt, a.idx_option);
+      hdl_index_dir(c->fd, c->d->docroot, base_url, dp, a.render_fmt, a.idx_option, a.out_width, a.out_height);
       free(dp);
       free(qps.fn);
     }
@@ -399,6 +619,87 @@ void ics_http_handler(
       } else {
         httperror(c->fd, 403, NULL, NULL);
       }
+    } else if (   strncasecmp(path,  "/admin/pin", 10) == 0
+               || strncasecmp(path,  "/admin/unpin", 12) == 0) {
+      if (cfg_adminmask & ADM_PIN) {
+        ics_request_args a;
+        memset(&a, 0, sizeof(ics_request_args));
+        int rv = parse_http_query(c, query, NULL, &a);
+        if (rv < 0) {
+          ;
+        } else if (rv&2) {
+          char *msg = hdl_cache_pin(c, &a, strncasecmp(path, "/admin/pin", 10) == 0, rv&1);
+          if (msg) {
+            SEND200(msg);
+            free(msg);
+          }
+        } else {
+          httperror(c->fd, 400, "Bad Request", "<p>Insufficient query parameters.</p>");
+        }
+        if (a.file_name) free(a.file_name);
+        if (a.file_qurl) free(a.file_qurl);
+        if (a.session) free(a.session);
+      } else {
+        httperror(c->fd, 403, NULL, NULL);
+      }
+    } else if (strncasecmp(path,  "/admin/config", 13) == 0) {
+      if (cfg_adminmask & ADM_CONFIG) {
+        char *msg = hdl_server_config(c, query);
+        if (msg) {
+          SEND200(msg);
+          free(msg);
+        }
+      } else {
+        httperror(c->fd, 403, NULL, NULL);
+      }
+    } else if (strncasecmp(path,  "/admin/jobs", 11) == 0) {
+      if (cfg_adminmask & ADM_JOBS) {
+        char *sub = path[11] == '/' ? &path[12] : &path[11];
+        if (strlen(sub) == 0) {
+          /* submit a new job, or list all jobs */
+          ics_request_args a;
+          char **files, **qurls;
+          int i, n;
+          memset(&a, 0, sizeof(ics_request_args));
+          n = parse_http_query_files(c, query, &a, &files, &qurls);
+          if (n > 0) {
+            char *msg = hdl_jobs_submit(c, &a, n, files);
+            if (msg) {
+              SEND200CT(msg, "application/json");
+              free(msg);
+            }
+          } else {
+            char *msg = jobs_status_json(-1);
+            SEND200CT(msg, "application/json");
+            free(msg);
+          }
+          for (i = 0; i < n; ++i) {
+            free(files[i]);
+            free(qurls[i]);
+          }
+          free(files);
+          free(qurls);
+          free(a.job_sizes);
+          free(a.session);
+        } else {
+          /* /admin/jobs/ID, /admin/jobs/ID/cancel */
+          char *end;
+          long id = strtol(sub, &end, 10);
+          char *msg;
+          if (end == sub || id < 0 || (*end && strcmp(end, "/") && strcasecmp(end, "/cancel"))) {
+            httperror(c->fd, 400, "Bad Request", "<p>Invalid job request.</p>");
+          } else if (!strcasecmp(end, "/cancel") && jobs_cancel(id)) {
+            httperror(c->fd, 404, "Not Found", "<p>No such job.</p>");
+          } else if (!(msg = jobs_status_json(id))) {
+            httperror(c->fd, 404, "Not Found", "<p>No such job.</p>");
+          } else {
+            SEND200CT(msg, "application/json");
+            free(msg);
+          }
+        }
+      } else {
+        httperror(c->fd, 403, NULL, NULL);
+      }
     } else if (strncasecmp(path,  "/admin/shutdown", 15) == 0) {
       if (cfg_adminmask & ADM_SHUTDOWN) {
         SEND200(OK200MSG("shutdown queued\n"));
@@ -424,6 +725,7 @@ void ics_http_handler(
     httpheader h;
     memset(&a, 0, sizeof(ics_request_args));
     memset(&h, 0, sizeof(httpheader));
+    a.accept = accept;
     int rv = parse_http_query(c, query, &h, &a);
     if (rv < 0) {
       ;
@@ -434,6 +736,7 @@ void ics_http_handler(
     }
     if (a.file_name) free(a.file_name);
     if (a.file_qurl) free(a.file_qurl);
+    if (a.session) free(a.session);
     c->run = 0;
   }
   else
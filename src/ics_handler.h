@@ -31,18 +31,46 @@ typedef struct {
   char *file_name;
   char *file_qurl;
   int64_t frame;
+  int64_t frame_end; ///< last frame of a range (/admin/pin), -1: unset
   int decode_fmt;
   int render_fmt;
   int out_width;
   int out_height;
+  int crop_x;    ///< source region of interest, left edge
+  int crop_y;    ///< source region of interest, top edge
+  int crop_w;    ///< source region width, 0: complete frame
+  int crop_h;    ///< source region height, 0: complete frame
+  char *session;     ///< raw delta session name, NULL: send complete frames
+  int delta_keyint;  ///< raw delta keyframe interval, 0: default
+  int client;        ///< client address and delta session, see VDEC_CLIENT()
+  int accept;        ///< ACCEPT_* flags, used to pick the default image format
+  int fmt_set;       ///< format= was given explicitly
+  int draft;         ///< quality=draft, allow reduced resolution decoding
+  int scaler;        ///< scale=, VSCALE_*
   int idx_option;
-  int misc_int; // currently used for jpeg quality only
+  int64_t job_interval;    ///< background job: render every Nth frame, 0: unset
+  double job_interval_sec; ///< background job: interval in seconds, 0: unset
+  char *job_sizes;         ///< background job: comma separated list of WxH
+  int misc_int; // format option: jpeg quality, webp options, qoi channels, lz4 pix-fmt
 } ics_request_args;
 
+/**
+ * @brief poster thumbnail request
+ *
+ * used by the index to pre-render thumbnails into the image cache
+ */
+typedef struct {
+  char *file_name; ///< absolute path of the video file
+  uint8_t *data;   ///< encoded image, only if requested (free() after use)
+  size_t len;      ///< size of data in bytes
+  int status;      ///< 0 on success, HTTP error code otherwise
+} PosterJob;
+
 void ics_http_handler(
   CONN *c,
   char *host, char *protocol,
   char *path, char *method_str,
-  char *query, char *cookie
+  char *query, char *cookie,
+  int accept
   );
 #endif
@@ -32,12 +32,91 @@
 #include <jpeglib.h>
 #include <png.h>
 
+#include <pthread.h>
+#include <assert.h>
+
+#ifdef HAVE_WEBP
+#include <webp/encode.h>
+#endif
+
 #include <dlog.h>
 #include <vinfo.h> // harvid.h
 #include "enums.h"
+#include "image_format.h"
 
 #define JPEG_QUALITY 75
 
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#include "parallel.h"
+
+#define LZ4_CHUNK (1 << 20) ///< compress larger frames in parallel, one LZ4 frame per chunk
+
+extern int max_decoder_threads;
+
+typedef struct {
+  const uint8_t *src;
+  size_t len;
+  uint8_t *dst;
+  size_t dst_len;
+} LZ4Chunk;
+
+static void lz4_worker(void *arg, int i) {
+  LZ4Chunk *c = &((LZ4Chunk*)arg)[i];
+  LZ4F_preferences_t prefs;
+  size_t bound;
+  memset(&prefs, 0, sizeof(LZ4F_preferences_t));
+  prefs.frameInfo.blockSizeID = LZ4F_max1MB;
+  prefs.frameInfo.contentSize = c->len;
+  bound = LZ4F_compressFrameBound(c->len, &prefs);
+  c->dst = malloc(bound);
+  c->dst_len = LZ4F_compressFrame(c->dst, bound, c->src, c->len, &prefs);
+  if (LZ4F_isError(c->dst_len)) {
+    dlog(LOG_ERR, "IMF: lz4 compression failed: %s\n", LZ4F_getErrorName(c->dst_len));
+    c->dst_len = 0;
+  }
+}
+
+/* the raw frame is split into chunks which are compressed
+ * concurrently. The result is a sequence of concatenated LZ4 frames
+ * (standard LZ4 frame format, e.g. `lz4 -d` decompresses it) */
+static size_t write_lz4(uint8_t **out, VInfo *ji, uint8_t *buf) {
+  const size_t len = ji->buffersize;
+  const int n = (len + LZ4_CHUNK - 1) / LZ4_CHUNK;
+  LZ4Chunk *c;
+  size_t rv = 0;
+  int i;
+
+  *out = NULL;
+  if (len == 0) return 0;
+
+  c = calloc(n, sizeof(LZ4Chunk));
+  for (i = 0; i < n; ++i) {
+    c[i].src = buf + (size_t) i * LZ4_CHUNK;
+    c[i].len = (i == n - 1) ? len - (size_t) i * LZ4_CHUNK : LZ4_CHUNK;
+  }
+
+  parallel_for(n, max_decoder_threads > 2 ? max_decoder_threads / 2 : 1, lz4_worker, c);
+
+  for (i = 0; i < n; ++i) {
+    if (c[i].dst_len == 0) { rv = 0; break; }
+    rv += c[i].dst_len;
+  }
+  if (rv > 0) {
+    uint8_t *p = *out = malloc(rv);
+    for (i = 0; i < n; ++i) {
+      memcpy(p, c[i].dst, c[i].dst_len);
+      p += c[i].dst_len;
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    free(c[i].dst);
+  }
+  free(c);
+  return rv;
+}
+#endif
+
 static int write_jpeg(VInfo *ji, uint8_t *buffer, int quality, FILE *x) {
   uint8_t *line;
   int n, y = 0, i, line_width;
@@ -88,6 +167,99 @@ static int write_jpeg(VInfo *ji, uint8_t *buffer, int quality, FILE *x) {
   return(0);
 }
 
+/* QOI - the "Quite OK Image Format", https://qoiformat.org/ */
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_HASH(C) ((C)[0] * 3 + (C)[1] * 5 + (C)[2] * 7 + (C)[3] * 11)
+
+static void qoi_write32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+/* encode packed RGB24 (channels = 3) or RGBA (channels = 4) directly
+ * from the raw frame buffer */
+static size_t write_qoi(uint8_t **out, VInfo *ji, uint8_t *image, int channels) {
+  const size_t n_px = (size_t) ji->out_width * ji->out_height;
+  const uint8_t *px = image;
+  const uint8_t *end = image + n_px * channels;
+  uint8_t index[64][4];
+  uint8_t prev[4] = {0, 0, 0, 255};
+  uint8_t cur[4] = {0, 0, 0, 255};
+  uint8_t *p;
+  int run = 0;
+
+  *out = malloc(14 + n_px * (channels + 1) + 8);
+  if (!*out) return 0;
+  memset(index, 0, sizeof(index));
+
+  p = *out;
+  memcpy(p, "qoif", 4);
+  qoi_write32(p + 4, ji->out_width);
+  qoi_write32(p + 8, ji->out_height);
+  p[12] = channels;
+  p[13] = 0; // sRGB with linear alpha
+  p += 14;
+
+  for (; px < end; px += channels) {
+    memcpy(cur, px, channels);
+
+    if (!memcmp(cur, prev, 4)) {
+      if (++run == 62) {
+        *p++ = QOI_OP_RUN | (run - 1);
+        run = 0;
+      }
+      continue;
+    }
+    if (run > 0) {
+      *p++ = QOI_OP_RUN | (run - 1);
+      run = 0;
+    }
+
+    const int h = QOI_HASH(cur) & 63;
+    if (!memcmp(index[h], cur, 4)) {
+      *p++ = QOI_OP_INDEX | h;
+    } else {
+      memcpy(index[h], cur, 4);
+      if (cur[3] == prev[3]) {
+        const signed char vr = cur[0] - prev[0];
+        const signed char vg = cur[1] - prev[1];
+        const signed char vb = cur[2] - prev[2];
+        const signed char vg_r = vr - vg;
+        const signed char vg_b = vb - vg;
+        if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+          *p++ = QOI_OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2);
+        } else if (vg_r > -9 && vg_r < 8 && vg > -33 && vg < 32 && vg_b > -9 && vg_b < 8) {
+          *p++ = QOI_OP_LUMA | (vg + 32);
+          *p++ = (vg_r + 8) << 4 | (vg_b + 8);
+        } else {
+          *p++ = QOI_OP_RGB;
+          *p++ = cur[0]; *p++ = cur[1]; *p++ = cur[2];
+        }
+      } else {
+        *p++ = QOI_OP_RGBA;
+        *p++ = cur[0]; *p++ = cur[1]; *p++ = cur[2]; *p++ = cur[3];
+      }
+    }
+    memcpy(prev, cur, 4);
+  }
+  if (run > 0) {
+    *p++ = QOI_OP_RUN | (run - 1);
+  }
+
+  memcpy(p, "\0\0\0\0\0\0\0\1", 8);
+  p += 8;
+
+  /* release the worst-case allocation, the image goes to the cache */
+  const size_t rv = p - *out;
+  p = realloc(*out, rv);
+  if (p) *out = p;
+  return rv;
+}
+
 static int write_png(VInfo *ji, uint8_t *image, FILE *x) {
   register int y;
   png_bytep rowpointers[ji->out_height];
@@ -122,6 +294,56 @@ static int write_png(VInfo *ji, uint8_t *image, FILE *x) {
   return(0);
 }
 
+#ifdef HAVE_WEBP
+static size_t write_webp(uint8_t **out, VInfo *ji, uint8_t *image, int opt) {
+  WebPConfig config;
+  WebPPicture pic;
+  WebPMemoryWriter wr;
+  size_t rv = 0;
+
+  *out = NULL;
+  if (!WebPConfigInit(&config) || !WebPPictureInit(&pic)) {
+    dlog(LOG_ERR, "IMF: libwebp version mismatch\n");
+    return 0;
+  }
+
+  config.lossless = WEBP_LOSSLESS(opt) ? 1 : 0;
+  config.quality = WEBP_QUALITY(opt);
+  config.method = WEBP_METHOD(opt);
+  if (!WebPValidateConfig(&config)) {
+    dlog(LOG_ERR, "IMF: invalid webp config q:%d m:%d\n", WEBP_QUALITY(opt), WEBP_METHOD(opt));
+    return 0;
+  }
+
+  pic.use_argb = config.lossless;
+  pic.width = ji->out_width;
+  pic.height = ji->out_height;
+  if (!WebPPictureImportRGB(&pic, image, 3 * ji->out_width)) {
+    dlog(LOG_ERR, "IMF: webp picture allocation failed\n");
+    return 0;
+  }
+
+  WebPMemoryWriterInit(&wr);
+  pic.writer = WebPMemoryWrite;
+  pic.custom_ptr = &wr;
+  if (WebPEncode(&config, &pic)) {
+    /* the image-cache free()s the buffer, don't hand out libwebp's allocation */
+    *out = malloc(wr.size);
+    memcpy(*out, wr.mem, wr.size);
+    rv = wr.size;
+  } else {
+    dlog(LOG_ERR, "IMF: webp encoding failed (error %d)\n", pic.error_code);
+  }
+  WebPPictureFree(&pic);
+#if WEBP_ENCODER_ABI_VERSION > 0x0203
+  WebPMemoryWriterClear(&wr);
+#else
+  free(wr.mem);
+#endif
+  return rv;
+}
+#endif
+
 static int write_ppm(VInfo *ji, uint8_t *image, FILE *x) {
 
   fprintf(x, "P6\n%d %d\n255\n", ji->out_width, ji->out_height);
@@ -135,10 +357,23 @@ static FILE *open_outfile(char *filename) {
   return fopen(filename, "w+");
 }
 
-size_t format_image(uint8_t **out, int render_fmt, int misc_int, VInfo *ji, uint8_t *buf) {
+static size_t encode_image(uint8_t **out, int render_fmt, int misc_int, VInfo *ji, uint8_t *buf) {
 #ifdef HAVE_WINDOWS
   char tfn[64] = "";
 #endif
+#ifdef HAVE_LZ4
+  if (render_fmt == FMT_LZ4) {
+    return write_lz4(out, ji, buf);
+  }
+#endif
+  if (render_fmt == FMT_QOI) {
+    return write_qoi(out, ji, buf, misc_int == 4 ? 4 : 3);
+  }
+#ifdef HAVE_WEBP
+  if (render_fmt == FMT_WEBP) {
+    return write_webp(out, ji, buf, misc_int);
+  }
+#endif
 #ifdef __USE_XOPEN2K8
   size_t rs = 0;
   FILE *x = open_memstream((char**) out, &rs);
@@ -218,6 +453,70 @@ size_t format_image(uint8_t **out, int render_fmt, int misc_int, VInfo *ji, uint
   return (rsize);
 }
 
+/* per format encoder statistics */
+#define IMF_NFMT (FMT_WEBP + 1)
+
+typedef struct {
+  uint64_t count;
+  uint64_t bytes;
+  uint64_t pixels;
+  uint64_t usec;
+} EncodeStats;
+
+static EncodeStats imf_stats[IMF_NFMT];
+static pthread_mutex_t imf_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *imf_fmt_name(int fmt) {
+  switch (fmt) {
+    case FMT_JPG:  return "JPEG";
+    case FMT_PNG:  return "PNG";
+    case FMT_PPM:  return "PPM";
+    case FMT_LZ4:  return "LZ4";
+    case FMT_QOI:  return "QOI";
+    case FMT_WEBP: return "WebP";
+    default:       return NULL;
+  }
+}
+
+size_t format_image(uint8_t **out, int render_fmt, int misc_int, VInfo *ji, uint8_t *buf) {
+  struct timeval t0, t1;
+  size_t rv;
+
+  gettimeofday(&t0, NULL);
+  rv = encode_image(out, render_fmt, misc_int, ji, buf);
+  gettimeofday(&t1, NULL);
+
+  if (rv > 0 && render_fmt > 0 && render_fmt < IMF_NFMT) {
+    pthread_mutex_lock(&imf_stats_lock);
+    imf_stats[render_fmt].count++;
+    imf_stats[render_fmt].bytes += rv;
+    imf_stats[render_fmt].pixels += (uint64_t) ji->out_width * ji->out_height;
+    imf_stats[render_fmt].usec += (t1.tv_sec - t0.tv_sec) * 1000000LL + (t1.tv_usec - t0.tv_usec);
+    pthread_mutex_unlock(&imf_stats_lock);
+  }
+  return rv;
+}
+
+void format_info_html(char **m, size_t *o, size_t *s) {
+  int i;
+  rprintf("<h3>Image Encoders:</h3>\n");
+  rprintf("<table style=\"text-align:center;width:100%%\">\n");
+  rprintf("<tr><th>Format</th><th>Images</th><th>Avg. Size</th><th>Bits/Pixel</th><th>Avg. Encode Time</th><th>Throughput</th></tr>\n");
+  pthread_mutex_lock(&imf_stats_lock);
+  for (i = 1; i < IMF_NFMT; ++i) {
+    const EncodeStats *es = &imf_stats[i];
+    if (!imf_fmt_name(i) || es->count == 0) continue;
+    rprintf("<tr><td>%s</td><td>%"PRIlld"</td><td>%.1f KiB</td><td>%.2f</td><td>%.2f ms</td><td>%.1f MPixel/s</td></tr>\n",
+        imf_fmt_name(i), (long long) es->count,
+        es->bytes / 1024.0 / es->count,
+        es->pixels > 0 ? 8.0 * es->bytes / es->pixels : 0,
+        es->usec / 1000.0 / es->count,
+        es->usec > 0 ? (double) es->pixels / es->usec : 0);
+  }
+  pthread_mutex_unlock(&imf_stats_lock);
+  rprintf("</table>\n");
+}
+
 void write_image(char *file_name, int render_fmt, VInfo *ji, uint8_t *buf) {
   FILE *x;
   if ((x = open_outfile(file_name))) {
@@ -234,6 +533,15 @@ void write_image(char *file_name, int render_fmt, VInfo *ji, uint8_t *buf) {
 	if (write_ppm(ji, buf, x))
 	  dlog(LOG_ERR, "IMF: Could not write ppm: %s\n", file_name);
 	break;
+      case FMT_QOI:
+	{
+	  uint8_t *qoi = NULL;
+	  size_t len = write_qoi(&qoi, ji, buf, 3);
+	  if (len == 0 || fwrite(qoi, len, 1, x) != 1)
+	    dlog(LOG_ERR, "IMF: Could not write qoi: %s\n", file_name);
+	  free(qoi);
+	}
+	break;
       default:
 	dlog(LOG_ERR, "IMF: Unknown outformat %d\n", render_fmt);
 	break;
@@ -33,5 +33,16 @@ size_t format_image(uint8_t **out, int render_fmt, int misc_int, VInfo *ji, uint
  */
 void write_image(char *file_name, int render_fmt, VInfo *ji, uint8_t *buf);
 
+/* FMT_WEBP options (misc_int): quality, method (0: fast .. 6: small), lossless */
+#define WEBP_DEFAULT_QUALITY 75
+#define WEBP_DEFAULT_METHOD 4
+#define WEBP_OPT(Q, M, LL) (((Q) & 0xff) | (((M) & 0xf) << 8) | ((LL) ? 0x1000 : 0))
+#define WEBP_QUALITY(O) ((O) & 0xff)
+#define WEBP_METHOD(O) (((O) >> 8) & 0xf)
+#define WEBP_LOSSLESS(O) ((O) & 0x1000)
+
+/** HTML format per image-format encoder statistics (count, size, time) */
+void format_info_html(char **m, size_t *o, size_t *s);
+
 
 #endif
@@ -0,0 +1,358 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <dlog.h>
+#include "jobs.h"
+
+// harvid.c
+int hdl_job_file_info (const char *fn, int64_t *frames, double *fps);
+int hdl_job_render (const char *fn, int64_t frame, int w, int h, const JobSpec *spec);
+int hdl_spare_decoders (void);
+
+enum {JOB_QUEUED = 0, JOB_RUNNING, JOB_DONE, JOB_CANCELLED};
+static const char *job_state_names[] = {"queued", "running", "done", "cancelled"};
+
+typedef struct Job {
+  int id;
+  int state;
+  int cancel;
+  char **files;
+  int n_files;
+  JobSpec spec;
+  int64_t total;   ///< number of images, known once the job is running
+  int64_t done;    ///< images rendered (or found in cache)
+  int64_t failed;  ///< images that could not be rendered
+  int file;        ///< index of the file being processed
+  time_t queued;
+  struct timeval t_start;
+  struct timeval t_end;
+  struct Job *next;
+} Job;
+
+/* all of the below is protected by jobs_lock */
+static Job *jobs = NULL;
+static int jobs_next_id = 1;
+static int jobs_quit = 0;
+static int jobs_thread_active = 0;
+static pthread_t jobs_thread;
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+
+static void job_free(Job *j) {
+  int i;
+  for (i = 0; i < j->n_files; ++i) {
+    free(j->files[i]);
+  }
+  free(j->files);
+  free(j);
+}
+
+/* forget the oldest finished jobs, NB. jobs_lock must be held */
+static void jobs_expire(void) {
+  Job *j, *prev = NULL;
+  int n = 0;
+  for (j = jobs; j; j = j->next) ++n;
+  j = jobs;
+  while (j && n > JOBS_MAX_KEEP) {
+    Job *next = j->next;
+    if (j->state == JOB_DONE || j->state == JOB_CANCELLED) {
+      if (prev) prev->next = next; else jobs = next;
+      job_free(j);
+      --n;
+    } else {
+      prev = j;
+    }
+    j = next;
+  }
+}
+
+static Job *job_find(int id) {
+  Job *j;
+  for (j = jobs; j; j = j->next) {
+    if (j->id == id) return j;
+  }
+  return NULL;
+}
+
+static double tv_diff(const struct timeval *t1, const struct timeval *t0) {
+  return (t1->tv_sec - t0->tv_sec) + (t1->tv_usec - t0->tv_usec) / 1e6;
+}
+
+static int job_cancelled(Job *j) {
+  int rv;
+  pthread_mutex_lock(&jobs_lock);
+  rv = j->cancel || jobs_quit;
+  pthread_mutex_unlock(&jobs_lock);
+  return rv;
+}
+
+/* interactive requests have priority, wait for a spare decoder */
+static int job_yield(Job *j) {
+  while (hdl_spare_decoders() < 1) {
+    if (job_cancelled(j)) return -1;
+    mymsleep(20);
+  }
+  return job_cancelled(j) ? -1 : 0;
+}
+
+static void job_run(Job *j) {
+  int64_t *frames = calloc(j->n_files, sizeof(int64_t));
+  int64_t *step = calloc(j->n_files, sizeof(int64_t));
+  int64_t total = 0, failed = 0;
+  int i, s;
+
+  /* count images, this only probes the files */
+  for (i = 0; i < j->n_files; ++i) {
+    double fps = 0;
+    if (hdl_job_file_info(j->files[i], &frames[i], &fps) || frames[i] < 1) {
+      dlog(DLOG_WARNING, "JOB: %d cannot read file '%s'\n", j->id, j->files[i]);
+      frames[i] = 0;
+      failed++;
+      continue;
+    }
+    if (j->spec.interval_sec > 0 && fps > 0) {
+      step[i] = llrint(j->spec.interval_sec * fps);
+    } else {
+      step[i] = j->spec.interval;
+    }
+    if (step[i] < 1) step[i] = 1;
+    total += j->spec.n_sizes * ((frames[i] + step[i] - 1) / step[i]);
+  }
+
+  pthread_mutex_lock(&jobs_lock);
+  j->total = total;
+  j->failed = failed;
+  pthread_mutex_unlock(&jobs_lock);
+
+  /* frames of a file are rendered in order, one geometry at a time,
+   * so that the decoder can read ahead rather than seek */
+  for (i = 0; i < j->n_files; ++i) {
+    pthread_mutex_lock(&jobs_lock);
+    j->file = i;
+    pthread_mutex_unlock(&jobs_lock);
+    for (s = 0; s < j->spec.n_sizes; ++s) {
+      int64_t f;
+      for (f = 0; f < frames[i]; f += step[i]) {
+        int rv;
+        if (job_yield(j)) goto out;
+        rv = hdl_job_render(j->files[i], f, j->spec.w[s], j->spec.h[s], &j->spec);
+        pthread_mutex_lock(&jobs_lock);
+        if (rv) j->failed++; else j->done++;
+        pthread_mutex_unlock(&jobs_lock);
+      }
+    }
+  }
+out:
+  free(frames);
+  free(step);
+}
+
+static void *jobs_worker(void *arg) {
+  pthread_mutex_lock(&jobs_lock);
+  while (!jobs_quit) {
+    Job *j;
+    for (j = jobs; j; j = j->next) {
+      if (j->state == JOB_QUEUED) break;
+    }
+    if (!j) {
+      pthread_cond_wait(&jobs_cond, &jobs_lock);
+      continue;
+    }
+    if (j->cancel) {
+      j->state = JOB_CANCELLED;
+      continue;
+    }
+    j->state = JOB_RUNNING;
+    gettimeofday(&j->t_start, NULL);
+    pthread_mutex_unlock(&jobs_lock);
+
+    dlog(DLOG_INFO, "JOB: %d started, %d file(s)\n", j->id, j->n_files);
+    job_run(j);
+
+    pthread_mutex_lock(&jobs_lock);
+    gettimeofday(&j->t_end, NULL);
+    j->state = j->cancel ? JOB_CANCELLED : JOB_DONE;
+    dlog(DLOG_INFO, "JOB: %d %s, %"PRId64" image(s) in %.1f sec\n", j->id,
+        job_state_names[j->state], j->done, tv_diff(&j->t_end, &j->t_start));
+    jobs_expire();
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// public API
+
+int jobs_submit(char **files, int n, const JobSpec *spec) {
+  Job *j = calloc(1, sizeof(Job));
+  int id;
+  j->files = files;
+  j->n_files = n;
+  memcpy(&j->spec, spec, sizeof(JobSpec));
+  if (j->spec.n_sizes < 1) {
+    j->spec.n_sizes = 1;
+    j->spec.w[0] = j->spec.h[0] = 0;
+  }
+  j->state = JOB_QUEUED;
+  j->queued = time(NULL);
+
+  pthread_mutex_lock(&jobs_lock);
+  id = j->id = jobs_next_id++;
+  if (!jobs) {
+    jobs = j;
+  } else {
+    Job *t = jobs;
+    while (t->next) t = t->next;
+    t->next = j;
+  }
+  if (!jobs_thread_active && !jobs_quit) {
+    if (pthread_create(&jobs_thread, NULL, jobs_worker, NULL)) {
+      dlog(DLOG_ERR, "JOB: cannot create worker thread.\n");
+    } else {
+      jobs_thread_active = 1;
+    }
+  }
+  pthread_cond_signal(&jobs_cond);
+  pthread_mutex_unlock(&jobs_lock);
+  return id;
+}
+
+int jobs_cancel(int id) {
+  Job *j;
+  int rv = -1;
+  pthread_mutex_lock(&jobs_lock);
+  if ((j = job_find(id))) {
+    j->cancel = 1;
+    if (j->state == JOB_QUEUED) {
+      j->state = JOB_CANCELLED;
+    }
+    rv = 0;
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  return rv;
+}
+
+void jobs_shutdown(void) {
+  Job *j;
+  pthread_mutex_lock(&jobs_lock);
+  jobs_quit = 1;
+  pthread_cond_signal(&jobs_cond);
+  pthread_mutex_unlock(&jobs_lock);
+  if (jobs_thread_active) {
+    pthread_join(jobs_thread, NULL);
+    jobs_thread_active = 0;
+  }
+  while ((j = jobs)) {
+    jobs = j->next;
+    job_free(j);
+  }
+}
+
+/* NB. jobs_lock must be held */
+static void job_json(Job *j, char **m, size_t *o, size_t *s) {
+  struct timeval now;
+  double elapsed = 0, rate = 0, eta = -1, progress = 0;
+  int64_t processed = j->done + j->failed;
+
+  if (j->state == JOB_RUNNING) {
+    gettimeofday(&now, NULL);
+    elapsed = tv_diff(&now, &j->t_start);
+  } else if (j->state != JOB_QUEUED && j->t_start.tv_sec > 0) {
+    elapsed = tv_diff(&j->t_end, &j->t_start);
+  }
+  if (elapsed > 0) {
+    rate = processed / elapsed;
+  }
+  if (j->total > 0) {
+    progress = 100.0 * processed / (double) j->total;
+  }
+  if (j->state == JOB_RUNNING && rate > 0 && j->total > 0) {
+    eta = (j->total - processed) / rate;
+  } else if (j->state == JOB_DONE) {
+    eta = 0;
+  }
+
+  rprintf("{\"id\":%d,\"state\":\"%s\"", j->id, job_state_names[j->state]);
+  rprintf(",\"files\":%d,\"file\":%d", j->n_files, j->file);
+  rprintf(",\"total\":%"PRId64",\"done\":%"PRId64",\"failed\":%"PRId64, j->total, j->done, j->failed);
+  rprintf(",\"progress\":%.1f,\"elapsed\":%.1f,\"throughput\":%.2f", progress, elapsed, rate);
+  if (eta >= 0) {
+    rprintf(",\"eta\":%.1f}", eta);
+  } else {
+    rprintf(",\"eta\":null}");
+  }
+}
+
+char *jobs_status_json(int id) {
+  Job *j;
+  size_t ss = 256, off = 0;
+  char *sm;
+  pthread_mutex_lock(&jobs_lock);
+  if (id >= 0 && !(j = job_find(id))) {
+    pthread_mutex_unlock(&jobs_lock);
+    return NULL;
+  }
+  sm = malloc(ss * sizeof(char));
+  sm[0] = '\0';
+  if (id >= 0) {
+    job_json(j, &sm, &off, &ss);
+  } else {
+    rpprintf(&sm, &off, &ss, "[");
+    for (j = jobs; j; j = j->next) {
+      if (j != jobs) rpprintf(&sm, &off, &ss, ",");
+      job_json(j, &sm, &off, &ss);
+    }
+    rpprintf(&sm, &off, &ss, "]");
+  }
+  pthread_mutex_unlock(&jobs_lock);
+  return sm;
+}
+
+void jobs_info_html(char **m, size_t *o, size_t *s) {
+  Job *j;
+  int n = 0;
+  pthread_mutex_lock(&jobs_lock);
+  for (j = jobs; j; j = j->next) ++n;
+  rprintf("<h3>Background Jobs:</h3>\n");
+  rprintf("<p>jobs: %d</p>\n", n);
+  if (n > 0) {
+    rprintf("<table style=\"text-align:center;width:100%%\">\n");
+    rprintf("<tr><th>#</th><th>State</th><th>Files</th><th>Images</th><th>Failed</th><th>Total</th></tr>\n");
+    for (j = jobs; j; j = j->next) {
+      rprintf("<tr><td>%d</td><td>%s</td><td>%d / %d</td><td>%"PRId64"</td><td>%"PRId64"</td><td>%"PRId64"</td></tr>\n",
+          j->id, job_state_names[j->state], j->file + (j->state == JOB_DONE ? 1 : 0), j->n_files,
+          j->done, j->failed, j->total);
+    }
+    rprintf("</table>\n");
+  }
+  pthread_mutex_unlock(&jobs_lock);
+}
+
+// vim:sw=2 sts=2 ts=8 et:
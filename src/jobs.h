@@ -0,0 +1,74 @@
+/**
+   @file jobs.h
+   @brief background thumbnail pre-generation
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _jobs_H
+#define _jobs_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define JOBS_MAX_SIZES 8  ///< max. number of geometries per job
+#define JOBS_MAX_KEEP 64  ///< finished jobs are forgotten beyond this number
+
+/** job parameters */
+typedef struct {
+  int64_t interval;      ///< render every Nth frame
+  double interval_sec;   ///< if > 0, interval in seconds (overrides \a interval)
+  int n_sizes;
+  short w[JOBS_MAX_SIZES]; ///< requested width, 0: auto
+  short h[JOBS_MAX_SIZES]; ///< requested height, 0: auto
+  int render_fmt;        ///< image format (FMT_*)
+  int misc_int;          ///< format option, as in ics_request_args
+  int decode_fmt;        ///< pixel-format to decode to
+  int draft;             ///< allow reduced resolution decoding (quality=draft)
+  int scaler;            ///< VSCALE_*
+} JobSpec;
+
+/**
+ * queue a job. Jobs are processed one at a time by a background thread,
+ * which only decodes while spare decoders are available.
+ * @param files absolute file-names, the job takes ownership of the array and strings
+ * @param n number of files
+ * @param spec job parameters
+ * @return job id
+ */
+int jobs_submit(char **files, int n, const JobSpec *spec);
+
+/** cancel a queued or running job
+ * @return 0 on success, -1 if there is no such job
+ */
+int jobs_cancel(int id);
+
+/** JSON formatted state of a job, or of all jobs if \a id < 0
+ * @return newly allocated string to be free()d, NULL if there is no such job
+ */
+char *jobs_status_json(int id);
+
+/** cancel all jobs and stop the background thread */
+void jobs_shutdown(void);
+
+/** HTML format job summary */
+void jobs_info_html(char **m, size_t *o, size_t *s);
+
+#endif
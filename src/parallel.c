@@ -0,0 +1,81 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <dlog.h>
+#include "parallel.h"
+
+typedef struct {
+  pthread_mutex_t lock;
+  int next;
+  int n;
+  parallel_fn fn;
+  void *arg;
+} ParallelJob;
+
+static void *parallel_worker(void *arg) {
+  ParallelJob *pj = (ParallelJob*) arg;
+  while (1) {
+    int idx;
+    pthread_mutex_lock(&pj->lock);
+    idx = pj->next++;
+    pthread_mutex_unlock(&pj->lock);
+    if (idx >= pj->n) break;
+    pj->fn(pj->arg, idx);
+  }
+  return NULL;
+}
+
+void parallel_for(int n, int max_threads, parallel_fn fn, void *arg) {
+  ParallelJob pj;
+  pthread_t *threads;
+  int i, nt = 0;
+
+  if (n < 1) return;
+  if (max_threads > n) max_threads = n;
+  if (max_threads < 1) max_threads = 1;
+
+  pj.next = 0;
+  pj.n = n;
+  pj.fn = fn;
+  pj.arg = arg;
+  pthread_mutex_init(&pj.lock, NULL);
+
+  /* the calling thread is a worker, too */
+  threads = (pthread_t*) malloc((max_threads - 1) * sizeof(pthread_t) + 1);
+  for (i = 0; i < max_threads - 1; ++i) {
+    if (pthread_create(&threads[nt], NULL, parallel_worker, &pj)) {
+      dlog(DLOG_WARNING, "SRV: cannot create worker thread.\n");
+      break;
+    }
+    ++nt;
+  }
+
+  parallel_worker(&pj);
+
+  for (i = 0; i < nt; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&pj.lock);
+}
+
+// vim:sw=2 sts=2 ts=8 et:
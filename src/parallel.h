@@ -0,0 +1,46 @@
+/**
+   @file parallel.h
+   @brief bounded worker pool
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _parallel_H
+#define _parallel_H
+
+/** work callback
+ * @param arg user data passed to \ref parallel_for
+ * @param idx item to process, 0 <= idx < n
+ */
+typedef void (*parallel_fn)(void *arg, int idx);
+
+/**
+ * call \a fn for every item 0..n-1 using at most \a max_threads threads
+ * (including the calling thread). Items are processed in no particular
+ * order; the function returns when all items are done.
+ *
+ * @param n number of items
+ * @param max_threads upper bound of concurrent workers
+ * @param fn callback
+ * @param arg user data passed to \a fn
+ */
+void parallel_for(int n, int max_threads, parallel_fn fn, void *arg);
+
+#endif
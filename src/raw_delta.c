@@ -0,0 +1,347 @@
+/*
+   This file is part of harvid
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include <dlog.h>
+#include "ffcompat.h"
+#include <libavutil/pixdesc.h>
+#include "raw_delta.h"
+
+//#define HASH_EMIT_KEYS 3
+#define HASH_FUNCTION HASH_SAX
+#include "uthash.h"
+
+#define RDELTA_MAX_SESSIONS 32 ///< max. number of sessions (each keeps one raw frame)
+#define RDELTA_TIMEOUT 300     ///< idle sessions expire after this many seconds
+
+#define RD_CEIL_RSHIFT(a,b) (-((-(a)) >> (b)))
+
+typedef struct {
+  char *name;
+  unsigned short vid;
+  int w;
+  int h;
+  int fmt;
+  int64_t frame;        ///< frame-number of ref
+  int since_key;        ///< number of deltas since the last keyframe
+  uint8_t *ref;         ///< last frame sent on this session
+  size_t ref_len;
+  int refcnt;           ///< number of requests using this session, protected by rd_lock
+  time_t lru;
+  pthread_mutex_t lock; ///< serialize requests of the same session
+  UT_hash_handle hh;
+} RDSession;
+
+/** raw frame memory layout */
+typedef struct {
+  int n_planes;
+  uint8_t *data[4];
+  int linesize[4];
+  int step[4]; ///< bytes per pixel
+  int hsub[4]; ///< log2 horizontal sub-sampling
+  int vsub[4]; ///< log2 vertical sub-sampling
+} RDPlanes;
+
+static RDSession *rd_sessions = NULL;
+static pthread_mutex_t rd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* statistics, protected by rd_lock */
+static uint64_t rd_keyframes = 0;
+static uint64_t rd_deltas = 0;
+static uint64_t rd_bytes_raw = 0;
+static uint64_t rd_bytes_sent = 0;
+
+static void rd_free(RDSession *s) {
+  pthread_mutex_destroy(&s->lock);
+  free(s->name);
+  free(s->ref);
+  free(s);
+}
+
+/* remove expired sessions and make room for a new one
+ * NB. rd_lock must be held */
+static void rd_evict(time_t now) {
+  RDSession *s, *tmp, *slru = NULL;
+  time_t lru = now + 1;
+  HASH_ITER(hh, rd_sessions, s, tmp) {
+    if (s->refcnt > 0) continue;
+    if (s->lru + RDELTA_TIMEOUT < now) {
+      HASH_DEL(rd_sessions, s);
+      rd_free(s);
+    } else if (s->lru < lru) {
+      lru = s->lru;
+      slru = s;
+    }
+  }
+  if (slru && HASH_COUNT(rd_sessions) >= RDELTA_MAX_SESSIONS) {
+    HASH_DEL(rd_sessions, slru);
+    rd_free(slru);
+  }
+}
+
+static RDSession *rd_get_session(const char *name) {
+  RDSession *s = NULL;
+  const time_t now = time(NULL);
+  pthread_mutex_lock(&rd_lock);
+  HASH_FIND_STR(rd_sessions, name, s);
+  if (!s) {
+    rd_evict(now);
+    if (HASH_COUNT(rd_sessions) < RDELTA_MAX_SESSIONS) {
+      s = calloc(1, sizeof(RDSession));
+      s->name = strdup(name);
+      s->frame = -1;
+      pthread_mutex_init(&s->lock, NULL);
+      HASH_ADD_KEYPTR(hh, rd_sessions, s->name, strlen(s->name), s);
+    } else {
+      dlog(DLOG_WARNING, "DELTA: too many sessions, sending keyframe.\n");
+    }
+  }
+  if (s) {
+    s->refcnt++;
+    s->lru = now;
+  }
+  pthread_mutex_unlock(&rd_lock);
+  return s;
+}
+
+static void rd_release_session(RDSession *s) {
+  pthread_mutex_lock(&rd_lock);
+  s->refcnt--;
+  pthread_mutex_unlock(&rd_lock);
+}
+
+/* map a raw frame (as written by the decoder, no padding) */
+static int rd_planes(RDPlanes *p, const uint8_t *buf, size_t len, int fmt, int w, int h) {
+  const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+  int c, i;
+  memset(p, 0, sizeof(RDPlanes));
+  if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))) {
+    return -1;
+  }
+  i = av_image_fill_arrays(p->data, p->linesize, buf, fmt, w, h, 1);
+  if (i < 0 || (size_t) i > len) {
+    return -1;
+  }
+  for (i = 0; i < 4; ++i) {
+    if (!p->data[i]) break;
+    for (c = 0; c < desc->nb_components; ++c) {
+      if (desc->comp[c].plane != i) continue;
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(55, 0, 100)
+      p->step[i] = desc->comp[c].step_minus1 + 1;
+#else
+      p->step[i] = desc->comp[c].step;
+#endif
+      if ((c == 1 || c == 2) && !(desc->flags & AV_PIX_FMT_FLAG_RGB)) {
+        p->hsub[i] = desc->log2_chroma_w;
+        p->vsub[i] = desc->log2_chroma_h;
+      }
+      break;
+    }
+    p->n_planes = i + 1;
+  }
+  return 0;
+}
+
+/* copy or compare the given tile of all planes
+ * if \a out is NULL: return 1 if the tile differs between \a a and \a b
+ * otherwise: copy the tile of \a a to \a out and return the number of bytes
+ */
+static size_t rd_tile(const RDPlanes *a, const RDPlanes *b, int tx, int ty, int w, int h, uint8_t *out) {
+  size_t rv = 0;
+  int i, y;
+  const int px0 = tx * RDELTA_TILE;
+  const int py0 = ty * RDELTA_TILE;
+  const int px1 = px0 + RDELTA_TILE < w ? px0 + RDELTA_TILE : w;
+  const int py1 = py0 + RDELTA_TILE < h ? py0 + RDELTA_TILE : h;
+
+  for (i = 0; i < a->n_planes; ++i) {
+    const int x0 = px0 >> a->hsub[i];
+    const int x1 = RD_CEIL_RSHIFT(px1, a->hsub[i]);
+    const int y0 = py0 >> a->vsub[i];
+    const int y1 = RD_CEIL_RSHIFT(py1, a->vsub[i]);
+    const size_t rowbytes = (x1 - x0) * a->step[i];
+    for (y = y0; y < y1; ++y) {
+      const size_t off = y * a->linesize[i] + x0 * a->step[i];
+      if (!out) {
+        if (memcmp(a->data[i] + off, b->data[i] + off, rowbytes)) {
+          return 1;
+        }
+      } else {
+        memcpy(out + rv, a->data[i] + off, rowbytes);
+        rv += rowbytes;
+      }
+    }
+  }
+  return rv;
+}
+
+#define RD_HEADER_SIZE (4 + 5 * sizeof(int32_t) + 2 * sizeof(int64_t) + 3 * sizeof(int32_t))
+
+static uint8_t *rd_header(uint8_t *p, int32_t flags, int32_t w, int32_t h, int32_t fmt,
+    int64_t frame, int64_t ref, int32_t tiles_x, int32_t tiles_y, int32_t n_tiles) {
+  const int32_t h1[5] = { flags, w, h, fmt, RDELTA_TILE };
+  const int32_t h2[3] = { tiles_x, tiles_y, n_tiles };
+  memcpy(p, "HRD1", 4); p += 4;
+  memcpy(p, h1, sizeof(h1)); p += sizeof(h1);
+  memcpy(p, &frame, sizeof(int64_t)); p += sizeof(int64_t);
+  memcpy(p, &ref, sizeof(int64_t)); p += sizeof(int64_t);
+  memcpy(p, h2, sizeof(h2)); p += sizeof(h2);
+  return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// public API
+
+size_t rdelta_encode(const char *session, unsigned short vid, int64_t frame,
+    int w, int h, int fmt, int keyint,
+    const uint8_t *buf, size_t len, uint8_t **out) {
+  RDSession *s;
+  RDPlanes cur, ref;
+  int32_t *tiles = NULL;
+  int32_t n_tiles = 0;
+  size_t rv = 0;
+  int want_key = 1;
+  const int tiles_x = (w + RDELTA_TILE - 1) / RDELTA_TILE;
+  const int tiles_y = (h + RDELTA_TILE - 1) / RDELTA_TILE;
+
+  *out = NULL;
+  if (!buf || len == 0 || w < 1 || h < 1) {
+    return 0;
+  }
+  if (keyint <= 0) {
+    keyint = RDELTA_KEYINT;
+  }
+
+  s = rd_get_session(session);
+  if (s) {
+    pthread_mutex_lock(&s->lock);
+    want_key = !s->ref || s->vid != vid
+      || s->w != w || s->h != h || s->fmt != fmt || s->ref_len != len
+      || (frame != s->frame && frame != s->frame + 1) // seek
+      || s->since_key + 1 >= keyint;
+  }
+
+  if (!want_key && !rd_planes(&cur, buf, len, fmt, w, h) && !rd_planes(&ref, s->ref, len, fmt, w, h)) {
+    int tx, ty;
+    size_t bytes = 0;
+    tiles = malloc(tiles_x * tiles_y * sizeof(int32_t));
+    for (ty = 0; ty < tiles_y; ++ty) {
+      for (tx = 0; tx < tiles_x; ++tx) {
+        if (rd_tile(&cur, &ref, tx, ty, w, h, NULL)) {
+          tiles[n_tiles++] = ty * tiles_x + tx;
+        }
+      }
+    }
+    bytes = n_tiles * sizeof(int32_t) + (len * n_tiles) / (tiles_x * tiles_y);
+    if (bytes > len * 3 / 4) {
+      /* most of the frame changed, a keyframe is cheaper to apply */
+      want_key = 1;
+    }
+  } else {
+    want_key = 1;
+  }
+
+  if (want_key) {
+    *out = malloc(RD_HEADER_SIZE + len);
+    uint8_t *p = rd_header(*out, RDELTA_KEY, w, h, fmt, frame, -1, tiles_x, tiles_y, 0);
+    memcpy(p, buf, len);
+    rv = RD_HEADER_SIZE + len;
+  } else {
+    int32_t i;
+    *out = malloc(RD_HEADER_SIZE + n_tiles * sizeof(int32_t) + len);
+    uint8_t *p = rd_header(*out, 0, w, h, fmt, frame, s->frame, tiles_x, tiles_y, n_tiles);
+    memcpy(p, tiles, n_tiles * sizeof(int32_t));
+    p += n_tiles * sizeof(int32_t);
+    for (i = 0; i < n_tiles; ++i) {
+      p += rd_tile(&cur, NULL, tiles[i] % tiles_x, tiles[i] / tiles_x, w, h, p);
+    }
+    rv = p - *out;
+  }
+  free(tiles);
+
+  if (s) {
+    if (s->ref_len != len) {
+      free(s->ref);
+      s->ref = malloc(len);
+      s->ref_len = len;
+    }
+    memcpy(s->ref, buf, len);
+    s->vid = vid;
+    s->w = w;
+    s->h = h;
+    s->fmt = fmt;
+    s->frame = frame;
+    s->since_key = want_key ? 0 : s->since_key + 1;
+    pthread_mutex_unlock(&s->lock);
+    rd_release_session(s);
+  }
+
+  pthread_mutex_lock(&rd_lock);
+  if (want_key) rd_keyframes++; else rd_deltas++;
+  rd_bytes_raw += len;
+  rd_bytes_sent += rv;
+  pthread_mutex_unlock(&rd_lock);
+
+  debugmsg(DEBUG_ICS, "DELTA: frame %"PRId64" %s %d/%d tiles, %lu bytes\n", frame,
+      want_key ? "key" : "delta", want_key ? tiles_x * tiles_y : n_tiles, tiles_x * tiles_y, (unsigned long) rv);
+  return rv;
+}
+
+void rdelta_clear(void) {
+  RDSession *s, *tmp;
+  pthread_mutex_lock(&rd_lock);
+  HASH_ITER(hh, rd_sessions, s, tmp) {
+    if (s->refcnt > 0) continue;
+    HASH_DEL(rd_sessions, s);
+    rd_free(s);
+  }
+  pthread_mutex_unlock(&rd_lock);
+}
+
+void rdelta_info_html(char **m, size_t *o, size_t *s) {
+  RDSession *rs, *tmp;
+  pthread_mutex_lock(&rd_lock);
+  rprintf("<h3>Raw Delta Sessions:</h3>\n");
+  rprintf("<p>sessions: %d / %d, keyframes: %"PRIu64", deltas: %"PRIu64", sent: %.1f MiB of %.1f MiB raw",
+      HASH_COUNT(rd_sessions), RDELTA_MAX_SESSIONS, rd_keyframes, rd_deltas,
+      rd_bytes_sent / 1048576.0, rd_bytes_raw / 1048576.0);
+  if (rd_bytes_raw > 0) {
+    rprintf(" (%.1f%%)", 100.0 * rd_bytes_sent / (double) rd_bytes_raw);
+  }
+  rprintf("</p>\n");
+  if (HASH_COUNT(rd_sessions) > 0) {
+    rprintf("<table style=\"text-align:center;width:100%%\">\n");
+    rprintf("<tr><th>Session</th><th>file-id</th><th>Geometry</th><th>Frame#</th><th>Since Key</th><th>LRU</th></tr>\n");
+    HASH_ITER(hh, rd_sessions, rs, tmp) {
+      rprintf("<tr><td>%.32s</td><td>%d</td><td>%dx%d</td><td>%"PRIlld"</td><td>%d</td><td>%"PRIlld"</td></tr>\n",
+          rs->name, rs->vid, rs->w, rs->h, (long long) rs->frame, rs->since_key, (long long) rs->lru);
+    }
+    rprintf("</table>\n");
+  }
+  pthread_mutex_unlock(&rd_lock);
+}
+
+// vim:sw=2 sts=2 ts=8 et:
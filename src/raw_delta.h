@@ -0,0 +1,72 @@
+/**
+   @file raw_delta.h
+   @brief tile based delta encoding of raw frames
+
+   This file is part of harvid
+
+   @author Robin Gareus <robin@gareus.org>
+   @copyright
+
+   Copyright (C) 2026 Robin Gareus <robin@gareus.org>
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2, or (at your option)
+   any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _raw_delta_H
+#define _raw_delta_H
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define RDELTA_TILE 16      ///< tile size in pixels
+#define RDELTA_KEYINT 30    ///< default keyframe interval
+
+/** flags in the delta header */
+#define RDELTA_KEY 1 ///< payload is a complete frame
+
+/**
+ * encode a raw frame relative to the last frame sent on the given session.
+ *
+ * The output is a "HRD1" header (native byte-order):
+ * int32 flags, width, height, pix_fmt, tile-size,
+ * int64 frame, int64 reference-frame (-1 for keyframes),
+ * int32 tiles_x, tiles_y, n_tiles.
+ *
+ * A keyframe is followed by the complete raw frame. Otherwise
+ * n_tiles int32 tile-indices (ty * tiles_x + tx) follow, then the data of
+ * each changed tile in the same order: for every plane the rows of the
+ * tile-rectangle (chroma planes are sub-sampled accordingly).
+ *
+ * @param session client chosen session name
+ * @param vid file id
+ * @param frame frame-number of \a buf
+ * @param w width of \a buf
+ * @param h height of \a buf
+ * @param fmt pixel-format (AVPixelFormat) of \a buf
+ * @param keyint send a keyframe at least every \a keyint frames, 0: default
+ * @param buf raw frame
+ * @param len size of \a buf in bytes
+ * @param out newly allocated encoded data, free() after use
+ * @return size of \a out in bytes, 0 on error
+ */
+size_t rdelta_encode(const char *session, unsigned short vid, int64_t frame,
+    int w, int h, int fmt, int keyint,
+    const uint8_t *buf, size_t len, uint8_t **out);
+
+/** free all sessions */
+void rdelta_clear(void);
+
+/** HTML format session statistics */
+void rdelta_info_html(char **m, size_t *o, size_t *s);
+
+#endif
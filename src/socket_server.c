@@ -164,10 +164,15 @@ static int server_bind(ICI *d, struct sockaddr_in addr) {
 #define CON_TIMEOUT (300) // ICSP 5 min
 
 static int global_shutdown = 0;
+static volatile int global_reload = 0;
 #ifdef CATCH_SIGNALS
 void catchsig (int sig) {
   //signal(SIGHUP, catchsig); /* reset signal */
   //signal(SIGINT, catchsig);
+  if (sig == SIGHUP) {
+    global_reload = 1; // handled by main_loop()
+    return;
+  }
   dlog(DLOG_INFO, "SRV: caught signal, shutting down\n");
   global_shutdown = 1;
 }
@@ -356,6 +361,15 @@ static int main_loop (void *arg) {
     fd_set rfds;
     struct timeval tv;
 
+    if (global_reload) {
+      global_reload = 0;
+      if (protocol_reload(d->userdata)) {
+        dlog(DLOG_INFO, "SRV: caught signal, shutting down\n");
+        global_shutdown = 1;
+        continue;
+      }
+    }
+
     tv.tv_sec = 1; tv.tv_usec = 0;
     FD_ZERO(&rfds);
     FD_SET(d->fd, &rfds);
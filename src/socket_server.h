@@ -152,4 +152,14 @@ void protocol_response(int fd, char *msg);
  */
 int protocol_droid(CONN *c, void *d); // called if socket is writable and c->cq is not NULL
 
+/**
+ * virtual callback - implement this for the server's protocol.
+ *
+ * this callback is executed in the server's main thread after SIGHUP was received.
+ *
+ * @param d user/application specific server-data from \ref start_tcp_server()
+ * @return return 0 if the configuration was reloaded, non zero shuts down the server.
+ */
+int protocol_reload(void *d);
+
 #endif